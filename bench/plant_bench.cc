@@ -0,0 +1,328 @@
+// plant_bench.cc — Google Benchmark suite for the plant, packing and controller hot paths
+//
+// Every benchmark reports ns/op (real_time) plus an "ops/s" rate counter. For JSON:
+//   ./plant_bench --benchmark_format=json --benchmark_out=bench.json
+// or `cmake --build <dir> --target bench_json` (writes <dir>/bench_output.json).
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+extern "C" {
+  #include "plant_user_api.h"
+  #include "ctrl_set_api.h"
+  #include "controller_core.h"
+  #include "rx_ring.h"
+}
+
+static void ops_rate(benchmark::State& st, double per_iter = 1.0) {
+  st.counters["ops/s"] = benchmark::Counter(per_iter * static_cast<double>(st.iterations()),
+                                            benchmark::Counter::kIsRate);
+}
+
+// Inputs cycle through a small table so the compiler cannot fold the call.
+static const double kTemps[8] = {-5.0, 12.5, 25.0, 40.0, 60.0, 75.5, 90.0, 118.0};
+static const double kRpm[8]   = {0.0, 150.0, 700.0, 1200.0, 1650.0, 2100.0, 2500.0, 2800.0};
+
+/*** -------- Plant model -------- ***/
+static void BM_mu_water(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(mu_water(kTemps[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_mu_water);
+
+static void BM_mu_water_fast(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(mu_water_fast(kTemps[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_mu_water_fast);
+
+static void BM_UA_func(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(UA_func(kRpm[i++ & 7], 0.0));
+  ops_rate(st);
+}
+BENCHMARK(BM_UA_func);
+
+static void BM_UA_func_fast(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(UA_func_fast(kRpm[i++ & 7], 0.0));
+  ops_rate(st);
+}
+BENCHMARK(BM_UA_func_fast);
+
+static void BM_Psys(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(Psys(0.0, kTemps[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_Psys);
+
+// Arg: 0 = exact libm model, 1 = --fast_math tables
+static void BM_plant_step(benchmark::State& st) {
+  plant_set_fast_math((int)st.range(0));
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 1200.0};
+  unsigned i = 0;
+  for (auto _ : st) {
+    plant_step(&s, 2000.0, kRpm[(i++ >> 10) & 7], 0.010);
+    benchmark::DoNotOptimize(s);
+  }
+  plant_set_fast_math(0);
+  ops_rate(st);
+}
+BENCHMARK(BM_plant_step)->Arg(0)->Arg(1);
+
+static void BM_plant_step_rosenbrock(benchmark::State& st) {
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 1200.0};
+  for (auto _ : st) {
+    plant_step_rosenbrock(&s, 2000.0, 1200.0, 0.010);
+    benchmark::DoNotOptimize(s);
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_plant_step_rosenbrock);
+
+// Args: fleet size, kernel (0 scalar, 1 avx2, 2 avx512); ops/s counts plant steps
+static void BM_plant_batch_step(benchmark::State& st) {
+  static const char* const kIsa[] = {"scalar", "avx2", "avx512"};
+  const size_t n = (size_t)st.range(0);
+  if (plant_batch_select_isa(kIsa[st.range(1)]) != 0) { st.SkipWithError("ISA not supported"); return; }
+  PlantBatch b;
+  if (plant_batch_init(&b, n) != 0) { st.SkipWithError("plant_batch_init"); return; }
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 1200.0};
+  for (size_t k = 0; k < n; ++k) plant_batch_set(&b, k, &s);
+  std::vector<double> om(n, 2000.0), v(n, 1200.0);
+  for (auto _ : st) {
+    plant_batch_step(&b, om.data(), v.data(), 0.010);
+    benchmark::ClobberMemory();
+  }
+  st.SetLabel(plant_batch_isa());
+  ops_rate(st, (double)n);
+  plant_batch_free(&b);
+  plant_batch_select_isa(nullptr);
+}
+BENCHMARK(BM_plant_batch_step)->ArgsProduct({{64, 4096}, {0, 1, 2}});
+
+/*** -------- 0x202 packing -------- ***/
+static void BM_pack_temp_q10(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(pack_temp_q10(kTemps[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_pack_temp_q10);
+
+static void BM_pack_v_prev_q10(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(pack_v_prev_q10(kRpm[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_pack_v_prev_q10);
+
+static void BM_pack_dt_ms(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(pack_dt_ms(kTemps[i++ & 7] * 1e-3));
+  ops_rate(st);
+}
+BENCHMARK(BM_pack_dt_ms);
+
+static void BM_plant_pack_feedback(benchmark::State& st) {
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 1200.0};
+  struct can_frame f;
+  for (auto _ : st) {
+    plant_pack_feedback(&s, 0.010, &f);
+    benchmark::DoNotOptimize(f);
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_plant_pack_feedback);
+
+static void BM_plant_pack_feedback_fd(benchmark::State& st) {
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 1200.0};
+  struct canfd_frame f;
+  for (auto _ : st) {
+    plant_pack_feedback_fd(&s, 0.010, &f);
+    benchmark::DoNotOptimize(f);
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_plant_pack_feedback_fd);
+
+/*** -------- ctrl_set quantizers -------- ***/
+static const float kGains[8] = {-0.15f, 0.01f, 0.1f, 4.0f, 5.0f, 100.6f, 130.0f, 300.0f};
+
+static void BM_to_q01(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(to_q01((float)kTemps[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_to_q01);
+
+static void BM_to_q88(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(to_q88(kGains[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_to_q88);
+
+static void BM_to_q44(benchmark::State& st) {
+  unsigned i = 0;
+  for (auto _ : st) benchmark::DoNotOptimize(to_q44(kGains[i++ & 7]));
+  ops_rate(st);
+}
+BENCHMARK(BM_to_q44);
+
+/*** -------- Controller core (same source as controller_kernel.ko) -------- ***/
+static void BM_controller_step(benchmark::State& st) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  c.have_feedback = true;
+  c.dt_us = 10000;
+  c.Th = Q_FROM_INT(35);
+  c.v_prev_rpm = 1200;
+  unsigned i = 0;
+  for (auto _ : st) {
+    c.Ts = Q_FROM_INT(20 + (int)(i++ & 31));   // walks through both clamp regions
+    controller_step(&c);
+    benchmark::DoNotOptimize(c.omega_cmd_rpm);
+    benchmark::DoNotOptimize(c.v_cmd_rpm);
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_controller_step);
+
+// 0x202 decode + controller_step, i.e. the per-frame work of nodeb_rx_work
+static void BM_ctrl_rx_feedback(benchmark::State& st) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  Plant s{.Ts = 30.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.2, .v_prev = 1200.0};
+  struct can_frame f;
+  plant_pack_feedback(&s, 0.010, &f);
+  unsigned i = 0;
+  for (auto _ : st) {
+    f.data[0] = (uint8_t)(i++ & 63);
+    benchmark::DoNotOptimize(ctrl_rx_frame(&c, 0x202, f.data, f.len));
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_ctrl_rx_feedback);
+
+// Same with the 32-byte CAN FD 0x202 (Q16.16 fields, no scaling divisions)
+static void BM_ctrl_rx_feedback_fd(benchmark::State& st) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  Plant s{.Ts = 30.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.2, .v_prev = 1200.0};
+  struct canfd_frame f;
+  plant_pack_feedback_fd(&s, 0.010, &f);
+  unsigned i = 0;
+  for (auto _ : st) {
+    f.data[0] = (uint8_t)(i++ & 63);
+    benchmark::DoNotOptimize(ctrl_rx_frame(&c, 0x202, f.data, f.len));
+  }
+  ops_rate(st);
+}
+BENCHMARK(BM_ctrl_rx_feedback_fd);
+
+/*** -------- Node B RX queue: one spinlocked FIFO vs per-CPU lock-free rings -------- ***/
+// Arg = producer threads standing in for RX softirqs on different CPUs; this thread is
+// nodeb_rx_work. Each producer stamps and queues kRxPerProducer frames the size of
+// controller_kernel.c's rx_item; the consumer takes them all, from the rings via the same
+// timestamp merge as nodeb_rings_next(). Full/empty queues yield rather than spin so the
+// numbers stay meaningful with fewer cores than threads. ops/s = frames delivered.
+struct BenchRxItem { struct canfd_frame cf; uint64_t t_rx_ns; };
+static const uint32_t kRxDepth = 128;          // rx_fifo_len default
+static const uint32_t kRxPerProducer = 1u << 15;
+
+static uint64_t bench_now_ns() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The old path: kfifo + spin_lock_irqsave shared by every CPU and the work item
+struct LockedRxQueue {
+  std::atomic_flag lock = ATOMIC_FLAG_INIT;
+  BenchRxItem slot[kRxDepth];
+  uint32_t in = 0, out = 0;
+  void acquire() { while (lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+  void release() { lock.clear(std::memory_order_release); }
+  bool put(const BenchRxItem& it) {
+    acquire();
+    bool ok = in - out < kRxDepth;
+    if (ok) slot[in++ % kRxDepth] = it;
+    release();
+    return ok;
+  }
+  bool take(BenchRxItem* it) {
+    acquire();
+    bool ok = in != out;
+    if (ok) *it = slot[out++ % kRxDepth];
+    release();
+    return ok;
+  }
+};
+
+static void BM_RxLockedQueue(benchmark::State& st) {
+  const int np = (int)st.range(0);
+  const uint64_t total = (uint64_t)np * kRxPerProducer;
+  for (auto _ : st) {
+    LockedRxQueue q;
+    std::vector<std::thread> prod;
+    for (int p = 0; p < np; p++)
+      prod.emplace_back([&q, p] {
+        BenchRxItem it{};
+        it.cf.can_id = 0x300 + p;
+        for (uint32_t i = 0; i < kRxPerProducer; i++) {
+          it.t_rx_ns = bench_now_ns();
+          while (!q.put(it)) std::this_thread::yield();
+        }
+      });
+    BenchRxItem it;
+    for (uint64_t got = 0; got < total;) {
+      if (q.take(&it)) { benchmark::DoNotOptimize(it.t_rx_ns); got++; }
+      else std::this_thread::yield();
+    }
+    for (auto& t : prod) t.join();
+  }
+  ops_rate(st, (double)total);
+}
+BENCHMARK(BM_RxLockedQueue)->Arg(1)->Arg(2)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void BM_RxPerCpuRings(benchmark::State& st) {
+  const int np = (int)st.range(0);
+  const uint64_t total = (uint64_t)np * kRxPerProducer;
+  std::vector<BenchRxItem> slots((size_t)np * kRxDepth), front(np);
+  std::vector<struct rx_ring> ring(np);
+  for (auto _ : st) {
+    for (int p = 0; p < np; p++)
+      rx_ring_init(&ring[p], &slots[(size_t)p * kRxDepth], kRxDepth, sizeof(BenchRxItem));
+    std::vector<std::thread> prod;
+    for (int p = 0; p < np; p++)
+      prod.emplace_back([&ring, p] {
+        BenchRxItem it{};
+        it.cf.can_id = 0x300 + p;
+        for (uint32_t i = 0; i < kRxPerProducer; i++) {
+          it.t_rx_ns = bench_now_ns();
+          while (rx_ring_put(&ring[p], &it, false) == RX_RING_FULL) std::this_thread::yield();
+        }
+      });
+    std::vector<bool> valid(np, false);
+    for (uint64_t got = 0; got < total;) {
+      int best = -1;
+      for (int p = 0; p < np; p++) {
+        if (!valid[p]) valid[p] = rx_ring_take(&ring[p], &front[p]);
+        if (valid[p] && (best < 0 || front[p].t_rx_ns < front[best].t_rx_ns)) best = p;
+      }
+      if (best < 0) { std::this_thread::yield(); continue; }
+      benchmark::DoNotOptimize(front[best].t_rx_ns);
+      valid[best] = false;
+      got++;
+    }
+    for (auto& t : prod) t.join();
+  }
+  ops_rate(st, (double)total);
+}
+BENCHMARK(BM_RxPerCpuRings)->Arg(1)->Arg(2)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0
+// controller_core.c — Node B controller core shared by the kernel module and user space
+// Kernel:     #included by controller_kernel.c (keeps the module a single controller_kernel.ko)
+// User space: gcc -O2 -Wall -c controller/controller_core.c   (or CMake controller_core_obj)
+
+#include "controller_core.h"
+
+#ifndef __KERNEL__
+#include <string.h>
+#endif
+
+/* -------------------------- Defaults ----------------------------------- */
+void ctrl_defaults(struct ctrl_cfg *cfg)
+{
+	cfg->Ts_sp = Q_FROM_INT(25);
+
+	/* Python: KpT=100.6, KiT=0.10, KdT=4.0 */
+	cfg->KpT = Q_FROM_INT(100) + (Q_ONE/5 + Q_ONE/10); /* ≈100.6 */
+	cfg->KiT = Q_ONE/10;     /* 0.10 */
+	cfg->KdT = Q_FROM_INT(4);
+
+	cfg->Kpm = Q_FROM_INT(130);
+	cfg->Kim = Q_ONE/100;    /* 0.01 */
+
+	cfg->kawT = Q_FROM_INT(5);
+	cfg->kawm = Q_FROM_INT(10);
+
+	/* kvw≈-0.15, kwv≈-0.02 */
+	cfg->kvw = -(Q_ONE/6 + Q_ONE/30);
+	cfg->kwv = -(Q_ONE/50);
+
+	cfg->omega0_rpm = 100;
+	cfg->v0_rpm     = 100;
+
+	cfg->omega_max_rpm = 4000;
+	cfg->v_max_rpm     = 2800;
+	cfg->v_cut_rpm     = 700;
+
+	cfg->tau_d_min_s   = Q_ONE/1000; /* 0.001 s minimum */
+}
+
+void ctrl_reset(struct ctrl_core *c)
+{
+	memset(c, 0, sizeof(*c));
+	ctrl_defaults(&c->cfg);
+	c->st.tau_d = Q_FROM_INT(1); /* start tau_d=1s; clamped by tau_d_min_s */
+}
+
+/* -------------------------- Controller core ---------------------------- */
+void controller_step(struct ctrl_core *c)
+{
+	if (!c->have_feedback || c->dt_us == 0) {
+		c->omega_cmd_rpm = 0;
+		c->v_cmd_rpm     = 0;
+		c->omega_cmd_q   = 0;
+		c->v_cmd_q       = 0;
+		return;
+	}
+
+	/* dt seconds in Q16.16 (whole ms give exactly the old dt_ms/1000 result) */
+	q16_16 dt = Q_DIV(Q_FROM_INT(c->dt_us), Q_FROM_INT(1000000));
+
+	/* ----- Flow loop (pump) ----- */
+	q16_16 e_m = c->cfg.Ts_sp - c->Ts; /* Ts_sp - Ts */
+
+	q16_16 omega0_q = Q_FROM_INT(c->cfg.omega0_rpm);
+	q16_16 omega_raw_q = -(omega0_q
+		+ Q_MUL(c->cfg.Kpm, e_m)
+		+ Q_MUL(c->cfg.Kim, c->st.eta_m));
+
+	q16_16 v_prev_q = Q_FROM_INT(c->v_prev_rpm);
+	q16_16 v_ff_q   = Q_FROM_INT(c->cfg.v0_rpm);
+	q16_16 omega_cmd_q = omega_raw_q + Q_MUL(c->cfg.kwv, (v_prev_q - v_ff_q));
+
+	int omega_cmd_i = Q_TO_INT(omega_cmd_q);
+	if (omega_cmd_i < 0) omega_cmd_i = 0;
+	if (omega_cmd_i > c->cfg.omega_max_rpm) omega_cmd_i = c->cfg.omega_max_rpm;
+
+	q16_16 omega_cmd_q16 = Q_FROM_INT(omega_cmd_i);
+	q16_16 omega_err_q   = omega_cmd_q16 - omega_raw_q;
+	c->st.eta_m += Q_MUL( (e_m + Q_MUL(c->cfg.kawm, omega_err_q)), dt );
+	c->st.eta_m  = q_sat(c->st.eta_m, Q_FROM_INT(-200), Q_FROM_INT(200));
+
+	/* ----- Temperature loop (fan) ----- */
+	q16_16 e_T = c->cfg.Ts_sp - c->Ts;
+
+	if (c->st.tau_d < c->cfg.tau_d_min_s) c->st.tau_d = c->cfg.tau_d_min_s;
+
+	q16_16 Th_minus = c->Th - c->st.dTh_f;
+	q16_16 term1 = Q_DIV(Th_minus, dt);               /* (Th - dTh_f)/dt */
+	q16_16 term2 = Q_DIV(c->st.dTh_f, c->st.tau_d);   /* dTh_f / tau_d */
+	c->st.dTh_f += Q_MUL((term1 - term2), dt);
+
+	q16_16 v0_q = Q_FROM_INT(c->cfg.v0_rpm);
+	q16_16 v_raw_q = -(v0_q
+		+ Q_MUL(c->cfg.KpT, e_T)
+		+ Q_MUL(c->cfg.KiT, c->st.eta_T)
+		- Q_MUL(c->cfg.KdT, c->st.dTh_f));
+
+	q16_16 omega_ff_q = Q_FROM_INT(c->cfg.omega0_rpm);
+	q16_16 v_cmd_q = v_raw_q + Q_MUL(c->cfg.kvw, (omega_cmd_q16 - omega_ff_q));
+
+	int v_cmd_i = Q_TO_INT(v_cmd_q);
+	if (v_cmd_i < 0) v_cmd_i = 0;
+	if (v_cmd_i > c->cfg.v_max_rpm) v_cmd_i = c->cfg.v_max_rpm;
+	if (v_cmd_i < c->cfg.v_cut_rpm) v_cmd_i = 0;
+
+	q16_16 v_cmd_q16 = Q_FROM_INT(v_cmd_i);
+	q16_16 v_err_q   = v_cmd_q16 - v_raw_q;
+	c->st.eta_T += Q_MUL( (e_T + Q_MUL(c->cfg.kawT, v_err_q)), dt );
+	c->st.eta_T  = q_sat(c->st.eta_T, Q_FROM_INT(-500), Q_FROM_INT(500));
+
+	c->omega_cmd_rpm = (uint16_t)omega_cmd_i;
+	c->v_cmd_rpm     = (uint16_t)v_cmd_i;
+	c->omega_cmd_q   = q_sat(omega_cmd_q, 0, Q_FROM_INT(c->cfg.omega_max_rpm));
+	c->v_cmd_q       = v_cmd_i ? q_sat(v_cmd_q, Q_FROM_INT(c->cfg.v_cut_rpm),
+					   Q_FROM_INT(c->cfg.v_max_rpm)) : 0;
+}
+
+/* -------------------------- Frame decode/encode ------------------------ */
+#define CTRL_FD_DT_US_MIN 16u        /* smallest dt that is non-zero in Q16.16 seconds */
+#define CTRL_FD_DT_US_MAX 1000000u   /* 1 s; keeps Q_DIV(dt_us) inside int64 */
+
+static enum ctrl_rx_kind ctrl_rx_feedback_fd(struct ctrl_core *c, const uint8_t *data)
+{
+	uint32_t dt_us = le_to_u32(&data[20]);
+	int32_t  v_q   = le_to_s32(&data[16]);
+
+	c->Ts   = le_to_s32(&data[0]);
+	c->Th   = le_to_s32(&data[4]);
+	c->Tc   = le_to_s32(&data[8]);
+	c->mdot = le_to_s32(&data[12]);
+	c->fb_seq = data[CTRL_FD_SEQ_BYTE];
+	/* 0..v_max_rpm, as a classic frame (10 rpm steps up to 2550) can carry */
+	c->v_prev_rpm = v_q <= 0 ? 0 :
+			(Q_TO_INT(v_q) > c->cfg.v_max_rpm ? c->cfg.v_max_rpm : (uint16_t)Q_TO_INT(v_q));
+	c->dt_us = dt_us < CTRL_FD_DT_US_MIN ? CTRL_FD_DT_US_MIN :
+		   (dt_us > CTRL_FD_DT_US_MAX ? CTRL_FD_DT_US_MAX : dt_us);
+	c->have_feedback = true;
+	controller_step(c);
+	return CTRL_RX_FEEDBACK;
+}
+
+enum ctrl_rx_kind ctrl_rx_frame(struct ctrl_core *c, uint32_t id,
+				const uint8_t *data, uint8_t len)
+{
+	switch (id) {
+	case 0x101:
+		return CTRL_RX_HELLO;
+
+	case 0x202: /* Plant feedback: Ts,Th,Tc,v_prev,dt */
+		if (len == CTRL_FD_FEEDBACK_LEN)
+			return ctrl_rx_feedback_fd(c, data);
+		if (len != 8)
+			return CTRL_RX_IGNORED;
+		c->Ts = q_from_q01_temp(le_to_s16(&data[0]));
+		c->Th = q_from_q01_temp(le_to_s16(&data[2]));
+		c->Tc = q_from_q01_temp(le_to_s16(&data[4]));
+		c->mdot = 0;
+		c->fb_seq++;   /* no room for a sequence byte: node C counts its frames the same way */
+		c->v_prev_rpm = (uint16_t)(data[6] * 10u);
+		c->dt_us = (data[7] ? data[7] : 1) * 1000u;
+		c->have_feedback = true;
+		controller_step(c);   /* compute omega_cmd/v_cmd now */
+		return CTRL_RX_FEEDBACK;
+
+	case 0x301: /* setpoint from node A */
+		if (len < 2)
+			return CTRL_RX_IGNORED;
+		c->cfg.Ts_sp = q_from_q01_temp(le_to_s16(&data[0]));
+		return CTRL_RX_SETPOINT;
+
+	case 0x300: /* [0..1] KpT q8.8, [2..3] KiT q8.8, [4..5] KdT q8.8, [6] kawT q4.4 */
+		if (len < 7)
+			return CTRL_RX_IGNORED;
+		c->cfg.KpT  = (q16_16)le_to_u16(&data[0]) << 8;   /* q8.8 -> Q16.16 */
+		c->cfg.KiT  = (q16_16)le_to_u16(&data[2]) << 8;
+		c->cfg.KdT  = (q16_16)le_to_u16(&data[4]) << 8;
+		c->cfg.kawT = (q16_16)data[6] << 12;             /* q4.4 -> Q16.16 */
+		return CTRL_RX_GAINS_T;
+
+	case 0x302: /* Kpm/Kim (q8.8), kawm/kvw/kwv (q4.4) */
+		if (len < 7)
+			return CTRL_RX_IGNORED;
+		c->cfg.Kpm  = (q16_16)le_to_u16(&data[0]) << 8;
+		c->cfg.Kim  = (q16_16)le_to_u16(&data[2]) << 8;
+		c->cfg.kawm = (q16_16)data[4] << 12;
+		c->cfg.kvw  = (q16_16)data[5] << 12;
+		c->cfg.kwv  = (q16_16)data[6] << 12;
+		return CTRL_RX_GAINS_M;
+
+	case CTRL_FD_PARAMS_ID: /* FD: everything node A sets, Q16.16 each */
+		if (len < CTRL_FD_PARAMS_LEN)
+			return CTRL_RX_IGNORED;
+		c->cfg.Ts_sp = le_to_s32(&data[0]);
+		c->cfg.KpT   = le_to_s32(&data[4]);
+		c->cfg.KiT   = le_to_s32(&data[8]);
+		c->cfg.KdT   = le_to_s32(&data[12]);
+		c->cfg.kawT  = le_to_s32(&data[16]);
+		c->cfg.Kpm   = le_to_s32(&data[20]);
+		c->cfg.Kim   = le_to_s32(&data[24]);
+		c->cfg.kawm  = le_to_s32(&data[28]);
+		c->cfg.kvw   = le_to_s32(&data[32]);
+		c->cfg.kwv   = le_to_s32(&data[36]);
+		return CTRL_RX_PARAMS;
+
+	default:
+		return CTRL_RX_IGNORED;
+	}
+}
+
+void ctrl_tx_payload(const struct ctrl_core *c, uint8_t data[8])
+{
+	memset(data, 0, 8);
+	le_put_u16(&data[0], c->omega_cmd_rpm);  /* bytes 0..1: omega_cmd rpm LE */
+	le_put_u16(&data[2], c->v_cmd_rpm);      /* bytes 2..3: v_cmd rpm LE */
+	data[CTRL_ECHO_BYTE] = c->fb_seq;        /* byte 4: which 0x202 this answers */
+}
+
+uint8_t ctrl_tx_payload_fd(const struct ctrl_core *c, uint8_t data[CTRL_FD_CMD_LEN])
+{
+	memset(data, 0, CTRL_FD_CMD_LEN);
+	le_put_u32(&data[0], (uint32_t)c->omega_cmd_q);  /* Q16.16 rpm, already clamped >= 0 */
+	le_put_u32(&data[4], (uint32_t)c->v_cmd_q);
+	data[CTRL_FD_ECHO_BYTE] = c->fb_seq;
+	return CTRL_FD_CMD_LEN;
+}
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* controller_core.h — Node B controller arithmetic and frame decoding, no kernel dependencies
+ *
+ * Compiled into controller_kernel.ko (controller_kernel.c includes controller_core.c) and
+ * into user space (CMake controller_core_obj) for GTest, benchmarks and plant_sim. The
+ * plant side (plant_user, plant_replay, plant_rec) takes its frame layouts and LE helpers
+ * from here too.
+ * Everything here is plain C on fixed-width integers: no locks, no allocation, no printk.
+ */
+#pragma once
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* -------------------------- Q16.16 fixed-point helpers ----------------- */
+typedef int64_t q16_16;
+#define Q_ONE          ((q16_16)1 << 16)
+#define Q_FROM_INT(x)  ((q16_16)(x) * 65536)   /* not << : x may be negative */
+#define Q_TO_INT(x)    ((int)((x) >> 16))
+#define Q_MUL(a,b)     ((q16_16)(((int64_t)(a) * (int64_t)(b)) >> 16))
+#define Q_DIV(a,b)     ((q16_16)(((int64_t)(a) * 65536) / (int64_t)(b)))
+static inline q16_16 q_sat(q16_16 x, q16_16 lo, q16_16 hi)
+{ return x < lo ? lo : (x > hi ? hi : x); }
+
+/* LE helpers + temp converter */
+static inline int16_t  le_to_s16(const uint8_t *d){ return (int16_t)((uint16_t)d[0] | ((uint16_t)d[1] << 8)); }
+static inline uint16_t le_to_u16(const uint8_t *d){ return (uint16_t)d[0] | ((uint16_t)d[1] << 8); }
+static inline void le_put_u16(uint8_t *dst, uint16_t v){ dst[0]=(uint8_t)(v & 0xFF); dst[1]=(uint8_t)(v>>8); }
+static inline uint32_t le_to_u32(const uint8_t *d)
+{ return (uint32_t)d[0] | ((uint32_t)d[1] << 8) | ((uint32_t)d[2] << 16) | ((uint32_t)d[3] << 24); }
+static inline int32_t  le_to_s32(const uint8_t *d){ return (int32_t)le_to_u32(d); }
+static inline void le_put_u32(uint8_t *dst, uint32_t v)
+{ dst[0]=(uint8_t)v; dst[1]=(uint8_t)(v>>8); dst[2]=(uint8_t)(v>>16); dst[3]=(uint8_t)(v>>24); }
+/* 0.1°C -> Q16.16 °C */
+static inline q16_16 q_from_q01_temp(int16_t t_q01)
+{ return (q16_16)(((int64_t)t_q01 * (int64_t)Q_ONE) / 10); }
+
+/* -------------------------- CAN FD layouts ------------------------------ */
+/* FD frames reuse 0x201/0x202 and are told apart by their length; all fields LE.
+ *
+ * 0x202 feedback, 32 bytes:
+ *   [0..3] Ts  [4..7] Th  [8..11] Tc   s32 Q16.16 °C
+ *   [12..15] mdot s32 Q16.16 kg/s   [16..19] v_prev u32 Q16.16 rpm   [20..23] dt u32 µs
+ *   [24] sequence number   [25..31] reserved, zero
+ * 0x201 command, 12 bytes:
+ *   [0..3] omega_cmd  [4..7] v_cmd   u32 Q16.16 rpm   [8] echo of the last 0x202 sequence
+ *   [9..11] reserved, zero
+ * 0x310 parameters, 48 bytes (replaces 0x301 + 0x300 + 0x302):
+ *   [0..3] Ts_sp  [4..7] KpT  [8..11] KiT  [12..15] KdT  [16..19] kawT
+ *   [20..23] Kpm  [24..27] Kim  [28..31] kawm  [32..35] kvw  [36..39] kwv
+ *   all s32 Q16.16 (signed, so negative decoupling gains survive); [40..47] reserved
+ */
+#define CTRL_FD_FEEDBACK_LEN 32
+#define CTRL_FD_CMD_LEN      12
+#define CTRL_FD_PARAMS_ID    0x310
+#define CTRL_FD_PARAMS_LEN   48
+#define CTRL_FD_SEQ_BYTE     24   /* in 0x202 */
+#define CTRL_FD_ECHO_BYTE    8    /* in 0x201 */
+#define CTRL_ECHO_BYTE       4    /* in classic 0x201 */
+
+/* -------------------------- Controller config/state -------------------- */
+struct ctrl_cfg {
+	q16_16 Ts_sp;           /* °C (Q16.16); default 25 */
+
+	/* Gains in Q16.16 */
+	q16_16 KpT, KiT, KdT;   /* temperature loop */
+	q16_16 Kpm, Kim;        /* flow loop       */
+	q16_16 kawT, kawm;      /* anti-windup back-calculation */
+	q16_16 kvw,  kwv;       /* decoupling */
+
+	/* Integer domains */
+	uint16_t omega0_rpm, v0_rpm; /* feedforward baselines */
+	uint16_t omega_max_rpm, v_max_rpm;
+	uint16_t v_cut_rpm;          /* fan cut-in (e.g., 700 rpm) */
+
+	q16_16 tau_d_min_s;     /* min derivative filter time constant (>= 1e-3 s) */
+};
+
+struct ctrl_state {
+	q16_16 eta_T, eta_m;    /* integrators */
+	q16_16 dTh_f;           /* derivative filter state (°C in Q16.16) */
+	q16_16 tau_d;           /* current tau_d (s in Q16.16) */
+};
+
+/* Everything controller_step() reads and writes */
+struct ctrl_core {
+	struct ctrl_cfg   cfg;
+	struct ctrl_state st;
+
+	/* Latest plant feedback */
+	q16_16   Ts, Th, Tc;        /* °C (Q16.16) */
+	q16_16   mdot;              /* kg/s (Q16.16); FD feedback only, informational */
+	uint16_t v_prev_rpm;        /* rpm */
+	uint32_t dt_us;             /* step, µs (classic frames: 1..255 ms) */
+	uint8_t  fb_seq;            /* echoed in 0x201: FD byte 24, classic = latched 0x202 count */
+	bool     have_feedback;
+
+	/* Last computed command */
+	uint16_t omega_cmd_rpm;
+	uint16_t v_cmd_rpm;
+	q16_16   omega_cmd_q, v_cmd_q;  /* same command before truncation (FD 0x201) */
+};
+
+/* What ctrl_rx_frame() did with a frame */
+enum ctrl_rx_kind {
+	CTRL_RX_IGNORED = 0,    /* unknown ID or short frame */
+	CTRL_RX_HELLO,          /* 0x101 */
+	CTRL_RX_FEEDBACK,       /* 0x202: feedback latched, controller_step() run */
+	CTRL_RX_SETPOINT,       /* 0x301 */
+	CTRL_RX_GAINS_T,        /* 0x300 */
+	CTRL_RX_GAINS_M,        /* 0x302 */
+	CTRL_RX_PARAMS,         /* 0x310 (FD): setpoint and both gain sets */
+};
+
+void ctrl_defaults(struct ctrl_cfg *cfg);
+void ctrl_reset(struct ctrl_core *c);      /* defaults + zeroed state, tau_d = 1 s */
+void controller_step(struct ctrl_core *c);
+
+/* Decode one CAN or CAN FD frame (ID without flags, payload, length) into c */
+enum ctrl_rx_kind ctrl_rx_frame(struct ctrl_core *c, uint32_t id,
+				const uint8_t *data, uint8_t len);
+/* 0x201 payload: omega_cmd, v_cmd (rpm, LE); byte 4 fb_seq echo; bytes 5..7 zero */
+void ctrl_tx_payload(const struct ctrl_core *c, uint8_t data[8]);
+/* FD 0x201 payload (see above); returns CTRL_FD_CMD_LEN */
+uint8_t ctrl_tx_payload_fd(const struct ctrl_core *c, uint8_t data[CTRL_FD_CMD_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,8 +2,14 @@
 // controller_kernel.c — Node B with ISR-like RX using can_rx_register() + bottom half
 // Build:  make -C /lib/modules/$(uname -r)/build M=$PWD modules
 // Load:   sudo insmod controller_kernel.ko ifname=vcan0 period_ms=100 idle_ms=1500
+//         ... tx_path=skb                         (0x201 via can_send() from softirq timers)
+//         ... bh_prio=80 bh_cpu=3 timer_cpu=3   (RT kthread + timers on an isolated CPU)
+//         ... loops=48                              (48 controllers, loop k on every ID + k*id_stride)
 // Unload: sudo rmmod controller_kernel
-// Show:   dmesg -w | grep -E '^\[B\]| nodeb'
+// Show:   dmesg -w | grep -E '^\[B\]| nodeb'          (state changes only)
+// Trace:  trace-cmd record -e nodeb                       (per-frame RX/TX/step, see nodeb_trace.h)
+// Stats:  cat /sys/kernel/debug/nodeb/{timer_late,rx_latency,step_time,fb_latency}  (echo 0 > ... resets)
+//         grep . /sys/module/controller_kernel/stats/*
 
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -17,17 +23,30 @@
 #include <net/sock.h>
 
 #include <linux/spinlock.h>
-#include <linux/kfifo.h>
 #include <linux/workqueue.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/types.h>   /* s64/u64 */
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/seqlock.h>
+#include <linux/cpumask.h>
+#include <linux/bitmap.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/sched/types.h>   /* struct sched_attr */
+#include <linux/smp.h>
 
 #include <linux/can.h>
 #include <linux/can/core.h>  /* can_rx_register / unregister */
 #include <linux/can/raw.h>
+#include <linux/can/skb.h>   /* can_skb_reserve / can_skb_prv */
 
 #if IS_ENABLED(CONFIG_KUNIT)
 #include <kunit/test.h>
@@ -48,6 +67,94 @@ static int idle_ms = 3000;
 module_param(idle_ms, int, 0644);
 MODULE_PARM_DESC(idle_ms, "Idle window (ms) without 0x202 before stopping TX");
 
+/* CAN FD: 0x201 goes out as a 12-byte Q16.16 frame. RX takes classic and FD frames either way. */
+static bool fd_mode;
+module_param(fd_mode, bool, 0444);
+MODULE_PARM_DESC(fd_mode, "Send 0x201 as a CAN FD frame (interface MTU must be 72)");
+
+/* 0x202 is decoded and stepped in the CAN RX softirq, skipping the RX rings and the
+ * workqueue hop; configuration frames still go through nodeb_rx_work. */
+static bool fast_path;
+module_param(fast_path, bool, 0444);
+MODULE_PARM_DESC(fast_path, "Run controller_step on 0x202 directly in the RX softirq");
+
+/* Send 0x201 right after each controller_step; tx_timer then only fires a
+ * keep-alive when no step has sent anything for period_ms. */
+static bool reactive_tx;
+module_param(reactive_tx, bool, 0444);
+MODULE_PARM_DESC(reactive_tx, "Send 0x201 on every 0x202 step; period_ms becomes a keep-alive");
+
+/* RX queue for frames the callback cannot handle itself: one ring of this
+ * many frames per CPU (the name predates the per-CPU rings) */
+static int rx_fifo_len = 128;
+module_param(rx_fifo_len, int, 0444);
+MODULE_PARM_DESC(rx_fifo_len, "Per-CPU RX ring depth in frames (rounded up to a power of two, 2..4096)");
+
+/* What happens to a frame that does not fit:
+ *   coalesce - 0x202 bypasses the rings through a latest-value mailbox, so only
+ *              the newest sample is kept; other frames are dropped when full
+ *   drop_new - every frame is queued; a full ring drops the arriving frame
+ *   drop_old - every frame is queued; a full ring evicts its oldest frame */
+static char *rx_overflow = "coalesce";
+module_param(rx_overflow, charp, 0444);
+MODULE_PARM_DESC(rx_overflow, "RX overflow policy: coalesce (default), drop_new, drop_old");
+
+/* Bottom half: by default an ordered workqueue, which shares kworkers with the
+ * rest of the kernel. bh_prio > 0 or bh_cpu >= 0 moves it to a dedicated
+ * kthread "nodeb_rx" (SCHED_FIFO at bh_prio, SCHED_NORMAL for 0), bound to
+ * bh_cpu if given. */
+static int bh_prio;
+module_param(bh_prio, int, 0444);
+MODULE_PARM_DESC(bh_prio, "SCHED_FIFO priority of a dedicated RX kthread (1..99; 0 = workqueue)");
+
+static int bh_cpu = -1;
+module_param(bh_cpu, int, 0444);
+MODULE_PARM_DESC(bh_cpu, "Bind the RX kthread to this CPU (-1 = any)");
+
+/* tx_timer and rx_guard are pinned to the CPU that arms them. timer_cpu arms
+ * them there instead, by IPI when a 0x202 is handled elsewhere; with
+ * bh_cpu == timer_cpu and fast_path off no IPI is needed. */
+static int timer_cpu = -1;
+module_param(timer_cpu, int, 0444);
+MODULE_PARM_DESC(timer_cpu, "Run tx_timer and rx_guard on this CPU (-1 = the CPU handling 0x202)");
+
+/* How 0x201 leaves:
+ *   socket - kernel_sendmsg() on a kernel CAN_RAW socket, from hardirq timers
+ *   skb    - can_send() of skbs from a small per-loop pool refilled in process
+ *            context (or one skb reused in place on an IFF_TX_SKB_SHARING
+ *            netdev); both timers run in softirq (HRTIMER_MODE_*_SOFT) */
+static char *tx_path = "socket";
+module_param(tx_path, charp, 0444);
+MODULE_PARM_DESC(tx_path, "0x201 TX path: socket (default) or skb (can_send, preallocated skbs, softirq timers)");
+
+static bool tx_skb;   /* tx_path=skb */
+
+/* Several control loops on one bus. Loop k uses every Node B ID (0x101, 0x201,
+ * 0x202, 0x300, 0x301, 0x302, 0x310) plus id_base + k * id_stride, with its
+ * own timers and controller; loading fails if two IDs collide or pass 0x7FF.
+ * No single stride fits more than 115 loops above id_base=0 (stride 11); all
+ * 128 fit only below it, e.g. id_base=-134. */
+#define NODEB_MAX_LOOPS 128
+
+/* tx_path=skb: preallocated 0x201 skbs per loop, enough for the timer and a
+ * reactive step to both send before the refill work runs */
+#define NODEB_TX_POOL 4
+static int loops = 1;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Controller instances on the bus (1..115 with id_base=0; 128 needs id_base<=-134)");
+
+static int id_base;
+module_param(id_base, int, 0444);
+MODULE_PARM_DESC(id_base, "CAN ID offset of loop 0 (0 keeps loop 0 on the plain IDs)");
+
+/* 0 is replaced at load by the stride picked, so the parameter file shows it */
+static int id_stride;
+module_param(id_stride, int, 0444);
+MODULE_PARM_DESC(id_stride, "CAN ID offset between consecutive loops (0 = widest that fits loops; 3 and up)");
+
+enum nodeb_rx_policy { NODEB_RX_COALESCE, NODEB_RX_DROP_NEW, NODEB_RX_DROP_OLD };
+static enum nodeb_rx_policy rx_policy;
+
 #if IS_ENABLED(CONFIG_KUNIT)
 /* When true, skip netdev hooks/sockets/timers to allow pure-logic KUnit runs */
 static bool kunit_no_hw = true;
@@ -64,335 +171,974 @@ MODULE_PARM_DESC(kunit_no_hw, "Skip HW/net/timers for KUnit (pure logic only)");
 # endif
 #endif
 
-#define RX_FIFO_ELEMS 128
-
 struct rx_item {
-	struct can_frame cf;
+	struct canfd_frame cf;   /* classic frames use the first CAN_MTU bytes */
+	u64 t_rx_ns;             /* ktime_get_ns() in the RX callback */
 };
 
-/* -------------------------- Q16.16 fixed-point helpers ----------------- */
-typedef s64 q16_16;
-#define Q_ONE          ((q16_16)1 << 16)
-#define Q_FROM_INT(x)  ((q16_16)(x) << 16)
-#define Q_TO_INT(x)    ((int)((x) >> 16))
-#define Q_MUL(a,b)     ((q16_16)(((s64)(a) * (s64)(b)) >> 16))
-#define Q_DIV(a,b)     ((q16_16)(((s64)(a) << 16) / (s64)(b)))
-static inline q16_16 q_sat(q16_16 x, q16_16 lo, q16_16 hi)
-{ return x < lo ? lo : (x > hi ? hi : x); }
-
-/* LE helpers + temp converter */
-static inline s16 le_to_s16(const u8 *d){ return (s16)((u16)d[0] | ((u16)d[1] << 8)); }
-static inline u16 le_to_u16(const u8 *d){ return (u16)d[0] | ((u16)d[1] << 8); }
-static inline void u16_to_le(u8 *dst, u16 v){ dst[0]=(u8)(v & 0xFF); dst[1]=(u8)(v>>8); }
-/* 0.1°C -> Q16.16 °C */
-static inline q16_16 q_from_q01_temp(s16 t_q01)
-{ return (q16_16)(((s64)t_q01 * (s64)Q_ONE) / 10); }
-
-/* -------------------------- Controller config/state -------------------- */
-struct ctrl_cfg {
-	q16_16 Ts_sp;           /* °C (Q16.16); default 25 */
-
-	/* Gains in Q16.16 */
-	q16_16 KpT, KiT, KdT;   /* temperature loop */
-	q16_16 Kpm, Kim;        /* flow loop       */
-	q16_16 kawT, kawm;      /* anti-windup back-calculation */
-	q16_16 kvw,  kwv;       /* decoupling */
-
-	/* Integer domains */
-	u16 omega0_rpm, v0_rpm; /* feedforward baselines */
-	u16 omega_max_rpm, v_max_rpm;
-	u16 v_cut_rpm;          /* fan cut-in (e.g., 700 rpm) */
-
-	q16_16 tau_d_min_s;     /* min derivative filter time constant (>= 1e-3 s) */
-};
+/* Q16.16 helpers, struct ctrl_cfg/ctrl_state/ctrl_core, controller_step() and
+ * frame decoding live in controller_core.c (also built for user space). Included
+ * rather than linked so the module stays a single controller_kernel.ko. */
+#include "controller_core.c"
 
-struct ctrl_state {
-	q16_16 eta_T, eta_m;    /* integrators */
-	q16_16 dTh_f;           /* derivative filter state (°C in Q16.16) */
-	q16_16 tau_d;           /* current tau_d (s in Q16.16) */
-};
+/* Lock-free single-producer/single-consumer ring, shared with the user-space tests */
+#include "rx_ring.h"
+
+#define CREATE_TRACE_POINTS
+#include "nodeb_trace.h"
 
 /* -------------------------- Node-B context ----------------------------- */
-struct nodeb_ctx {
+struct nodeb_ctx;
+
+/* One control loop: its CAN IDs, timers and controller */
+struct nodeb_loop {
+	struct nodeb_ctx *ctx;
+	unsigned int idx;
+	int id_off;                      /* added to every Node B CAN ID */
+
 	/* TX */
-	struct socket *tx_sock;
-	int ifindex;
+	/* tx_path=skb: each sender takes a slot with xchg and hands the skb to
+	 * can_send() with its only reference; tx_refill fills empty slots.
+	 * With tx_share, slot 0 alone holds the last 0x201 for reuse. */
+	struct sk_buff *tx_pool[NODEB_TX_POOL];
 	struct hrtimer tx_timer;
-	ktime_t period;
 	u8 seq;
+	u64 last_tx_ns;         /* ktime_get_ns() of the last 0x201 sent, either path */
+	/* under core_lock: set when a 0x202 asks for TX, cleared by rx_guard.
+	 * Unlike hrtimer_active(tx_timer) it is set while an arm_csd is in flight. */
+	bool tx_started;
 
 	/* NEW: inactivity guard to stop TX when node C is silent */
 	struct hrtimer rx_guard;
-	ktime_t        idle_period;
 
-	/* RX (ISR-like + BH) */
-	DECLARE_KFIFO(rx_fifo, struct rx_item, RX_FIFO_ELEMS);
-	spinlock_t rx_lock;
-	struct workqueue_struct *wq;
-	struct work_struct rx_work;
+	/* rx_overflow=coalesce: newest 0x202. RX callbacks overwrite it under the
+	 * seqlock (writers only contend with each other), the bottom half copies
+	 * it out without locking and retries if a write raced the copy. The
+	 * writer side keeps its spinlock: a loop's 0x202 is not tied to one CPU
+	 * (vcan delivers on the sender's CPU, RPS spreads real interfaces), and
+	 * two unserialized writers would leave the sequence even mid-copy. The
+	 * lock is per loop and held for one 80-byte copy. */
+	seqlock_t      mbox_lock;
+	struct rx_item mbox;
+	u64            mbox_gen;    /* writes so far */
+	u64            mbox_seen;   /* last generation processed (bottom half only) */
+
+	/* classic 0x202s coalesced or dropped before a step; node C numbered
+	 * them, so they go into core.fb_seq with the next one latched */
+	atomic_t       fb_lost;
+
+	/* timer_cpu: nodeb_arm_timers() run there by IPI */
+	call_single_data_t  arm_csd;
 
 	/* simple state */
 	int state;
 
-	/* Controller additions */
-	struct ctrl_cfg   cfg;
-	struct ctrl_state st;
+	/* Controller: config, state, latest feedback, last command. core_lock is
+	 * taken from the RX softirq (fast_path), the bottom half and the TX hrtimer
+	 * (hardirq, softirq with tx_path=skb), always with interrupts disabled. */
+	spinlock_t core_lock;
+	struct ctrl_core core;
+};
 
-	/* Latest plant feedback */
-	q16_16 Ts, Th, Tc;          /* °C (Q16.16) */
-	u16    v_prev_rpm;          /* rpm */
-	u8     dt_ms;               /* 1..255 ms */
-	bool   have_feedback;
+/* The bus: TX handle, RX queues and bottom half shared by all loops */
+struct nodeb_ctx {
+	/* TX */
+	struct socket *tx_sock;          /* tx_path=socket */
+	struct net_device *tx_dev;       /* tx_path=skb: held until exit */
+	bool tx_share;                   /* tx_dev has IFF_TX_SKB_SHARING */
+	struct work_struct tx_refill;    /* tx_path=skb: refills tx_pool[] */
+	int ifindex;
+	enum hrtimer_mode tmode;         /* all timers; _SOFT with tx_path=skb */
+	ktime_t period;
+	ktime_t idle_period;
+	bool stopping;                   /* exit: a late arm_csd must not start timers */
+
+	/* RX (ISR-like + BH): one rx_ring per CPU, filled only by that CPU's RX
+	 * softirq and drained only by the bottom half, so neither side locks.
+	 * The bottom half merges the rings back into arrival order by t_rx_ns. */
+	struct rx_ring __percpu *rings;
+	u32             ring_len;
+	cpumask_t       rx_pending;  /* CPUs that queued since the bottom half last looked */
+	struct rx_item *rx_front;    /* bottom half only: head of each CPU's ring, nr_cpu_ids */
+	cpumask_t       rx_fronts;   /* bottom half only: valid rx_front[] entries */
+	DECLARE_BITMAP(mbox_pending, NODEB_MAX_LOOPS);   /* loops with a new mailbox 0x202 */
+
+	/* bottom half: wq, or rx_task when bh_prio/bh_cpu ask for a kthread */
+	struct workqueue_struct *wq;
+	struct work_struct rx_work;
+	struct task_struct *rx_task;
+	atomic_t            rx_kick;   /* frames queued since rx_task last looked */
 
-	/* Last computed command */
-	u16 omega_cmd_rpm;
-	u16 v_cmd_rpm;
+	unsigned int       nloops;
+	struct nodeb_loop *loop;
 };
 
 static struct nodeb_ctx *g;
 
-static void nodeb_print_cf(const char *tag, const struct can_frame *cf)
+/* hello, feedback, setpoint, gains T/M, FD parameter block; the order is
+ * also that of the stats/rx_<id> files below */
+#define NODEB_RX_IDS 6
+static const canid_t nodeb_rx_ids[NODEB_RX_IDS] = {
+	0x101, 0x202, 0x301, 0x300, 0x302, CTRL_FD_PARAMS_ID
+};
+
+/* CAN ID -> loop and nodeb_rx_ids[] slot, built at load and read-only after.
+ * loop holds the index + 1, so a zero entry means "not ours". The RX callback
+ * does this one lookup per frame however many loops there are. */
+struct nodeb_route {
+	u8 loop, slot;
+};
+static struct nodeb_route nodeb_route[CAN_SFF_MASK + 1] __read_mostly;
+
+/* n loops at base + k * stride; -EINVAL if an ID (0x201 included) is taken
+ * twice or falls outside 11 bits, said in the log if report */
+static int nodeb_build_routes(unsigned int n, int base, int stride, bool report)
+{
+	DECLARE_BITMAP(used, CAN_SFF_MASK + 1);
+	unsigned int k, i;
+
+	bitmap_zero(used, CAN_SFF_MASK + 1);
+	memset(nodeb_route, 0, sizeof(nodeb_route));
+	for (k = 0; k < n; k++) {
+		long off = base + (long)k * stride;
+
+		/* i == NODEB_RX_IDS: the loop's 0x201, reserved but not routed */
+		for (i = 0; i <= NODEB_RX_IDS; i++) {
+			canid_t id0 = i < NODEB_RX_IDS ? nodeb_rx_ids[i] : 0x201;
+			long id = id0 + off;
+
+			if (id < 0 || id > CAN_SFF_MASK || test_bit(id, used)) {
+				if (!report)
+					return -EINVAL;
+				pr_err("[B] loop %u: 0x%03x%+ld is %s\n", k, id0, off,
+				       id < 0 || id > CAN_SFF_MASK ? "not an 11-bit ID" : "already taken");
+				return -EINVAL;
+			}
+			__set_bit(id, used);
+			if (i < NODEB_RX_IDS)
+				nodeb_route[id] = (struct nodeb_route){ .loop = k + 1, .slot = i };
+		}
+	}
+	return 0;
+}
+
+/* id_stride=0: the widest stride that fits n loops above base (0 for one
+ * loop), leaving their routes built; -EINVAL if none does */
+static int nodeb_pick_stride(unsigned int n, int base)
+{
+	int s;
+
+	if (n < 2)
+		return nodeb_build_routes(n, base, 0, true);
+	/* 0x310 is the highest Node B ID: start where loop n-1's lands on 0x7FF */
+	for (s = ((int)CAN_SFF_MASK - CTRL_FD_PARAMS_ID - base) / (int)(n - 1); s > 0; s--)
+		if (!nodeb_build_routes(n, base, s, false))
+			return s;
+	return -EINVAL;
+}
+
+/* -------------------------- Event counters ----------------------------- */
+/* Monotonic per-CPU counters, bumped with this_cpu_inc() (IRQ-safe, no lock,
+ * no shared cache line) and summed over all CPUs when a sysfs file is read. */
+struct nodeb_counters {
+	u64 rx[NODEB_RX_IDS];   /* frames taken by the RX callback, by nodeb_rx_ids[] slot */
+	u64 fifo_drops;         /* RX ring full: frame dropped (drop_old: evicted) */
+	u64 rx_coalesced;       /* 0x202 overwritten in the mailbox before it was processed */
+	u64 work_runs;          /* bottom-half runs (work item or kthread wakeups) */
+	u64 work_frames;        /* frames processed by them */
+	u64 work_frames_max;    /* most frames in one run (max over CPUs on read) */
+	u64 tx_ok, tx_err;      /* 0x201 kernel_sendmsg / can_send results */
+	u64 tx_skb_alloc;       /* tx_path=skb: pool empty (tx_share: skb in flight), one allocated */
+	u64 tx_keepalive;       /* reactive_tx: 0x201 sent by tx_timer for lack of steps */
+	u64 guard_expired;      /* rx_guard fired (0x202 silent for idle_ms) */
+	u64 steps;              /* controller_step runs (latched 0x202) */
+};
+
+/* log2 ns buckets: [0] < 1 ns, [k] = [2^(k-1), 2^k) ns, last one open-ended.
+ * Each CPU only touches its own copy (preemption off around the update), so
+ * the hot paths take no lock; readers sum all CPUs and may see an update in
+ * flight, which only skews a live snapshot by one sample. */
+#define NODEB_HIST_BUCKETS 40
+
+enum nodeb_lat {
+	NODEB_LAT_TIMER,   /* tx_timer expiry -> nodeb_tx_timer_fn running */
+	NODEB_LAT_RX,      /* RX callback -> nodeb_rx_work dequeues the frame */
+	NODEB_LAT_STEP,    /* 0x202 decode + controller_step */
+	NODEB_LAT_FEEDBACK,/* 0x202 RX callback -> command ready, either path */
+	NODEB_LAT_NR
+};
+
+static const char *const nodeb_lat_names[NODEB_LAT_NR] = {
+	"timer_late", "rx_latency", "step_time", "fb_latency",
+};
+
+struct nodeb_hist {
+	u64 n, sum_ns, max_ns;
+	u64 bucket[NODEB_HIST_BUCKETS];
+};
+
+struct nodeb_stats {
+	struct nodeb_counters c;
+	struct nodeb_hist h[NODEB_LAT_NR];
+};
+
+static DEFINE_PER_CPU(struct nodeb_stats, nodeb_stats);
+static struct dentry *nodeb_dbg_dir;
+
+static unsigned int nodeb_lat_bucket(u64 ns)
+{
+	if (!ns)
+		return 0;
+	return min_t(unsigned int, ilog2(ns) + 1, NODEB_HIST_BUCKETS - 1);
+}
+
+static void nodeb_lat_add(enum nodeb_lat which, s64 ns)
 {
-	char buf[3 * 8 + 1];
-	int i, pos = 0;
-	for (i = 0; i < cf->len && i < 8; i++)
-		pos += scnprintf(buf + pos, sizeof(buf) - pos, "%02X ", cf->data[i]);
-	buf[sizeof(buf) - 1] = '\0';
+	struct nodeb_hist *h = &get_cpu_ptr(&nodeb_stats)->h[which];
+	u64 v = ns > 0 ? (u64)ns : 0;   /* early timer callbacks count as on time */
+
+	h->bucket[nodeb_lat_bucket(v)]++;
+	h->n++;
+	h->sum_ns += v;
+	if (v > h->max_ns)
+		h->max_ns = v;
+	put_cpu_ptr(&nodeb_stats);
+}
+
+static int nodeb_hist_show(struct seq_file *m, void *unused)
+{
+	enum nodeb_lat which = (enum nodeb_lat)(uintptr_t)m->private;
+	struct nodeb_hist sum = {0};
+	u64 seen = 0, p50 = 0, p99 = 0;
+	int cpu, k;
+
+	for_each_possible_cpu(cpu) {
+		const struct nodeb_hist *h = &per_cpu_ptr(&nodeb_stats, cpu)->h[which];
+
+		sum.n      += h->n;
+		sum.sum_ns += h->sum_ns;
+		sum.max_ns  = max(sum.max_ns, h->max_ns);
+		for (k = 0; k < NODEB_HIST_BUCKETS; k++)
+			sum.bucket[k] += h->bucket[k];
+	}
+
+	/* quantiles as bucket upper edges */
+	for (k = 0; k < NODEB_HIST_BUCKETS && sum.n; k++) {
+		seen += sum.bucket[k];
+		if (!p50 && seen * 2 >= sum.n)
+			p50 = 1ULL << k;
+		if (!p99 && seen * 100 >= sum.n * 99)
+			p99 = 1ULL << k;
+	}
 
-	pr_info("[B] %s 0x%03X [%d] %s\n",
-		tag, cf->can_id & CAN_SFF_MASK, cf->len, buf);
+	seq_printf(m, "%s: n=%llu mean=%llu ns max=%llu ns p50<%llu ns p99<%llu ns\n",
+		   nodeb_lat_names[which], sum.n, sum.n ? div64_u64(sum.sum_ns, sum.n) : 0,
+		   sum.max_ns, p50, p99);
+	for (k = 0; k < NODEB_HIST_BUCKETS; k++) {
+		if (!sum.bucket[k])
+			continue;
+		seq_printf(m, "[%llu, %llu) ns %llu\n",
+			   k ? 1ULL << (k - 1) : 0, 1ULL << k, sum.bucket[k]);
+	}
+	return 0;
+}
+
+static int nodeb_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nodeb_hist_show, inode->i_private);
 }
 
-/* -------------------------- Defaults ----------------------------------- */
-static void ctrl_defaults(struct nodeb_ctx *ctx)
+/* Any write clears the histogram on every CPU */
+static ssize_t nodeb_hist_write(struct file *file, const char __user *buf,
+				size_t len, loff_t *ppos)
 {
-	ctx->cfg.Ts_sp = Q_FROM_INT(25);
+	struct seq_file *m = file->private_data;
+	enum nodeb_lat which = (enum nodeb_lat)(uintptr_t)m->private;
+	int cpu;
 
-	/* Python: KpT=100.6, KiT=0.10, KdT=4.0 */
-	ctx->cfg.KpT = Q_FROM_INT(100) + (Q_ONE/5 + Q_ONE/10); /* ≈100.6 */
-	ctx->cfg.KiT = Q_ONE/10;     /* 0.10 */
-	ctx->cfg.KdT = Q_FROM_INT(4);
+	for_each_possible_cpu(cpu)
+		memset(&per_cpu_ptr(&nodeb_stats, cpu)->h[which], 0, sizeof(struct nodeb_hist));
+	return len;
+}
 
-	ctx->cfg.Kpm = Q_FROM_INT(130);
-	ctx->cfg.Kim = Q_ONE/100;    /* 0.01 */
+static const struct file_operations nodeb_hist_fops = {
+	.owner   = THIS_MODULE,
+	.open    = nodeb_hist_open,
+	.read    = seq_read,
+	.write   = nodeb_hist_write,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
 
-	ctx->cfg.kawT = Q_FROM_INT(5);
-	ctx->cfg.kawm = Q_FROM_INT(10);
+/* debugfs is best effort: the controller runs the same without it */
+static void nodeb_debugfs_init(void)
+{
+	int i;
 
-	/* kvw≈-0.15, kwv≈-0.02 */
-	ctx->cfg.kvw = -(Q_ONE/6 + Q_ONE/30);
-	ctx->cfg.kwv = -(Q_ONE/50);
+	nodeb_dbg_dir = debugfs_create_dir("nodeb", NULL);
+	for (i = 0; i < NODEB_LAT_NR; i++)
+		debugfs_create_file(nodeb_lat_names[i], 0600, nodeb_dbg_dir,
+				    (void *)(uintptr_t)i, &nodeb_hist_fops);
+}
 
-	ctx->cfg.omega0_rpm = 100;
-	ctx->cfg.v0_rpm     = 100;
+static u64 nodeb_counter_sum(size_t off, bool take_max)
+{
+	u64 v = 0;
+	int cpu;
 
-	ctx->cfg.omega_max_rpm = 4000;
-	ctx->cfg.v_max_rpm     = 2800;
-	ctx->cfg.v_cut_rpm     = 700;
+	for_each_possible_cpu(cpu) {
+		u64 x = *(const u64 *)((const char *)&per_cpu_ptr(&nodeb_stats, cpu)->c + off);
 
-	ctx->cfg.tau_d_min_s   = Q_ONE/1000; /* 0.001 s minimum */
+		v = take_max ? max(v, x) : v + x;
+	}
+	return v;
 }
 
-/* -------------------------- Controller core ---------------------------- */
-static void controller_step(struct nodeb_ctx *ctx)
+#define NODEB_COUNTER_ATTR(name, field, take_max)				\
+static ssize_t name##_show(struct kobject *kobj, struct kobj_attribute *attr,	\
+			   char *buf)						\
+{										\
+	return sysfs_emit(buf, "%llu\n",					\
+			  nodeb_counter_sum(offsetof(struct nodeb_counters, field),	\
+					    take_max));				\
+}										\
+static struct kobj_attribute name##_attr = __ATTR_RO(name)
+
+/* one file per nodeb_rx_ids[] entry */
+NODEB_COUNTER_ATTR(rx_101, rx[0], false);
+NODEB_COUNTER_ATTR(rx_202, rx[1], false);
+NODEB_COUNTER_ATTR(rx_301, rx[2], false);
+NODEB_COUNTER_ATTR(rx_300, rx[3], false);
+NODEB_COUNTER_ATTR(rx_302, rx[4], false);
+NODEB_COUNTER_ATTR(rx_310, rx[5], false);
+NODEB_COUNTER_ATTR(fifo_drops, fifo_drops, false);
+NODEB_COUNTER_ATTR(rx_coalesced, rx_coalesced, false);
+NODEB_COUNTER_ATTR(work_runs, work_runs, false);
+NODEB_COUNTER_ATTR(work_frames, work_frames, false);
+NODEB_COUNTER_ATTR(work_frames_max, work_frames_max, true);
+NODEB_COUNTER_ATTR(tx_ok, tx_ok, false);
+NODEB_COUNTER_ATTR(tx_err, tx_err, false);
+NODEB_COUNTER_ATTR(tx_keepalive, tx_keepalive, false);
+NODEB_COUNTER_ATTR(tx_skb_alloc, tx_skb_alloc, false);
+NODEB_COUNTER_ATTR(guard_expired, guard_expired, false);
+NODEB_COUNTER_ATTR(steps, steps, false);
+
+static struct attribute *nodeb_stats_attrs[] = {
+	&rx_101_attr.attr, &rx_202_attr.attr, &rx_301_attr.attr,
+	&rx_300_attr.attr, &rx_302_attr.attr, &rx_310_attr.attr,
+	&fifo_drops_attr.attr, &rx_coalesced_attr.attr,
+	&work_runs_attr.attr, &work_frames_attr.attr, &work_frames_max_attr.attr,
+	&tx_ok_attr.attr, &tx_err_attr.attr, &tx_keepalive_attr.attr, &tx_skb_alloc_attr.attr,
+	&guard_expired_attr.attr,
+	&steps_attr.attr,
+	NULL,
+};
+
+/* /sys/module/controller_kernel/stats/ */
+static const struct attribute_group nodeb_stats_group = {
+	.name  = "stats",
+	.attrs = nodeb_stats_attrs,
+};
+static bool nodeb_stats_sysfs;
+
+/* -------------------------- 0x201 TX ----------------------------------- */
+/* Controller outputs to plant (classic: first CAN_MTU bytes as a can_frame).
+ * Called with core_lock held; returns the MTU to send. */
+static size_t nodeb_build_cmd(struct nodeb_loop *l, struct canfd_frame *cf)
 {
-	if (!ctx->have_feedback || ctx->dt_ms == 0) {
-		ctx->omega_cmd_rpm = 0;
-		ctx->v_cmd_rpm     = 0;
-		return;
+	memset(cf, 0, sizeof(*cf));
+	cf->can_id = 0x201 + l->id_off;
+	if (fd_mode) {
+		cf->len   = ctrl_tx_payload_fd(&l->core, cf->data);
+		cf->flags = CANFD_BRS;
+		return CANFD_MTU;
+	}
+	cf->len = 8;
+	ctrl_tx_payload(&l->core, cf->data);
+	return CAN_MTU;
+}
+
+/* An skb holding one frame of mtu bytes, laid out like CAN_RAW's */
+static struct sk_buff *nodeb_alloc_tx_skb(struct nodeb_ctx *ctx, size_t mtu, gfp_t gfp)
+{
+	struct sk_buff *skb = alloc_skb(sizeof(struct can_skb_priv) + mtu, gfp);
+
+	if (!skb)
+		return NULL;
+	can_skb_reserve(skb);
+	can_skb_prv(skb)->ifindex = ctx->tx_dev->ifindex;
+	can_skb_prv(skb)->skbcnt = 0;
+	skb->dev = ctx->tx_dev;
+	skb->ip_summed = CHECKSUM_UNNECESSARY;
+	skb_put_zero(skb, mtu);
+	return skb;
+}
+
+/* Put a fresh skb in every empty tx_pool[] slot (tx_share: slot 0 only).
+ * Senders only ever empty a slot, so a lost cmpxchg means one got there
+ * first with nothing to take; the skb is then not needed. */
+static int nodeb_tx_fill(struct nodeb_ctx *ctx, gfp_t gfp)
+{
+	unsigned int n = ctx->tx_share ? 1 : NODEB_TX_POOL;
+	size_t mtu = fd_mode ? CANFD_MTU : CAN_MTU;
+	unsigned int k, i;
+
+	for (k = 0; k < ctx->nloops; k++) {
+		for (i = 0; i < n; i++) {
+			struct sk_buff *skb;
+
+			if (READ_ONCE(ctx->loop[k].tx_pool[i]))
+				continue;
+			skb = nodeb_alloc_tx_skb(ctx, mtu, gfp);
+			if (!skb)
+				return -ENOMEM;
+			if (cmpxchg(&ctx->loop[k].tx_pool[i], NULL, skb))
+				consume_skb(skb);
+		}
 	}
+	return 0;
+}
+
+/* Unbound, so a timer_cpu kept isolated does not get the allocations */
+static void nodeb_tx_refill_work(struct work_struct *work)
+{
+	nodeb_tx_fill(container_of(work, struct nodeb_ctx, tx_refill), GFP_KERNEL);
+}
+
+/* tx_share: an skb with a second user may only go to dev_queue_xmit() on a
+ * netdev with IFF_TX_SKB_SHARING, and no CAN driver sets it. There slot 0 is
+ * reused when nothing else holds it (the qdisc/driver reference is gone and
+ * the loopback clone no longer shares its data), else a fresh one is
+ * allocated. Safe from the timer and a reactive step on two CPUs: each takes
+ * the slot with xchg. */
+static int nodeb_send_shared(struct nodeb_loop *l, const struct canfd_frame *cf, size_t mtu)
+{
+	struct sk_buff *skb = xchg(&l->tx_pool[0], NULL);
+	int ret;
 
-	/* dt seconds in Q16.16 */
-	q16_16 dt = Q_DIV(Q_FROM_INT(ctx->dt_ms), Q_FROM_INT(1000));
+	if (skb && (skb_shared(skb) || skb_cloned(skb) || skb->len != mtu)) {
+		consume_skb(skb);   /* drops our reference; the holder frees it */
+		skb = NULL;
+	}
+	if (skb) {
+		skb->tstamp = 0;                  /* no stale launch time for ETF/fq */
+		can_skb_prv(skb)->skbcnt = 0;     /* a new frame to CAN_RAW's duplicate check */
+	} else {
+		this_cpu_inc(nodeb_stats.c.tx_skb_alloc);
+		skb = nodeb_alloc_tx_skb(l->ctx, mtu, GFP_ATOMIC);
+		if (!skb)
+			return -ENOMEM;
+	}
+	memcpy(skb->data, cf, mtu);
 
-	/* ----- Flow loop (pump) ----- */
-	q16_16 e_m = ctx->cfg.Ts_sp - ctx->Ts; /* Ts_sp - Ts */
+	skb_get(skb);   /* can_send() consumes one reference, even on error */
+	ret = can_send(skb, 1);   /* loop back, as CAN_RAW does by default */
+	skb = xchg(&l->tx_pool[0], skb);
+	if (skb)
+		consume_skb(skb);
+	return ret;
+}
 
-	q16_16 omega0_q = Q_FROM_INT(ctx->cfg.omega0_rpm);
-	q16_16 omega_raw_q = -(omega0_q
-		+ Q_MUL(ctx->cfg.Kpm, e_m)
-		+ Q_MUL(ctx->cfg.Kim, ctx->st.eta_m));
+/* tx_path=skb: send cf without the socket layer, on an skb from the loop's
+ * pool that nobody else references; the stack owns it from here. */
+static int nodeb_send_skb(struct nodeb_loop *l, const struct canfd_frame *cf, size_t mtu)
+{
+	struct nodeb_ctx *ctx = l->ctx;
+	struct sk_buff *skb = NULL;
+	unsigned int i;
 
-	q16_16 v_prev_q = Q_FROM_INT(ctx->v_prev_rpm);
-	q16_16 v_ff_q   = Q_FROM_INT(ctx->cfg.v0_rpm);
-	q16_16 omega_cmd_q = omega_raw_q + Q_MUL(ctx->cfg.kwv, (v_prev_q - v_ff_q));
+	if (ctx->tx_share)
+		return nodeb_send_shared(l, cf, mtu);
 
-	int omega_cmd_i = Q_TO_INT(omega_cmd_q);
-	if (omega_cmd_i < 0) omega_cmd_i = 0;
-	if (omega_cmd_i > ctx->cfg.omega_max_rpm) omega_cmd_i = ctx->cfg.omega_max_rpm;
+	for (i = 0; i < NODEB_TX_POOL && !skb; i++)
+		skb = xchg(&l->tx_pool[i], NULL);
+	if (skb) {
+		queue_work(system_unbound_wq, &ctx->tx_refill);
+	} else {
+		this_cpu_inc(nodeb_stats.c.tx_skb_alloc);
+		skb = nodeb_alloc_tx_skb(ctx, mtu, GFP_ATOMIC);
+		if (!skb)
+			return -ENOMEM;
+	}
+	memcpy(skb->data, cf, mtu);
+	return can_send(skb, 1);   /* consumes the skb, even on error; loop back as CAN_RAW does */
+}
 
-	q16_16 omega_cmd_q16 = Q_FROM_INT(omega_cmd_i);
-	q16_16 omega_err_q   = omega_cmd_q16 - omega_raw_q;
-	ctx->st.eta_m += Q_MUL( (e_m + Q_MUL(ctx->cfg.kawm, omega_err_q)), dt );
-	ctx->st.eta_m  = q_sat(ctx->st.eta_m, Q_FROM_INT(-200), Q_FROM_INT(200));
+/* Called without core_lock, from the TX hrtimer, the RX softirq (fast_path)
+ * or the bottom half; MSG_DONTWAIT since the first two must not sleep. */
+static void nodeb_send_cmd(struct nodeb_loop *l, struct canfd_frame *cf, size_t mtu)
+{
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec iov = { .iov_base = cf, .iov_len = mtu };
+	int ret;
 
-	/* ----- Temperature loop (fan) ----- */
-	q16_16 e_T = ctx->cfg.Ts_sp - ctx->Ts;
+	if (tx_skb)
+		ret = nodeb_send_skb(l, cf, mtu);
+	else
+		ret = kernel_sendmsg(l->ctx->tx_sock, &msg, &iov, 1, mtu);
+	trace_nodeb_tx(cf, ret);
+	if (ret >= 0) {
+		this_cpu_inc(nodeb_stats.c.tx_ok);
+		WRITE_ONCE(l->last_tx_ns, ktime_get_ns());
+		l->seq++;
+	} else {
+		this_cpu_inc(nodeb_stats.c.tx_err);
+		pr_warn_ratelimited("[B] %s failed: %d\n",
+		                    tx_skb ? "can_send()" : "kernel_sendmsg()", ret);
+	}
+}
 
-	if (ctx->st.tau_d < ctx->cfg.tau_d_min_s) ctx->st.tau_d = ctx->cfg.tau_d_min_s;
+/* Start tx_timer if it is stopped and (re)arm the idle guard, both pinned to
+ * the calling CPU */
+static void nodeb_arm_timers(struct nodeb_loop *l)
+{
+	struct nodeb_ctx *ctx = l->ctx;
 
-	q16_16 Th_minus = ctx->Th - ctx->st.dTh_f;
-	q16_16 term1 = Q_DIV(Th_minus, dt);                 /* (Th - dTh_f)/dt */
-	q16_16 term2 = Q_DIV(ctx->st.dTh_f, ctx->st.tau_d); /* dTh_f / tau_d */
-	ctx->st.dTh_f += Q_MUL((term1 - term2), dt);
+	/* NEW: start TX timer on demand after 0x202 */
+	if (!hrtimer_active(&l->tx_timer)) {
+		hrtimer_start(&l->tx_timer, ctx->period, ctx->tmode);
+		trace_nodeb_guard(l->idx, true, READ_ONCE(l->core.fb_seq));
+		pr_info("[B] loop %u: TX timer started after 0x%03x\n", l->idx, 0x202 + l->id_off);
+	}
+	/* NEW: (re)arm inactivity guard */
+	hrtimer_start(&l->rx_guard, ctx->idle_period, ctx->tmode);
+}
 
-	q16_16 v0_q = Q_FROM_INT(ctx->cfg.v0_rpm);
-	q16_16 v_raw_q = -(v0_q
-		+ Q_MUL(ctx->cfg.KpT, e_T)
-		+ Q_MUL(ctx->cfg.KiT, ctx->st.eta_T)
-		- Q_MUL(ctx->cfg.KdT, ctx->st.dTh_f));
+/* arm_csd: hardirq on timer_cpu */
+static void nodeb_arm_timers_ipi(void *info)
+{
+	struct nodeb_loop *l = info;
 
-	q16_16 omega_ff_q = Q_FROM_INT(ctx->cfg.omega0_rpm);
-	q16_16 v_cmd_q = v_raw_q + Q_MUL(ctx->cfg.kvw, (omega_cmd_q16 - omega_ff_q));
+	if (!READ_ONCE(l->ctx->stopping))
+		nodeb_arm_timers(l);
+}
 
-	int v_cmd_i = Q_TO_INT(v_cmd_q);
-	if (v_cmd_i < 0) v_cmd_i = 0;
-	if (v_cmd_i > ctx->cfg.v_max_rpm) v_cmd_i = ctx->cfg.v_max_rpm;
-	if (v_cmd_i < ctx->cfg.v_cut_rpm) v_cmd_i = 0;
+static void nodeb_ipi_nop(void *info)
+{
+}
 
-	q16_16 v_cmd_q16 = Q_FROM_INT(v_cmd_i);
-	q16_16 v_err_q   = v_cmd_q16 - v_raw_q;
-	ctx->st.eta_T += Q_MUL( (e_T + Q_MUL(ctx->cfg.kawT, v_err_q)), dt );
-	ctx->st.eta_T  = q_sat(ctx->st.eta_T, Q_FROM_INT(-500), Q_FROM_INT(500));
+/* A 0x202 was latched and stepped: account it, arm TX and the idle guard.
+ * Called with core_lock held, from the bottom half or (fast_path) the RX softirq. */
+static void nodeb_feedback_latched(struct nodeb_loop *l, const struct rx_item *it, u64 t0)
+{
+	u64 t1 = ktime_get_ns();
+
+	nodeb_lat_add(NODEB_LAT_STEP, (s64)(t1 - t0));
+	nodeb_lat_add(NODEB_LAT_FEEDBACK, (s64)(t1 - it->t_rx_ns));
+	this_cpu_inc(nodeb_stats.c.steps);
+	trace_nodeb_step(l->idx, &l->core);
+
+	/* classic frames carry no sequence: a (re)started plant numbers its
+	 * 0x202 from 1, so restart the count with tx_timer. A plant restarted
+	 * within idle_ms, or one that kept running across a reload or an idle
+	 * restart, is out of step: plant_user sees the echo jump and reports
+	 * desync instead of round trips. CAN FD carries the sequence. */
+	if (!l->tx_started && it->cf.len <= CAN_MAX_DLEN)
+		l->core.fb_seq = 1;
+	l->tx_started = true;
+
+	if (timer_cpu < 0 || timer_cpu == smp_processor_id())
+		nodeb_arm_timers(l);
+	else if (smp_call_function_single_async(timer_cpu, &l->arm_csd) == -ENXIO)
+		nodeb_arm_timers(l);   /* timer_cpu went offline; -EBUSY: already on its way */
+	l->state = 2;
+}
 
-	ctx->omega_cmd_rpm = (u16)omega_cmd_i;
-	ctx->v_cmd_rpm     = (u16)v_cmd_i;
+/* Under core_lock, before a 0x202 is decoded: count the classic ones lost on
+ * the way so the 0x201 echo stays in step with node C (FD overwrites it) */
+static void nodeb_fb_catch_up(struct nodeb_loop *l)
+{
+	l->core.fb_seq += (u8)atomic_xchg(&l->fb_lost, 0);
 }
 
-/* -------------------------- RX bottom-half ----------------------------- */
-static void nodeb_rx_work(struct work_struct *work)
+/* Decode one frame under core_lock; id is the loop-0 ID (nodeb_rx_ids[]) that
+ * controller_core knows. A 0x202 also gets the post-step work and, with
+ * reactive_tx, its 0x201 goes out as soon as the lock is dropped. */
+static enum ctrl_rx_kind nodeb_rx_frame(struct nodeb_loop *l, u32 id,
+					const struct rx_item *it, u64 t0)
 {
+	struct canfd_frame tx;
+	enum ctrl_rx_kind kind;
 	unsigned long flags;
-	struct rx_item item;
+	size_t mtu = 0;
+
+	spin_lock_irqsave(&l->core_lock, flags);
+	if (id == 0x202)
+		nodeb_fb_catch_up(l);
+	kind = ctrl_rx_frame(&l->core, id, it->cf.data, it->cf.len);
+	if (kind == CTRL_RX_FEEDBACK) {
+		nodeb_feedback_latched(l, it, t0);
+		if (reactive_tx)
+			mtu = nodeb_build_cmd(l, &tx);
+	}
+	spin_unlock_irqrestore(&l->core_lock, flags);
 
-	for (;;) {
-		int copied;
+	if (mtu)
+		nodeb_send_cmd(l, &tx, mtu);
+	return kind;
+}
 
-		spin_lock_irqsave(&g->rx_lock, flags);
-		copied = kfifo_out(&g->rx_fifo, &item, 1);
-		spin_unlock_irqrestore(&g->rx_lock, flags);
+/* -------------------------- RX rings ----------------------------------- */
+/* len frames per possible CPU, slots on the CPU's node. On error the caller
+ * still calls nodeb_rings_free(). */
+static int nodeb_rings_alloc(struct nodeb_ctx *ctx, unsigned int len)
+{
+	int cpu;
 
-		if (copied != 1)
-			break;
+	ctx->ring_len = roundup_pow_of_two(len);
+	ctx->rings = alloc_percpu(struct rx_ring);
+	ctx->rx_front = kcalloc(nr_cpu_ids, sizeof(*ctx->rx_front), GFP_KERNEL);
+	if (!ctx->rings || !ctx->rx_front)
+		return -ENOMEM;
 
-		nodeb_print_cf("RX", &item.cf);
-		switch (item.cf.can_id & CAN_SFF_MASK) {
-		case 0x101:
-			g->state = 1;
-			break;
+	for_each_possible_cpu(cpu) {
+		struct rx_item *slots = kcalloc_node(ctx->ring_len, sizeof(*slots),
+		                                     GFP_KERNEL, cpu_to_node(cpu));
 
-		case 0x202: { /* Plant feedback: Ts,Th,Tc,v_prev,dt */
-			if (item.cf.len == 8) {
-				s16 Ts_q01 = le_to_s16(&item.cf.data[0]);
-				s16 Th_q01 = le_to_s16(&item.cf.data[2]);
-				s16 Tc_q01 = le_to_s16(&item.cf.data[4]);
-				u8  vprev_q10 = item.cf.data[6];
-				u8  dt_ms     = item.cf.data[7] ? item.cf.data[7] : 1;
-
-				g->Ts = q_from_q01_temp(Ts_q01);
-				g->Th = q_from_q01_temp(Th_q01);
-				g->Tc = q_from_q01_temp(Tc_q01);
-				g->v_prev_rpm = (u16)(vprev_q10 * 10u);
-				g->dt_ms = dt_ms;
-				g->have_feedback = true;
-
-				controller_step(g);   /* compute omega_cmd/v_cmd now */
-
-				/* NEW: start TX timer on demand after 0x202 */
-				if (!hrtimer_active(&g->tx_timer)) {
-					hrtimer_start(&g->tx_timer, g->period,
-					              HRTIMER_MODE_REL_PINNED);
-					pr_info("[B] TX timer started after 0x202\n");
-				}
-				/* NEW: (re)arm inactivity guard */
-				hrtimer_start(&g->rx_guard, g->idle_period,
-				              HRTIMER_MODE_REL_PINNED);
-			}
-			g->state = 2;
-			break;
+		if (!slots)
+			return -ENOMEM;
+		rx_ring_init(per_cpu_ptr(ctx->rings, cpu), slots, ctx->ring_len, sizeof(*slots));
+	}
+	return 0;
+}
+
+static void nodeb_rings_free(struct nodeb_ctx *ctx)
+{
+	int cpu;
+
+	if (ctx->rings) {
+		for_each_possible_cpu(cpu)
+			kfree(per_cpu_ptr(ctx->rings, cpu)->slot);   /* alloc_percpu zeroed it */
+		free_percpu(ctx->rings);
+		ctx->rings = NULL;
+	}
+	kfree(ctx->rx_front);
+	ctx->rx_front = NULL;
+}
+
+/* Oldest queued frame across all CPUs' rings (rx_work only). Each ring is in
+ * order already; keeping its head in rx_front[] makes this a k-way merge. */
+static bool nodeb_rings_next(struct nodeb_ctx *ctx, struct rx_item *out)
+{
+	struct rx_item *best = NULL;
+	int cpu, best_cpu = 0;
+
+	for_each_cpu(cpu, &ctx->rx_pending) {
+		cpumask_clear_cpu(cpu, &ctx->rx_pending);
+		smp_mb__after_atomic();   /* pairs with smp_mb() in nodeb_can_rx_cb */
+		if (!cpumask_test_cpu(cpu, &ctx->rx_fronts) &&
+		    rx_ring_take(per_cpu_ptr(ctx->rings, cpu), &ctx->rx_front[cpu]))
+			__cpumask_set_cpu(cpu, &ctx->rx_fronts);
+	}
+
+	for_each_cpu(cpu, &ctx->rx_fronts) {
+		if (!best || ctx->rx_front[cpu].t_rx_ns < best->t_rx_ns) {
+			best = &ctx->rx_front[cpu];
+			best_cpu = cpu;
 		}
+	}
+	if (!best)
+		return false;
+
+	*out = *best;
+	/* empty now: the producer sets rx_pending again on its next frame */
+	if (!rx_ring_take(per_cpu_ptr(ctx->rings, best_cpu), best))
+		__cpumask_clear_cpu(best_cpu, &ctx->rx_fronts);
+	return true;
+}
+
+/* -------------------------- RX bottom-half ----------------------------- */
+/* Latest-value write from the RX softirq; see nodeb_loop.mbox_lock */
+static void nodeb_mbox_put(struct nodeb_loop *l, const struct rx_item *it)
+{
+	write_seqlock(&l->mbox_lock);
+	l->mbox = *it;
+	l->mbox_gen++;
+	write_sequnlock(&l->mbox_lock);
+	smp_mb__before_atomic();   /* mailbox before the pending bit */
+	set_bit(l->idx, l->ctx->mbox_pending);
+}
 
-		case 0x301: { /* setpoint from node A */
-			if (item.cf.len >= 2) {
-				s16 Ts_sp_q01 = le_to_s16(&item.cf.data[0]);
-				g->cfg.Ts_sp = q_from_q01_temp(Ts_sp_q01);
-				pr_info("[B] Ts_sp set to %d.%01d C\n",
-				        Ts_sp_q01/10, abs(Ts_sp_q01%10));
+/* Newest 0x202 from the loop's mailbox, if one arrived since the last call */
+static bool nodeb_mbox_take(struct nodeb_loop *l, struct rx_item *out)
+{
+	unsigned int seq;
+	u64 gen;
+
+	do {
+		seq = read_seqbegin(&l->mbox_lock);
+		gen = l->mbox_gen;
+		*out = l->mbox;
+	} while (read_seqretry(&l->mbox_lock, seq));
+
+	if (gen == l->mbox_seen)
+		return false;
+	if (gen - l->mbox_seen > 1) {
+		this_cpu_add(nodeb_stats.c.rx_coalesced, gen - l->mbox_seen - 1);
+		if (out->cf.len <= CAN_MAX_DLEN)
+			atomic_add((int)(gen - l->mbox_seen - 1), &l->fb_lost);
+	}
+	l->mbox_seen = gen;
+	return true;
+}
+
+static void nodeb_rx_item(struct nodeb_ctx *ctx, const struct rx_item *item)
+{
+	u32 rid = item->cf.can_id & CAN_SFF_MASK;
+	struct nodeb_route r = nodeb_route[rid];   /* non-zero: the callback checked */
+	struct nodeb_loop *l = &ctx->loop[r.loop - 1];
+	u32 id = nodeb_rx_ids[r.slot];
+	enum ctrl_rx_kind kind;
+	u64 t0 = ktime_get_ns();
+
+	nodeb_lat_add(NODEB_LAT_RX, (s64)(t0 - item->t_rx_ns));
+	kind = nodeb_rx_frame(l, id, item, t0);
+
+	trace_nodeb_rx(&item->cf, kind, t0 - item->t_rx_ns);
+	switch (kind) {
+	case CTRL_RX_HELLO:
+		l->state = 1;
+		break;
+
+	case CTRL_RX_FEEDBACK: /* stepped and TX handled in nodeb_rx_frame */
+		break;
+
+	case CTRL_RX_SETPOINT: {
+		s16 Ts_sp_q01 = le_to_s16(&item->cf.data[0]);
+
+		trace_nodeb_params(l->idx, rid, &l->core.cfg);
+		pr_info("[B] loop %u: Ts_sp set to %d.%01d C\n",
+		        l->idx, Ts_sp_q01/10, abs(Ts_sp_q01%10));
+		break;
+	}
+
+	case CTRL_RX_GAINS_T:
+		trace_nodeb_params(l->idx, rid, &l->core.cfg);
+		pr_info("[B] loop %u: Gains updated via 0x%03x\n", l->idx, rid);
+		break;
+
+	case CTRL_RX_GAINS_M:
+		trace_nodeb_params(l->idx, rid, &l->core.cfg);
+		pr_info("[B] loop %u: Flow/decouple gains updated via 0x%03x\n", l->idx, rid);
+		break;
+
+	case CTRL_RX_PARAMS:
+		trace_nodeb_params(l->idx, rid, &l->core.cfg);
+		pr_info("[B] loop %u: Ts_sp + all gains updated via 0x%03x (FD), Ts_sp=%d C\n",
+		        l->idx, rid, Q_TO_INT(l->core.cfg.Ts_sp));
+		break;
+
+	default:
+		if (id == 0x202)
+			l->state = 2;   /* wrong length: not latched, but node C is alive */
+		break;
+	}
+}
+
+/* Everything queued so far: mailboxes and rings, until all are empty */
+static void nodeb_rx_drain(struct nodeb_ctx *ctx)
+{
+	struct rx_item item;
+	u64 frames = 0;
+
+	this_cpu_inc(nodeb_stats.c.work_runs);
+	for (;;) {
+		bool any = false;
+		unsigned int k;
+
+		for_each_set_bit(k, ctx->mbox_pending, ctx->nloops) {
+			clear_bit(k, ctx->mbox_pending);
+			smp_mb__after_atomic();   /* pairs with smp_mb__before_atomic() in nodeb_mbox_put */
+			if (nodeb_mbox_take(&ctx->loop[k], &item)) {
+				nodeb_rx_item(ctx, &item);
+				frames++;
+				any = true;
 			}
-			break;
 		}
 
-		case 0x300: { /* optional hyperparameters */
-			/* [0..1] KpT q8.8, [2..3] KiT q8.8, [4..5] KdT q8.8, [6] kawT q4.4 */
-			if (item.cf.len >= 7) {
-				u16 kp = le_to_u16(&item.cf.data[0]);
-				u16 ki = le_to_u16(&item.cf.data[2]);
-				u16 kd = le_to_u16(&item.cf.data[4]);
-				u8  kaw= item.cf.data[6];
-				g->cfg.KpT  = (q16_16)kp << 8;   /* q8.8 -> Q16.16 */
-				g->cfg.KiT  = (q16_16)ki << 8;
-				g->cfg.KdT  = (q16_16)kd << 8;
-				g->cfg.kawT = (q16_16)kaw << 12; /* q4.4 -> Q16.16 */
-				pr_info("[B] Gains updated via 0x300\n");
-			}
-			break;
+		if (nodeb_rings_next(ctx, &item)) {
+			nodeb_rx_item(ctx, &item);
+			frames++;
+			any = true;
 		}
+		if (!any)
+			break;
+	}
 
-		case 0x302: { /* Kpm/Kim (q8.8), kawm/kvw/kwv (q4.4) */
-			if (item.cf.len >= 7) {
-				u16 kpm = le_to_u16(&item.cf.data[0]);
-				u16 kim = le_to_u16(&item.cf.data[2]);
-				u8  kawm= item.cf.data[4];
-				u8  kvw = item.cf.data[5];
-				u8  kwv = item.cf.data[6];
-				g->cfg.Kpm = (q16_16)kpm << 8;   /* q8.8 -> Q16.16 */
-				g->cfg.Kim = (q16_16)kim << 8;
-				g->cfg.kawm= (q16_16)kawm << 12; /* q4.4 -> Q16.16 */
-				g->cfg.kvw = (q16_16)kvw  << 12;
-				g->cfg.kwv = (q16_16)kwv  << 12;
-				pr_info("[B] Flow/decouple gains updated via 0x302\n");
-			}
+	this_cpu_add(nodeb_stats.c.work_frames, frames);
+	/* racy against migration; a max can only be under-reported */
+	if (frames > this_cpu_read(nodeb_stats.c.work_frames_max))
+		this_cpu_write(nodeb_stats.c.work_frames_max, frames);
+}
+
+static void nodeb_rx_work(struct work_struct *work)
+{
+	nodeb_rx_drain(container_of(work, struct nodeb_ctx, rx_work));
+}
+
+/* bh_prio/bh_cpu: the same drain on a dedicated thread, woken by nodeb_kick_rx() */
+static int nodeb_rx_thread(void *data)
+{
+	struct nodeb_ctx *ctx = data;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
 			break;
+		if (!atomic_xchg(&ctx->rx_kick, 0)) {
+			schedule();
+			continue;
 		}
+		__set_current_state(TASK_RUNNING);
+		nodeb_rx_drain(ctx);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
 
-		default:
-			break;
+static void nodeb_kick_rx(struct nodeb_ctx *ctx)
+{
+	if (ctx->rx_task) {
+		atomic_set(&ctx->rx_kick, 1);
+		wake_up_process(ctx->rx_task);   /* no-op while it is running */
+	} else {
+		queue_work(ctx->wq, &ctx->rx_work);
+	}
+}
+
+static int nodeb_start_rx_thread(struct nodeb_ctx *ctx)
+{
+	struct sched_attr attr = {
+		.size           = sizeof(attr),
+		.sched_policy   = SCHED_FIFO,
+		.sched_priority = bh_prio,
+	};
+	struct task_struct *t;
+	int ret;
+
+	t = kthread_create(nodeb_rx_thread, ctx, "nodeb_rx");
+	if (IS_ERR(t))
+		return PTR_ERR(t);
+	if (bh_cpu >= 0)
+		kthread_bind(t, bh_cpu);   /* also keeps user space from moving it */
+	if (bh_prio > 0) {
+		ret = sched_setattr_nocheck(t, &attr);
+		if (ret) {
+			kthread_stop(t);
+			return ret;
 		}
 	}
+	ctx->rx_task = t;
+	wake_up_process(t);
+	return 0;
 }
 
 /* -------------------------- RX "ISR-like" callback --------------------- */
+/* A frame the ring had no room for; a classic 0x202 still moved node C's count */
+static void nodeb_count_lost(struct nodeb_ctx *ctx, const struct rx_item *it)
+{
+	struct nodeb_route r = nodeb_route[it->cf.can_id & CAN_SFF_MASK];
+
+	if (r.loop && nodeb_rx_ids[r.slot] == 0x202 && it->cf.len <= CAN_MAX_DLEN)
+		atomic_inc(&ctx->loop[r.loop - 1].fb_lost);
+}
+
 static void nodeb_can_rx_cb(struct sk_buff *skb, void *data)
 {
 	struct nodeb_ctx *ctx = data;
-	const struct can_frame *cf;
-	struct rx_item it;
-	unsigned long flags;
+	struct nodeb_route r;
+	struct nodeb_loop *l;
+	struct rx_item it, old;
+	int cpu, ret;
+	u32 id;
 
 	if (unlikely(!skb))
 		return;
 
-	if (skb->len < sizeof(struct can_frame))
+	/* CAN_MTU or CANFD_MTU; both layouts start with id/len/data */
+	if (skb->len != CAN_MTU && skb->len != CANFD_MTU)
 		return;
 
-	cf = (const struct can_frame *)skb->data;
-	memcpy(&it.cf, cf, sizeof(*cf));
+	/* only routed IDs are registered: the lookup names the loop */
+	r = nodeb_route[((const struct canfd_frame *)skb->data)->can_id & CAN_SFF_MASK];
+	if (!r.loop)
+		return;
+	l = &ctx->loop[r.loop - 1];
+	id = nodeb_rx_ids[r.slot];   /* as loop 0 would see it */
 
-	spin_lock_irqsave(&ctx->rx_lock, flags);
-	if (!kfifo_is_full(&ctx->rx_fifo))
-		kfifo_in(&ctx->rx_fifo, &it, 1);
-	else
-		pr_warn("[B] RX FIFO overflow; dropping\n");
-	spin_unlock_irqrestore(&ctx->rx_lock, flags);
+	memcpy(&it.cf, skb->data, skb->len);
+	it.t_rx_ns = ktime_get_ns();
+	this_cpu_inc(nodeb_stats.c.rx[r.slot]);
+
+	/* controller_step is integer-only and never sleeps: run it right here */
+	if (fast_path && id == 0x202) {
+		enum ctrl_rx_kind kind = nodeb_rx_frame(l, id, &it, it.t_rx_ns);
+
+		if (kind != CTRL_RX_FEEDBACK)
+			l->state = 2;   /* wrong length: not latched, but node C is alive */
+		trace_nodeb_rx(&it.cf, kind, 0);
+		return;
+	}
+
+	/* only the newest telemetry matters: overwrite, never queue */
+	if (rx_policy == NODEB_RX_COALESCE && id == 0x202) {
+		nodeb_mbox_put(l, &it);
+		nodeb_kick_rx(ctx);
+		return;
+	}
+
+	/* softirq: no migration, and this CPU is its ring's only producer */
+	cpu = smp_processor_id();
+	ret = rx_ring_put_old(this_cpu_ptr(ctx->rings), &it, rx_policy == NODEB_RX_DROP_OLD, &old);
+	if (ret != RX_RING_QUEUED) {
+		nodeb_count_lost(ctx, ret == RX_RING_FULL ? &it : &old);
+		this_cpu_inc(nodeb_stats.c.fifo_drops);
+		pr_warn_ratelimited("[B] RX ring overflow on CPU%d; dropping %s (see stats/fifo_drops)\n",
+		                    cpu, rx_policy == NODEB_RX_DROP_OLD ? "oldest" : "newest");
+	}
 
-	queue_work(ctx->wq, &ctx->rx_work);
+	/* head store before the pending test; pairs with nodeb_rings_next() */
+	smp_mb();
+	if (!cpumask_test_cpu(cpu, &ctx->rx_pending))
+		cpumask_set_cpu(cpu, &ctx->rx_pending);
+
+	nodeb_kick_rx(ctx);
 }
 
 /* -------------------------- Register/unregister RX --------------------- */
+/* One exact-ID filter per routed ID (six per loop). af_can hashes these into
+ * its rx_sff[] table, so each frame costs it one indexed lookup however many
+ * loops there are, and frames for other nodes never reach nodeb_can_rx_cb.
+ * A catch-all filter would sit on the wildcard list and wake the callback for
+ * every frame on the bus. */
+#define NODEB_RX_MASK (CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG)
+
+static int nodeb_rx_reg(struct net_device *dev, canid_t id, struct nodeb_ctx *ctx)
+{
+#if CAN_RX_REG_NEEDS_FLAGS
+	return can_rx_register(&init_net, dev, id, NODEB_RX_MASK,
+	                       nodeb_can_rx_cb, ctx, "nodeb", 0);
+#else
+	return can_rx_register(&init_net, dev, id, NODEB_RX_MASK,
+	                       nodeb_can_rx_cb, ctx, "nodeb");
+#endif
+}
+
+/* Drop the filters of every routed ID below end */
+static void nodeb_rx_unreg(struct net_device *dev, canid_t end, struct nodeb_ctx *ctx)
+{
+	canid_t id;
+
+	for (id = 0; id < end; id++)
+		if (nodeb_route[id].loop)
+			can_rx_unregister(&init_net, dev, id, NODEB_RX_MASK, nodeb_can_rx_cb, ctx);
+}
+
 static int nodeb_register_rx(struct nodeb_ctx *ctx)
 {
 	int ret = 0;
 	struct net_device *dev;
+	canid_t id;
 
 	rcu_read_lock();
 	dev = dev_get_by_name_rcu(&init_net, ifname);
@@ -408,102 +1154,21 @@ static int nodeb_register_rx(struct nodeb_ctx *ctx)
 	if (!dev)
 		return -ENODEV;
 
-#if CAN_RX_REG_NEEDS_FLAGS
-	ret = can_rx_register(&init_net, dev, 0x101, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x101", 0);
-#else
-	ret = can_rx_register(&init_net, dev, 0x101, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x101");
-#endif
-	if (ret) {
-		pr_err("[B] can_rx_register 0x101 failed: %d\n", ret);
-		dev_put(dev);
-		return ret;
-	}
-
-#if CAN_RX_REG_NEEDS_FLAGS
-	ret = can_rx_register(&init_net, dev, 0x202, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x202", 0);
-#else
-	ret = can_rx_register(&init_net, dev, 0x202, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x202");
-#endif
-	if (ret) {
-		struct net_device *d2 = dev_get_by_index(&init_net, ctx->ifindex);
-		if (d2) {
-			can_rx_unregister(&init_net, d2, 0x101, CAN_SFF_MASK,
-			                  nodeb_can_rx_cb, ctx);
-			dev_put(d2);
-		}
-		pr_err("[B] can_rx_register 0x202 failed: %d\n", ret);
-		dev_put(dev);
-		return ret;
-	}
-
-#if CAN_RX_REG_NEEDS_FLAGS
-	ret = can_rx_register(&init_net, dev, 0x301, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x301", 0);
-#else
-	ret = can_rx_register(&init_net, dev, 0x301, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x301");
-#endif
-	if (ret) {
-		struct net_device *d2 = dev_get_by_index(&init_net, ctx->ifindex);
-		if (d2) {
-			can_rx_unregister(&init_net, d2, 0x202, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x101, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			dev_put(d2);
-		}
-		pr_err("[B] can_rx_register 0x301 failed: %d\n", ret);
-		dev_put(dev);
-		return ret;
-	}
-
-#if CAN_RX_REG_NEEDS_FLAGS
-	ret = can_rx_register(&init_net, dev, 0x300, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x300", 0);
-#else
-	ret = can_rx_register(&init_net, dev, 0x300, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x300");
-#endif
-	dev_put(dev);
-
-	if (ret) {
-		struct net_device *d2 = dev_get_by_index(&init_net, ctx->ifindex);
-		if (d2) {
-			can_rx_unregister(&init_net, d2, 0x301, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x202, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x101, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			dev_put(d2);
+	for (id = 0; id <= CAN_SFF_MASK; id++) {
+		if (!nodeb_route[id].loop)
+			continue;
+		ret = nodeb_rx_reg(dev, id, ctx);
+		if (ret) {
+			pr_err("[B] can_rx_register 0x%03X failed: %d\n", id, ret);
+			nodeb_rx_unreg(dev, id, ctx);
+			dev_put(dev);
+			return ret;
 		}
-		pr_err("[B] can_rx_register 0x300 failed: %d\n", ret);
-		return ret;
 	}
-
-
-#if CAN_RX_REG_NEEDS_FLAGS
-	ret = can_rx_register(&init_net, dev, 0x302, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x302", 0);
-#else
-	ret = can_rx_register(&init_net, dev, 0x302, CAN_SFF_MASK,
-	                      nodeb_can_rx_cb, ctx, "nodeb-0x302");
-#endif
 	dev_put(dev);
 
-	if (ret) {
-		struct net_device *d2 = dev_get_by_index(&init_net, ctx->ifindex);
-		if (d2) {
-			can_rx_unregister(&init_net, d2, 0x300, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x301, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x202, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			can_rx_unregister(&init_net, d2, 0x101, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-			dev_put(d2);
-		}
-		pr_err("[B] can_rx_register 0x302 failed: %d\n", ret);
-		return ret;
-	}
-
-	pr_info("[B] RX hooks registered on %s (ifindex=%d)\n", ifname, ctx->ifindex);
+	pr_info("[B] RX hooks registered on %s (ifindex=%d) for %u loop(s)\n",
+	        ifname, ctx->ifindex, ctx->nloops);
 	return 0;
 }
 
@@ -513,50 +1178,57 @@ static void nodeb_unregister_rx(struct nodeb_ctx *ctx)
 	if (!dev)
 		return;
 
-	can_rx_unregister(&init_net, dev, 0x101, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-	can_rx_unregister(&init_net, dev, 0x202, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-	can_rx_unregister(&init_net, dev, 0x301, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-	can_rx_unregister(&init_net, dev, 0x300, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
-	can_rx_unregister(&init_net, dev, 0x302, CAN_SFF_MASK, nodeb_can_rx_cb, ctx);
+	nodeb_rx_unreg(dev, CAN_SFF_MASK + 1, ctx);
 	dev_put(dev);
 }
 
 /* -------------------------- TX timer ----------------------------------- */
 static enum hrtimer_restart nodeb_tx_timer_fn(struct hrtimer *t)
 {
-	struct can_frame cf = {0};
-	struct msghdr msg = {0};
-	struct kvec iov;
-	int ret;
-
-	cf.can_id = 0x201;
-	cf.len    = 8;
+	struct nodeb_loop *l = container_of(t, struct nodeb_loop, tx_timer);
+	ktime_t period = l->ctx->period;
+	struct canfd_frame cf;
+	unsigned long flags;
+	size_t mtu;
 
-	/* Payload: controller outputs to plant */
-	u16_to_le(&cf.data[0], g->omega_cmd_rpm);  /* bytes 0..1: omega_cmd rpm LE */
-	u16_to_le(&cf.data[2], g->v_cmd_rpm);      /* bytes 2..3: v_cmd rpm LE */
+	nodeb_lat_add(NODEB_LAT_TIMER,
+		      ktime_to_ns(ktime_sub(ktime_get(), hrtimer_get_expires(t))));
 
-	iov.iov_base = &cf;
-	iov.iov_len  = sizeof(cf);
+	/* reactive_tx: steps drive TX; only fill in when they have gone quiet */
+	if (reactive_tx &&
+	    ktime_get_ns() - READ_ONCE(l->last_tx_ns) < (u64)ktime_to_ns(period))
+		goto out;
 
-	ret = kernel_sendmsg(g->tx_sock, &msg, &iov, 1, sizeof(cf));
-	if (ret >= 0) {
-		nodeb_print_cf("TX", &cf);
-		g->seq++;
-	} else {
-		pr_warn("[B] kernel_sendmsg() failed: %d\n", ret);
-	}
+	spin_lock_irqsave(&l->core_lock, flags);   /* hardirq, or softirq with tx_path=skb */
+	mtu = nodeb_build_cmd(l, &cf);
+	spin_unlock_irqrestore(&l->core_lock, flags);
 
-	hrtimer_forward_now(&g->tx_timer, g->period);
+	nodeb_send_cmd(l, &cf, mtu);
+	if (reactive_tx)
+		this_cpu_inc(nodeb_stats.c.tx_keepalive);
+out:
+	hrtimer_forward_now(t, period);
 	return HRTIMER_RESTART;
 }
 
 /* NEW: Inactivity guard callback — fires when no 0x202 within idle_period */
 static enum hrtimer_restart nodeb_rx_guard_fn(struct hrtimer *t)
 {
-	if (hrtimer_active(&g->tx_timer)) {
-		hrtimer_cancel(&g->tx_timer);
-		pr_info("[B] TX timer stopped due to 0x202 inactivity\n");
+	struct nodeb_loop *l = container_of(t, struct nodeb_loop, rx_guard);
+	unsigned long flags;
+
+	this_cpu_inc(nodeb_stats.c.guard_expired);
+	/* the next 0x202 restarts TX and the classic count. One latched between
+	 * here and the cancel below restarts the count as it should; if its
+	 * TX is cancelled, the 0x202 after it restarts tx_timer. */
+	spin_lock_irqsave(&l->core_lock, flags);
+	l->tx_started = false;
+	spin_unlock_irqrestore(&l->core_lock, flags);
+	if (hrtimer_active(&l->tx_timer)) {
+		hrtimer_cancel(&l->tx_timer);
+		trace_nodeb_guard(l->idx, false, l->core.fb_seq);
+		pr_info("[B] loop %u: TX timer stopped due to 0x%03x inactivity\n",
+		        l->idx, 0x202 + l->id_off);
 	}
 	/* one-shot guard; rearmed on next 0x202 */
 	return HRTIMER_NORESTART;
@@ -588,6 +1260,17 @@ static int nodeb_open_tx_socket(struct nodeb_ctx *ctx)
 	addr.can_family  = AF_CAN;
 	addr.can_ifindex = ctx->ifindex;
 
+	if (fd_mode) {
+		int on = 1;
+
+		ret = ctx->tx_sock->ops->setsockopt(ctx->tx_sock, SOL_CAN_RAW, CAN_RAW_FD_FRAMES,
+		                                    KERNEL_SOCKPTR(&on), sizeof(on));
+		if (ret) {
+			pr_err("[B] CAN_RAW_FD_FRAMES failed: %d\n", ret);
+			return ret;
+		}
+	}
+
 	ret = kernel_bind(ctx->tx_sock, (struct sockaddr *)&addr, sizeof(addr));
 	if (ret) {
 		pr_err("[B] bind failed: %d\n", ret);
@@ -596,24 +1279,176 @@ static int nodeb_open_tx_socket(struct nodeb_ctx *ctx)
 	return 0;
 }
 
+/* tx_path=skb: hold the netdev for can_send() and fill each loop's skb pool */
+static int nodeb_open_tx_dev(struct nodeb_ctx *ctx)
+{
+	ctx->tx_dev = dev_get_by_name(&init_net, ifname);
+	if (!ctx->tx_dev) {
+		pr_err("[B] no such netdev: %s\n", ifname);
+		return -ENODEV;
+	}
+	ctx->ifindex = ctx->tx_dev->ifindex;
+	if (fd_mode && ctx->tx_dev->mtu != CANFD_MTU) {
+		pr_err("[B] %s: MTU %u, fd_mode needs %d\n", ifname, ctx->tx_dev->mtu, CANFD_MTU);
+		return -EINVAL;
+	}
+	ctx->tx_share = ctx->tx_dev->priv_flags & IFF_TX_SKB_SHARING;
+	return nodeb_tx_fill(ctx, GFP_KERNEL);
+}
+
+/* Either TX path; timers and RX must be stopped, so nothing queues tx_refill */
+static void nodeb_close_tx(struct nodeb_ctx *ctx)
+{
+	unsigned int k, i;
+
+	cancel_work_sync(&ctx->tx_refill);
+	if (ctx->tx_sock) {
+		kernel_sock_shutdown(ctx->tx_sock, SHUT_RDWR);
+		sock_release(ctx->tx_sock);
+		ctx->tx_sock = NULL;
+	}
+	for (k = 0; k < ctx->nloops; k++) {
+		for (i = 0; i < NODEB_TX_POOL; i++) {
+			consume_skb(ctx->loop[k].tx_pool[i]);   /* NULL-safe */
+			ctx->loop[k].tx_pool[i] = NULL;
+		}
+	}
+	if (ctx->tx_dev) {
+		dev_put(ctx->tx_dev);
+		ctx->tx_dev = NULL;
+	}
+}
+
+/* -------------------------- Context ------------------------------------ */
+static void nodeb_ctx_free(struct nodeb_ctx *ctx)
+{
+	nodeb_rings_free(ctx);
+	kfree(ctx->loop);
+	kfree(ctx);
+}
+
+/* Bus context with n loops at the id_base/id_stride offsets: controllers
+ * reset, timers initialised, nothing registered or started */
+static struct nodeb_ctx *nodeb_ctx_alloc(unsigned int n, unsigned int ring_len)
+{
+	struct nodeb_ctx *ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	unsigned int k;
+
+	if (!ctx)
+		return NULL;
+	ctx->loop = kcalloc(n, sizeof(*ctx->loop), GFP_KERNEL);
+	if (!ctx->loop || nodeb_rings_alloc(ctx, ring_len)) {
+		nodeb_ctx_free(ctx);
+		return NULL;
+	}
+	ctx->nloops = n;
+	ctx->period = ktime_set(0, (s64)period_ms * 1000000LL);
+	ctx->idle_period = ktime_set(0, (s64)idle_ms * 1000000LL);
+	/* can_send() needs BH context at most, so the skb path keeps hardirq free */
+	ctx->tmode = tx_skb ? HRTIMER_MODE_REL_PINNED_SOFT : HRTIMER_MODE_REL_PINNED;
+	INIT_WORK(&ctx->rx_work, nodeb_rx_work);
+	INIT_WORK(&ctx->tx_refill, nodeb_tx_refill_work);
+
+	for (k = 0; k < n; k++) {
+		struct nodeb_loop *l = &ctx->loop[k];
+
+		l->ctx = ctx;
+		l->idx = k;
+		l->id_off = id_base + (int)k * id_stride;
+		ctrl_reset(&l->core);
+		spin_lock_init(&l->core_lock);
+		seqlock_init(&l->mbox_lock);
+		INIT_CSD(&l->arm_csd, nodeb_arm_timers_ipi, l);
+
+		/* NOTE: do NOT start TX timer here; it starts after first 0x202 */
+		hrtimer_init(&l->tx_timer, CLOCK_MONOTONIC, ctx->tmode);
+		l->tx_timer.function = nodeb_tx_timer_fn;
+		/* NEW: initialize inactivity guard (one-shot) */
+		hrtimer_init(&l->rx_guard, CLOCK_MONOTONIC, ctx->tmode);
+		l->rx_guard.function = nodeb_rx_guard_fn;
+	}
+	return ctx;
+}
+
+/* Stops the work item or kthread, waiting for a running drain */
+static void nodeb_stop_bh(struct nodeb_ctx *ctx)
+{
+	if (ctx->rx_task) {
+		kthread_stop(ctx->rx_task);
+		ctx->rx_task = NULL;
+	}
+	if (ctx->wq) {
+		flush_workqueue(ctx->wq);
+		destroy_workqueue(ctx->wq);
+		ctx->wq = NULL;
+	}
+}
+
+/* No callback may re-arm them by now */
+static void nodeb_cancel_timers(struct nodeb_ctx *ctx)
+{
+	unsigned int k;
+
+	for (k = 0; k < ctx->nloops; k++) {
+		hrtimer_cancel(&ctx->loop[k].rx_guard);   /* NEW */
+		hrtimer_cancel(&ctx->loop[k].tx_timer);
+	}
+}
+
 /* -------------------------- Module init/exit --------------------------- */
 
 static int __init nodeb_init(void)
 {
 	int ret;
 
-	g = kzalloc(sizeof(*g), GFP_KERNEL);
-	if (!g)
-		return -ENOMEM;
+	if (!strcmp(rx_overflow, "coalesce")) {
+		rx_policy = NODEB_RX_COALESCE;
+	} else if (!strcmp(rx_overflow, "drop_new")) {
+		rx_policy = NODEB_RX_DROP_NEW;
+	} else if (!strcmp(rx_overflow, "drop_old")) {
+		rx_policy = NODEB_RX_DROP_OLD;
+	} else {
+		pr_err("[B] rx_overflow=%s: expected coalesce, drop_new or drop_old\n", rx_overflow);
+		return -EINVAL;
+	}
+	if (!strcmp(tx_path, "skb")) {
+		tx_skb = true;
+	} else if (strcmp(tx_path, "socket")) {
+		pr_err("[B] tx_path=%s: expected socket or skb\n", tx_path);
+		return -EINVAL;
+	}
+	rx_fifo_len = clamp(rx_fifo_len, 2, 4096);
+	if (bh_prio < 0 || bh_prio >= MAX_RT_PRIO) {
+		pr_err("[B] bh_prio=%d: expected 0..%d\n", bh_prio, MAX_RT_PRIO - 1);
+		return -EINVAL;
+	}
+	/* cpu_online() indexes the cpumask: bound the raw parameters first */
+	if (bh_cpu >= (int)nr_cpu_ids || timer_cpu >= (int)nr_cpu_ids ||
+	    (bh_cpu >= 0 && !cpu_online(bh_cpu)) || (timer_cpu >= 0 && !cpu_online(timer_cpu))) {
+		pr_err("[B] bh_cpu=%d / timer_cpu=%d: not an online CPU\n", bh_cpu, timer_cpu);
+		return -EINVAL;
+	}
 
-	ctrl_defaults(g);
-	g->st.eta_T = 0; g->st.eta_m = 0;
-	g->st.dTh_f = 0; g->st.tau_d = Q_FROM_INT(1); /* start tau_d=1s; clamped by tau_d_min_s */
-	g->omega_cmd_rpm = 0; g->v_cmd_rpm = 0; g->have_feedback = false;
+	if (loops < 1 || loops > NODEB_MAX_LOOPS) {
+		pr_err("[B] loops=%d: expected 1..%d\n", loops, NODEB_MAX_LOOPS);
+		return -EINVAL;
+	}
+	if (id_stride) {
+		ret = nodeb_build_routes(loops, id_base, id_stride, true);
+		if (ret)
+			return ret;
+	} else {
+		ret = nodeb_pick_stride(loops, id_base);
+		if (ret < 0) {
+			pr_err("[B] loops=%d: no id_stride fits them above id_base=%d\n", loops, id_base);
+			return ret;
+		}
+		id_stride = ret;
+	}
 
-	INIT_KFIFO(g->rx_fifo);
-	spin_lock_init(&g->rx_lock);
-	INIT_WORK(&g->rx_work, nodeb_rx_work);
+	g = nodeb_ctx_alloc(loops, rx_fifo_len);
+	if (!g)
+		return -ENOMEM;
 
 	#if IS_ENABLED(CONFIG_KUNIT)
 	if (kunit_no_hw) {
@@ -623,47 +1458,56 @@ static int __init nodeb_init(void)
 	}
 	#endif
 
-	ret = nodeb_register_rx(g);
-	if (ret)
-		goto err_free;
+	/* bottom half and TX before RX: the first frame may use both */
+	if (bh_prio > 0 || bh_cpu >= 0) {
+		ret = nodeb_start_rx_thread(g);
+		if (ret) {
+			pr_err("[B] RX kthread failed: %d\n", ret);
+			goto err_free;
+		}
+	} else {
+		/* Ordered BH workqueue */
+		g->wq = alloc_ordered_workqueue("nodeb_wq", 0);
+		if (!g->wq) {
+			ret = -ENOMEM;
+			pr_err("[B] alloc_ordered_workqueue failed\n");
+			goto err_free;
+		}
+	}
 
-	ret = nodeb_open_tx_socket(g);
+	ret = tx_skb ? nodeb_open_tx_dev(g) : nodeb_open_tx_socket(g);
 	if (ret)
-		goto err_unreg;
-
-	g->seq = 0;
-	g->period = ktime_set(0, (s64)period_ms * 1000000LL);
-	hrtimer_init(&g->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
-	g->tx_timer.function = nodeb_tx_timer_fn;
-	/* NOTE: do NOT start TX timer here; it starts after first 0x202 */
-
-	/* NEW: initialize inactivity guard (one-shot) */
-	g->idle_period = ktime_set(0, (s64)idle_ms * 1000000LL);
-	hrtimer_init(&g->rx_guard, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
-	g->rx_guard.function = nodeb_rx_guard_fn;
-
-	/* Ordered BH workqueue */
-	g->wq = alloc_ordered_workqueue("nodeb_wq", 0);
-	if (!g->wq) {
-		ret = -ENOMEM;
-		pr_err("[B] alloc_ordered_workqueue failed\n");
-		goto err_timer;
-	}
+		goto err_tx;
 
-	pr_info("[B] started on %s: RX via can_rx_register(0x101/0x202/0x302/0x301/0x300), TX 0x201 period %d ms (armed on 0x202, idle %d ms)\n",
-	        ifname, period_ms, idle_ms);
+	ret = nodeb_register_rx(g);
+	if (ret)
+		goto err_tx;
+
+	nodeb_debugfs_init();
+	/* counters keep counting without their files; only the read side is lost */
+	nodeb_stats_sysfs = !sysfs_create_group(&THIS_MODULE->mkobj.kobj, &nodeb_stats_group);
+	if (!nodeb_stats_sysfs)
+		pr_warn("[B] sysfs stats group not created\n");
+
+	pr_info("[B] started on %s: %u loop(s), loop k on 0x101/0x201/0x202/0x300/0x301/0x302/0x310 %+d + k*%d, TX 0x201%s period %d ms (armed on 0x202, idle %d ms)%s%s\n",
+	        ifname, g->nloops, id_base, id_stride, fd_mode ? " (FD)" : "", period_ms, idle_ms,
+	        fast_path ? ", 0x202 stepped in softirq" : "",
+	        reactive_tx ? ", 0x201 sent per step (timer = keep-alive)" : "");
+	pr_info("[B] RX ring %u frames per CPU, overflow policy %s; TX via %s\n",
+	        g->ring_len, rx_overflow,
+	        !tx_skb ? "kernel_sendmsg()" : g->tx_share ? "can_send() (reused skb, softirq timers)" :
+	        "can_send() (skb pool, softirq timers)");
+	if (g->rx_task)
+		pr_info("[B] bottom half: kthread %s prio %d on CPU %d; timers on CPU %d (-1 = any)\n",
+		        bh_prio ? "SCHED_FIFO" : "SCHED_NORMAL", bh_prio, bh_cpu, timer_cpu);
 	return 0;
 
-err_timer:
-	hrtimer_cancel(&g->tx_timer);
-	if (g->tx_sock) {
-		kernel_sock_shutdown(g->tx_sock, SHUT_RDWR);
-		sock_release(g->tx_sock);
-	}
-err_unreg:
-	nodeb_unregister_rx(g);
+err_tx:
+	nodeb_close_tx(g);
+	nodeb_stop_bh(g);
 err_free:
-	kfree(g);
+	nodeb_ctx_free(g);
+	g = NULL;
 	return ret;
 }
 
@@ -672,22 +1516,27 @@ static void __exit nodeb_exit(void)
 	if (!g)
 		return;
 
-	hrtimer_cancel(&g->rx_guard);   /* NEW */
-	hrtimer_cancel(&g->tx_timer);
-
-	if (g->wq) {
-		flush_workqueue(g->wq);
-		destroy_workqueue(g->wq);
-	}
-
-	if (g->tx_sock) {
-		kernel_sock_shutdown(g->tx_sock, SHUT_RDWR);
-		sock_release(g->tx_sock);
-	}
+	if (nodeb_stats_sysfs)
+		sysfs_remove_group(&THIS_MODULE->mkobj.kobj, &nodeb_stats_group);
+	debugfs_remove_recursive(nodeb_dbg_dir);
 
+	/* stop the sources first: RX callbacks, then the bottom half. An arm_csd
+	 * may still be queued on timer_cpu, and a synchronous call does not wait
+	 * for it (the IPI handler runs SYNC entries before async ones), so
+	 * stopping makes it a no-op instead. The synchronous call only waits out
+	 * a callback that read the flag before it was set: handlers on one CPU
+	 * run one after another with IRQs off. Then the timers stay cancelled. */
 	nodeb_unregister_rx(g);
+	synchronize_net();
+	nodeb_stop_bh(g);
+	WRITE_ONCE(g->stopping, true);
+	if (timer_cpu >= 0)
+		smp_call_function_single(timer_cpu, nodeb_ipi_nop, NULL, 1);   /* full barrier */
+	nodeb_cancel_timers(g);
 
-	kfree(g);
+	nodeb_close_tx(g);
+
+	nodeb_ctx_free(g);
 	pr_info("[B] stopped\n");
 }
 
@@ -701,53 +1550,133 @@ static void __exit nodeb_exit(void)
 
 __visible_for_testing struct nodeb_ctx *nodeb_alloc_ctx_for_test(void)
 {
-	struct nodeb_ctx *ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
-	if (!ctx)
-		return NULL;
-	INIT_KFIFO(ctx->rx_fifo);
-	spin_lock_init(&ctx->rx_lock);
-	INIT_WORK(&ctx->rx_work, nodeb_rx_work);
-	ctrl_defaults(ctx);
-	ctx->st.eta_T = 0; ctx->st.eta_m = 0;
-	ctx->st.dTh_f = 0; ctx->st.tau_d = Q_FROM_INT(1);
-	ctx->omega_cmd_rpm = 0; ctx->v_cmd_rpm = 0;
-	ctx->have_feedback = false;
-	return ctx;
+	return nodeb_ctx_alloc(1, 128);
 }
 EXPORT_SYMBOL_GPL(nodeb_alloc_ctx_for_test);
 
 __visible_for_testing void nodeb_free_ctx_for_test(struct nodeb_ctx *ctx)
 {
-	kfree(ctx);
+	nodeb_ctx_free(ctx);
 }
 EXPORT_SYMBOL_GPL(nodeb_free_ctx_for_test);
 
+__visible_for_testing struct ctrl_core *nodeb_test_core(struct nodeb_ctx *ctx)
+{
+	return &ctx->loop[0].core;
+}
+EXPORT_SYMBOL_GPL(nodeb_test_core);
+
 __visible_for_testing void nodeb_test_ctrl_defaults(struct nodeb_ctx *ctx)
 {
-	ctrl_defaults(ctx);
+	ctrl_defaults(&ctx->loop[0].core.cfg);
 }
 EXPORT_SYMBOL_GPL(nodeb_test_ctrl_defaults);
 
 __visible_for_testing void nodeb_test_controller_step(struct nodeb_ctx *ctx)
 {
-	controller_step(ctx);
+	controller_step(&ctx->loop[0].core);
 }
 EXPORT_SYMBOL_GPL(nodeb_test_controller_step);
 
+static void nodeb_test_pack_0x202(u8 *d, s16 Ts_q01, s16 Th_q01, s16 Tc_q01,
+				  u8 vprev_q10, u8 dt_ms)
+{
+	le_put_u16(&d[0], (u16)Ts_q01);
+	le_put_u16(&d[2], (u16)Th_q01);
+	le_put_u16(&d[4], (u16)Tc_q01);
+	d[6] = vprev_q10;
+	d[7] = dt_ms;   /* 0 is coerced to 1 by the decoder */
+}
+
 __visible_for_testing void nodeb_test_inject_0x202(struct nodeb_ctx *ctx,
 						   s16 Ts_q01, s16 Th_q01, s16 Tc_q01,
 						   u8 vprev_q10, u8 dt_ms)
 {
-	if (!dt_ms) dt_ms = 1;
-	ctx->Ts = q_from_q01_temp(Ts_q01);
-	ctx->Th = q_from_q01_temp(Th_q01);
-	ctx->Tc = q_from_q01_temp(Tc_q01);
-	ctx->v_prev_rpm = (u16)(vprev_q10 * 10u);
-	ctx->dt_ms = dt_ms;
-	ctx->have_feedback = true;
-	controller_step(ctx);
+	u8 d[8];
+
+	nodeb_test_pack_0x202(d, Ts_q01, Th_q01, Tc_q01, vprev_q10, dt_ms);
+	ctrl_rx_frame(&ctx->loop[0].core, 0x202, d, sizeof(d));
 }
 EXPORT_SYMBOL_GPL(nodeb_test_inject_0x202);
+
+/* A classic 0x202 into loop 0's mailbox, as rx_overflow=coalesce stores it */
+__visible_for_testing void nodeb_test_mbox_0x202(struct nodeb_ctx *ctx,
+						 s16 Ts_q01, s16 Th_q01, s16 Tc_q01,
+						 u8 vprev_q10, u8 dt_ms)
+{
+	struct rx_item it = {};
+
+	it.cf.can_id = 0x202 + ctx->loop[0].id_off;
+	it.cf.len = 8;
+	nodeb_test_pack_0x202(it.cf.data, Ts_q01, Th_q01, Tc_q01, vprev_q10, dt_ms);
+	it.t_rx_ns = ktime_get_ns();
+	nodeb_mbox_put(&ctx->loop[0], &it);
+}
+EXPORT_SYMBOL_GPL(nodeb_test_mbox_0x202);
+
+/* The bottom half's mailbox step for loop 0, short of arming the timers */
+__visible_for_testing bool nodeb_test_mbox_step(struct nodeb_ctx *ctx)
+{
+	struct nodeb_loop *l = &ctx->loop[0];
+	struct rx_item it;
+	unsigned long flags;
+
+	if (!nodeb_mbox_take(l, &it))
+		return false;
+	spin_lock_irqsave(&l->core_lock, flags);
+	nodeb_fb_catch_up(l);
+	ctrl_rx_frame(&l->core, 0x202, it.cf.data, it.cf.len);
+	spin_unlock_irqrestore(&l->core_lock, flags);
+	return true;
+}
+EXPORT_SYMBOL_GPL(nodeb_test_mbox_step);
+
+/* Byte 4 of loop 0's next 0x201 */
+__visible_for_testing u8 nodeb_test_echo(struct nodeb_ctx *ctx)
+{
+	struct canfd_frame cf;
+
+	nodeb_build_cmd(&ctx->loop[0], &cf);
+	return cf.data[fd_mode ? CTRL_FD_ECHO_BYTE : CTRL_ECHO_BYTE];
+}
+EXPORT_SYMBOL_GPL(nodeb_test_echo);
+
+/* Rebuild the global ID table; nodeb_test_restore_routes() puts the module's back */
+__visible_for_testing int nodeb_test_build_routes(unsigned int n, int base, int stride)
+{
+	return nodeb_build_routes(n, base, stride, true);
+}
+EXPORT_SYMBOL_GPL(nodeb_test_build_routes);
+
+__visible_for_testing int nodeb_test_pick_stride(unsigned int n, int base)
+{
+	return nodeb_pick_stride(n, base);
+}
+EXPORT_SYMBOL_GPL(nodeb_test_pick_stride);
+
+__visible_for_testing bool nodeb_test_route(u32 id, unsigned int *loop, unsigned int *slot)
+{
+	struct nodeb_route r = nodeb_route[id & CAN_SFF_MASK];
+
+	if (!r.loop)
+		return false;
+	*loop = r.loop - 1;
+	*slot = r.slot;
+	return true;
+}
+EXPORT_SYMBOL_GPL(nodeb_test_route);
+
+__visible_for_testing void nodeb_test_restore_routes(void)
+{
+	WARN_ON(nodeb_build_routes(loops, id_base, id_stride, true));
+}
+EXPORT_SYMBOL_GPL(nodeb_test_restore_routes);
+
+__visible_for_testing unsigned int nodeb_test_lat_bucket(u64 ns)
+{
+	return nodeb_lat_bucket(ns);
+}
+EXPORT_SYMBOL_GPL(nodeb_test_lat_bucket);
 #endif /* CONFIG_KUNIT */
 /* ===================== end KUnit test hooks ======================================== */
 
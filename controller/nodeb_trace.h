@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* nodeb_trace.h — tracepoints for controller_kernel (events/nodeb/ in tracefs)
+ *
+ *   trace-cmd record -e nodeb -- sleep 10 && trace-cmd report
+ *   echo 1 > /sys/kernel/tracing/events/nodeb/enable; cat /sys/kernel/tracing/trace_pipe
+ *
+ * Disabled events cost one static-key branch. Temperatures are printed in m°C,
+ * flow in g/s and gains as value * 1000; the raw Q16.16 words are in the record.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nodeb
+
+#if !defined(_NODEB_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NODEB_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/can.h>
+
+/* Q16.16 -> value * 1000, rounded toward -inf */
+#define NODEB_Q_MILLI(x) ((s32)(((s64)(x) * 1000) >> 16))
+
+TRACE_EVENT(nodeb_rx,
+	TP_PROTO(const struct canfd_frame *cf, int kind, u64 wait_ns),
+	TP_ARGS(cf, kind, wait_ns),
+	TP_STRUCT__entry(
+		__field(u32, can_id)
+		__field(int, kind)
+		__field(u64, wait_ns)
+		__dynamic_array(u8, data, min_t(u8, cf->len, CANFD_MAX_DLEN))
+	),
+	TP_fast_assign(
+		__entry->can_id  = cf->can_id & CAN_SFF_MASK;
+		__entry->kind    = kind;
+		__entry->wait_ns = wait_ns;
+		memcpy(__get_dynamic_array(data), cf->data, __get_dynamic_array_len(data));
+	),
+	TP_printk("0x%03x [%u] %s kind=%d wait=%lluns",
+		  __entry->can_id, __get_dynamic_array_len(data),
+		  __print_hex(__get_dynamic_array(data), __get_dynamic_array_len(data)),
+		  __entry->kind, __entry->wait_ns)
+);
+
+TRACE_EVENT(nodeb_tx,
+	TP_PROTO(const struct canfd_frame *cf, int ret),
+	TP_ARGS(cf, ret),
+	TP_STRUCT__entry(
+		__field(u32, can_id)
+		__field(int, ret)
+		__dynamic_array(u8, data, min_t(u8, cf->len, CANFD_MAX_DLEN))
+	),
+	TP_fast_assign(
+		__entry->can_id = cf->can_id & CAN_SFF_MASK;
+		__entry->ret    = ret;
+		memcpy(__get_dynamic_array(data), cf->data, __get_dynamic_array_len(data));
+	),
+	TP_printk("0x%03x [%u] %s ret=%d",
+		  __entry->can_id, __get_dynamic_array_len(data),
+		  __print_hex(__get_dynamic_array(data), __get_dynamic_array_len(data)),
+		  __entry->ret)
+);
+
+/* controller_step inputs (latched 0x202) and outputs */
+TRACE_EVENT(nodeb_step,
+	TP_PROTO(unsigned int loop, const struct ctrl_core *c),
+	TP_ARGS(loop, c),
+	TP_STRUCT__entry(
+		__field(u8,  loop)
+		__field(s32, Ts)
+		__field(s32, Th)
+		__field(s32, Tc)
+		__field(s32, mdot)
+		__field(u16, v_prev_rpm)
+		__field(u32, dt_us)
+		__field(u8,  fb_seq)
+		__field(s32, eta_T)
+		__field(s32, eta_m)
+		__field(s32, omega_cmd_q)
+		__field(s32, v_cmd_q)
+	),
+	TP_fast_assign(
+		__entry->loop        = loop;
+		__entry->Ts          = c->Ts;
+		__entry->Th          = c->Th;
+		__entry->Tc          = c->Tc;
+		__entry->mdot        = c->mdot;
+		__entry->v_prev_rpm  = c->v_prev_rpm;
+		__entry->dt_us       = c->dt_us;
+		__entry->fb_seq      = c->fb_seq;
+		__entry->eta_T       = c->st.eta_T;
+		__entry->eta_m       = c->st.eta_m;
+		__entry->omega_cmd_q = c->omega_cmd_q;
+		__entry->v_cmd_q     = c->v_cmd_q;
+	),
+	TP_printk("loop=%u seq=%u Ts=%d Th=%d Tc=%d mC mdot=%d g/s v_prev=%u rpm dt=%uus"
+		  " eta_T=%d eta_m=%d -> omega=%d v=%d mrpm",
+		  __entry->loop, __entry->fb_seq, NODEB_Q_MILLI(__entry->Ts), NODEB_Q_MILLI(__entry->Th),
+		  NODEB_Q_MILLI(__entry->Tc), NODEB_Q_MILLI(__entry->mdot),
+		  __entry->v_prev_rpm, __entry->dt_us,
+		  NODEB_Q_MILLI(__entry->eta_T), NODEB_Q_MILLI(__entry->eta_m),
+		  NODEB_Q_MILLI(__entry->omega_cmd_q), NODEB_Q_MILLI(__entry->v_cmd_q))
+);
+
+/* setpoint / gains after a 0x301, 0x300, 0x302 or 0x310 */
+TRACE_EVENT(nodeb_params,
+	TP_PROTO(unsigned int loop, u32 can_id, const struct ctrl_cfg *cfg),
+	TP_ARGS(loop, can_id, cfg),
+	TP_STRUCT__entry(
+		__field(u8,  loop)
+		__field(u32, can_id)
+		__field(s32, Ts_sp)
+		__field(s32, KpT)
+		__field(s32, KiT)
+		__field(s32, KdT)
+		__field(s32, kawT)
+		__field(s32, Kpm)
+		__field(s32, Kim)
+		__field(s32, kawm)
+		__field(s32, kvw)
+		__field(s32, kwv)
+	),
+	TP_fast_assign(
+		__entry->loop   = loop;
+		__entry->can_id = can_id;
+		__entry->Ts_sp  = cfg->Ts_sp;
+		__entry->KpT    = cfg->KpT;
+		__entry->KiT    = cfg->KiT;
+		__entry->KdT    = cfg->KdT;
+		__entry->kawT   = cfg->kawT;
+		__entry->Kpm    = cfg->Kpm;
+		__entry->Kim    = cfg->Kim;
+		__entry->kawm   = cfg->kawm;
+		__entry->kvw    = cfg->kvw;
+		__entry->kwv    = cfg->kwv;
+	),
+	TP_printk("loop=%u 0x%03x Ts_sp=%d mC KpT=%d KiT=%d KdT=%d kawT=%d Kpm=%d Kim=%d kawm=%d"
+		  " kvw=%d kwv=%d (x1000)",
+		  __entry->loop, __entry->can_id, NODEB_Q_MILLI(__entry->Ts_sp),
+		  NODEB_Q_MILLI(__entry->KpT), NODEB_Q_MILLI(__entry->KiT),
+		  NODEB_Q_MILLI(__entry->KdT), NODEB_Q_MILLI(__entry->kawT),
+		  NODEB_Q_MILLI(__entry->Kpm), NODEB_Q_MILLI(__entry->Kim),
+		  NODEB_Q_MILLI(__entry->kawm), NODEB_Q_MILLI(__entry->kvw),
+		  NODEB_Q_MILLI(__entry->kwv))
+);
+
+/* tx_timer armed by a 0x202 after silence, or stopped by the idle guard */
+TRACE_EVENT(nodeb_guard,
+	TP_PROTO(unsigned int loop, bool tx_running, u8 fb_seq),
+	TP_ARGS(loop, tx_running, fb_seq),
+	TP_STRUCT__entry(
+		__field(u8,   loop)
+		__field(bool, tx_running)
+		__field(u8,   fb_seq)
+	),
+	TP_fast_assign(
+		__entry->loop       = loop;
+		__entry->tx_running = tx_running;
+		__entry->fb_seq     = fb_seq;
+	),
+	TP_printk("loop=%u tx_timer %s seq=%u",
+		  __entry->loop, __entry->tx_running ? "started (0x202)" : "stopped (0x202 idle)",
+		  __entry->fb_seq)
+);
+
+#endif /* _NODEB_TRACE_H */
+
+/* out-of-tree: the Makefile adds -I$(src) for the second pass */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nodeb_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* rx_ring.h — single-producer/single-consumer ring of fixed-size frames, no locks
+ *
+ * controller_kernel.c keeps one ring per CPU: the CAN RX softirq of that CPU is the only
+ * producer and nodeb_rx_work the only consumer. head is written by the producer alone. tail
+ * is written by the consumer, and by the producer only to evict the oldest entry of a full
+ * ring (drop-oldest policy); the consumer therefore commits a take with a CAS on tail and
+ * retries when an eviction raced its copy. Indices run free, capacity is a power of two.
+ * Header-only and plain C so the GTest suite and plant_bench exercise the same code.
+ */
+#pragma once
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/cache.h>
+#include <linux/atomic.h>
+#include <asm/barrier.h>
+#define RX_RING_ALIGNED             ____cacheline_aligned_in_smp
+#define rx_ring_load(p)             READ_ONCE(*(p))
+#define rx_ring_load_acquire(p)     smp_load_acquire(p)
+#define rx_ring_store_release(p, v) smp_store_release(p, v)
+#define rx_ring_cas(p, o, n)        (cmpxchg(p, o, n) == (o))
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#define RX_RING_ALIGNED             __attribute__((aligned(64)))
+#define rx_ring_load(p)             __atomic_load_n(p, __ATOMIC_RELAXED)
+#define rx_ring_load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define rx_ring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+static inline bool rx_ring_cas_u32(uint32_t *p, uint32_t o, uint32_t n)
+{ return __atomic_compare_exchange_n(p, &o, n, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+#define rx_ring_cas(p, o, n)        rx_ring_cas_u32(p, o, n)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct rx_ring {
+	uint32_t head RX_RING_ALIGNED;  /* next slot the producer fills */
+	uint32_t tail RX_RING_ALIGNED;  /* next slot the consumer takes */
+	uint32_t mask, esize;
+	unsigned char *slot;
+};
+
+/* rx_ring_put() results */
+#define RX_RING_QUEUED   0
+#define RX_RING_EVICTED  1      /* queued; the oldest entry was dropped for it */
+#define RX_RING_FULL    (-1)    /* not queued */
+
+/* n must be a power of two; slots holds n * esize bytes */
+static inline void rx_ring_init(struct rx_ring *r, void *slots, uint32_t n, uint32_t esize)
+{
+	r->head  = 0;
+	r->tail  = 0;
+	r->mask  = n - 1;
+	r->esize = esize;
+	r->slot  = (unsigned char *)slots;
+}
+
+/* Producer side. evict: a full ring drops its oldest entry instead of item;
+ * on RX_RING_EVICTED that entry is copied to old first, unless old is NULL. */
+static inline int rx_ring_put_old(struct rx_ring *r, const void *item, bool evict, void *old)
+{
+	uint32_t h = r->head;
+	uint32_t t = rx_ring_load_acquire(&r->tail);
+	unsigned char *s = r->slot + (size_t)(h & r->mask) * r->esize;
+	int ret = RX_RING_QUEUED;
+
+	if (h - t > r->mask) {
+		if (!evict)
+			return RX_RING_FULL;
+		/* a failed CAS means the consumer took it first, which frees the slot too */
+		if (rx_ring_cas(&r->tail, t, t + 1)) {
+			ret = RX_RING_EVICTED;
+			if (old)   /* slot t is slot h; only this producer writes it */
+				memcpy(old, s, r->esize);
+		}
+	}
+	memcpy(s, item, r->esize);
+	rx_ring_store_release(&r->head, h + 1);
+	return ret;
+}
+
+static inline int rx_ring_put(struct rx_ring *r, const void *item, bool evict)
+{
+	return rx_ring_put_old(r, item, evict, NULL);
+}
+
+/* Consumer side: oldest entry into out, false if the ring is empty */
+static inline bool rx_ring_take(struct rx_ring *r, void *out)
+{
+	uint32_t t;
+
+	do {
+		t = rx_ring_load(&r->tail);
+		if (t == rx_ring_load_acquire(&r->head))
+			return false;
+		memcpy(out, r->slot + (size_t)(t & r->mask) * r->esize, r->esize);
+	} while (!rx_ring_cas(&r->tail, t, t + 1));   /* evicted under us: copy is void */
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
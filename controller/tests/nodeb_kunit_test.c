@@ -5,50 +5,32 @@
 #include <kunit/test.h>
 #include <linux/types.h>
 #include "nodeb_test_hooks.h"
-
-/* Minimal Q16.16 helpers for assertions */
-typedef s64 q16_16;
-#define Q_ONE          ((q16_16)1 << 16)
-#define Q_FROM_INT(x)  ((q16_16)(x) << 16)
-#define Q_TO_INT(x)    ((int)((x) >> 16))
-
-/* Shallow peek; we only rely on fields used in assertions */
-struct ctrl_cfg_peek {
-	q16_16 Ts_sp, KpT, KiT, KdT, Kpm, Kim, kawT, kawm, kvw, kwv, tau_d_min_s;
-	u16 omega0_rpm, v0_rpm, omega_max_rpm, v_max_rpm, v_cut_rpm;
-};
-struct ctrl_state_peek { q16_16 eta_T, eta_m, dTh_f, tau_d; };
-
-struct nodeb_ctx_peek {
-	struct { struct ctrl_cfg_peek cfg; struct ctrl_state_peek st; } _;
-	u16 omega_cmd_rpm, v_cmd_rpm;
-	q16_16 Ts, Th, Tc;
-	u16 v_prev_rpm; u8 dt_ms; bool have_feedback;
-};
+#include "../controller_core.h"
 
 /* ---- Test 1: defaults ---- */
 static void nodeb_defaults_populates_expected(struct kunit *test)
 {
 	struct nodeb_ctx *ctx = nodeb_alloc_ctx_for_test();
-	struct nodeb_ctx_peek *p = (void *)ctx;
+	struct ctrl_core *p;
 
 	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	p = nodeb_test_core(ctx);
 
 	nodeb_test_ctrl_defaults(ctx);
-	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->_.cfg.Ts_sp), 25);
-	KUNIT_EXPECT_LE(test, abs(Q_TO_INT(p->_.cfg.KpT) - 101), 1);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.KiT, Q_ONE/10);
-	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->_.cfg.KdT), 4);
-	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->_.cfg.Kpm), 130);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.Kim, Q_ONE/100);
-	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->_.cfg.kawT), 5);
-	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->_.cfg.kawm), 10);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.omega0_rpm, 100);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.v0_rpm, 100);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.omega_max_rpm, 4000);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.v_max_rpm, 2800);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.v_cut_rpm, 700);
-	KUNIT_EXPECT_EQ(test, p->_.cfg.tau_d_min_s, Q_ONE/1000);
+	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->cfg.Ts_sp), 25);
+	KUNIT_EXPECT_LE(test, abs(Q_TO_INT(p->cfg.KpT) - 101), 1);
+	KUNIT_EXPECT_EQ(test, p->cfg.KiT, Q_ONE/10);
+	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->cfg.KdT), 4);
+	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->cfg.Kpm), 130);
+	KUNIT_EXPECT_EQ(test, p->cfg.Kim, Q_ONE/100);
+	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->cfg.kawT), 5);
+	KUNIT_EXPECT_EQ(test, Q_TO_INT(p->cfg.kawm), 10);
+	KUNIT_EXPECT_EQ(test, p->cfg.omega0_rpm, 100);
+	KUNIT_EXPECT_EQ(test, p->cfg.v0_rpm, 100);
+	KUNIT_EXPECT_EQ(test, p->cfg.omega_max_rpm, 4000);
+	KUNIT_EXPECT_EQ(test, p->cfg.v_max_rpm, 2800);
+	KUNIT_EXPECT_EQ(test, p->cfg.v_cut_rpm, 700);
+	KUNIT_EXPECT_EQ(test, p->cfg.tau_d_min_s, Q_ONE/1000);
 
 	nodeb_free_ctx_for_test(ctx);
 }
@@ -57,14 +39,15 @@ static void nodeb_defaults_populates_expected(struct kunit *test)
 static void nodeb_step_basic_behavior(struct kunit *test)
 {
 	struct nodeb_ctx *ctx = nodeb_alloc_ctx_for_test();
-	struct nodeb_ctx_peek *p = (void *)ctx;
+	struct ctrl_core *p;
 	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	p = nodeb_test_core(ctx);
 
 	/* Ts=20.0C, Th=25.0C, Tc=22.5C, v_prev=1200 rpm, dt=10 ms */
 	nodeb_test_inject_0x202(ctx, 200, 250, 225, 120, 10);
 
 	KUNIT_EXPECT_TRUE(test, p->have_feedback);
-	KUNIT_EXPECT_EQ(test, p->dt_ms, 10);
+	KUNIT_EXPECT_EQ(test, p->dt_us, 10000u);
 	KUNIT_EXPECT_EQ(test, p->v_prev_rpm, 1200);
 	KUNIT_EXPECT_GE(test, p->omega_cmd_rpm, 0);
 	KUNIT_EXPECT_GE(test, p->v_cmd_rpm, 0);
@@ -78,12 +61,13 @@ static void nodeb_step_basic_behavior(struct kunit *test)
 static void nodeb_ingest_edge_cases(struct kunit *test)
 {
 	struct nodeb_ctx *ctx = nodeb_alloc_ctx_for_test();
-	struct nodeb_ctx_peek *p = (void *)ctx;
+	struct ctrl_core *p;
 	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+	p = nodeb_test_core(ctx);
 
 	nodeb_test_inject_0x202(ctx, 250, 250, 250, 0, 0); /* dt=0 -> 1 */
 	KUNIT_EXPECT_TRUE(test, p->have_feedback);
-	KUNIT_EXPECT_EQ(test, p->dt_ms, 1);
+	KUNIT_EXPECT_EQ(test, p->dt_us, 1000u);
 
 	nodeb_test_inject_0x202(ctx, 100, 50, 50, 10, 10); /* big error */
 	KUNIT_EXPECT_LE(test, p->omega_cmd_rpm, 4000);
@@ -92,10 +76,77 @@ static void nodeb_ingest_edge_cases(struct kunit *test)
 	nodeb_free_ctx_for_test(ctx);
 }
 
+/* ---- Test 3b: coalesced classic 0x202s still count in the 0x201 echo ---- */
+static void nodeb_coalesce_keeps_echo(struct kunit *test)
+{
+	struct nodeb_ctx *ctx = nodeb_alloc_ctx_for_test();
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx);
+
+	nodeb_test_mbox_0x202(ctx, 200, 250, 225, 120, 10);   /* node C's #1 */
+	KUNIT_ASSERT_TRUE(test, nodeb_test_mbox_step(ctx));
+	KUNIT_EXPECT_EQ(test, nodeb_test_echo(ctx), 1);
+
+	nodeb_test_mbox_0x202(ctx, 200, 250, 225, 120, 10);   /* #2, overwritten */
+	nodeb_test_mbox_0x202(ctx, 200, 250, 225, 120, 10);   /* #3, overwritten */
+	nodeb_test_mbox_0x202(ctx, 201, 250, 225, 120, 10);   /* #4 */
+	KUNIT_ASSERT_TRUE(test, nodeb_test_mbox_step(ctx));
+	KUNIT_EXPECT_EQ(test, nodeb_test_echo(ctx), 4);
+	KUNIT_EXPECT_FALSE(test, nodeb_test_mbox_step(ctx));
+	KUNIT_EXPECT_EQ(test, nodeb_test_echo(ctx), 4);
+
+	nodeb_free_ctx_for_test(ctx);
+}
+
+/* ---- Test 4: latency histogram buckets are log2 ns ---- */
+static void nodeb_lat_buckets(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, nodeb_test_lat_bucket(0), 0u);
+	KUNIT_EXPECT_EQ(test, nodeb_test_lat_bucket(1), 1u);
+	KUNIT_EXPECT_EQ(test, nodeb_test_lat_bucket(1023), 10u);
+	KUNIT_EXPECT_EQ(test, nodeb_test_lat_bucket(1024), 11u);
+	KUNIT_EXPECT_EQ(test, nodeb_test_lat_bucket(U64_MAX), 39u);   /* open-ended */
+}
+
+/* ---- Test 5: multi-loop ID table ---- */
+static void nodeb_routes(struct kunit *test)
+{
+	unsigned int loop, slot;
+
+	KUNIT_ASSERT_EQ(test, nodeb_test_build_routes(3, 0, 0x20), 0);
+	KUNIT_EXPECT_TRUE(test, nodeb_test_route(0x222, &loop, &slot));
+	KUNIT_EXPECT_EQ(test, loop, 1u);
+	KUNIT_EXPECT_EQ(test, slot, 1u);            /* 0x202 */
+	KUNIT_EXPECT_TRUE(test, nodeb_test_route(0x350, &loop, &slot));
+	KUNIT_EXPECT_EQ(test, loop, 2u);
+	KUNIT_EXPECT_EQ(test, slot, 5u);            /* 0x310 */
+	KUNIT_EXPECT_FALSE(test, nodeb_test_route(0x221, &loop, &slot));   /* our own 0x201 */
+	KUNIT_EXPECT_FALSE(test, nodeb_test_route(0x262, &loop, &slot));   /* loop 3 not built */
+	KUNIT_EXPECT_FALSE(test, nodeb_test_route(0x123, &loop, &slot));
+
+	/* loop 1's 0x101 lands on loop 0's 0x201 */
+	KUNIT_EXPECT_EQ(test, nodeb_test_build_routes(2, 0, 0x100), -EINVAL);
+	KUNIT_EXPECT_EQ(test, nodeb_test_build_routes(1, 0x500, 0), -EINVAL);
+
+	/* id_stride=0: widest stride that fits; 0x20 already clashes at 9 loops */
+	KUNIT_EXPECT_EQ(test, nodeb_test_build_routes(9, 0, 0x20), -EINVAL);
+	KUNIT_EXPECT_EQ(test, nodeb_test_pick_stride(1, 0), 0);
+	KUNIT_EXPECT_EQ(test, nodeb_test_pick_stride(48, 0), 26);
+	KUNIT_EXPECT_EQ(test, nodeb_test_pick_stride(115, 0), 11);
+	KUNIT_EXPECT_TRUE(test, nodeb_test_route(0x202 + 114 * 11, &loop, &slot));
+	KUNIT_EXPECT_EQ(test, loop, 114u);
+	KUNIT_EXPECT_EQ(test, nodeb_test_pick_stride(116, 0), -EINVAL);
+	KUNIT_EXPECT_EQ(test, nodeb_test_pick_stride(128, -134), 11);
+
+	nodeb_test_restore_routes();
+}
+
 static struct kunit_case nodeb_kunit_cases[] = {
 	KUNIT_CASE(nodeb_defaults_populates_expected),
 	KUNIT_CASE(nodeb_step_basic_behavior),
 	KUNIT_CASE(nodeb_ingest_edge_cases),
+	KUNIT_CASE(nodeb_coalesce_keeps_echo),
+	KUNIT_CASE(nodeb_lat_buckets),
+	KUNIT_CASE(nodeb_routes),
 	{}
 };
 
@@ -2,13 +2,25 @@
 #include <linux/types.h>
 
 struct nodeb_ctx;
+struct ctrl_core;
 
 #if IS_ENABLED(CONFIG_KUNIT)
 struct nodeb_ctx *nodeb_alloc_ctx_for_test(void);
 void nodeb_free_ctx_for_test(struct nodeb_ctx *ctx);
+struct ctrl_core *nodeb_test_core(struct nodeb_ctx *ctx);
 void nodeb_test_ctrl_defaults(struct nodeb_ctx *ctx);
 void nodeb_test_controller_step(struct nodeb_ctx *ctx);
 void nodeb_test_inject_0x202(struct nodeb_ctx *ctx,
 			     s16 Ts_q01, s16 Th_q01, s16 Tc_q01,
 			     u8 vprev_q10, u8 dt_ms);
+void nodeb_test_mbox_0x202(struct nodeb_ctx *ctx,
+			   s16 Ts_q01, s16 Th_q01, s16 Tc_q01,
+			   u8 vprev_q10, u8 dt_ms);
+bool nodeb_test_mbox_step(struct nodeb_ctx *ctx);
+u8 nodeb_test_echo(struct nodeb_ctx *ctx);
+unsigned int nodeb_test_lat_bucket(u64 ns);
+int nodeb_test_build_routes(unsigned int n, int base, int stride);
+int nodeb_test_pick_stride(unsigned int n, int base);
+bool nodeb_test_route(u32 id, unsigned int *loop, unsigned int *slot);
+void nodeb_test_restore_routes(void);
 #endif
\ No newline at end of file
@@ -2,7 +2,8 @@
 // Build:  gcc -O2 -Wall -o ctrl_set ctrl_set.c -lm
 // Usage:  ./ctrl_set <ifname> <Ts_sp_C> [--kp KpT] [--ki KiT] [--kd KdT] [--kaw kawT]
 //                                         [--kpm Kpm] [--kim Kim] [--kawm kawm] [--kvw kvw] [--kwv kwv]
-//         Add --no-params to send only 0x301.
+//         Add --no-params to send only 0x301, --fd to send everything as one CAN FD 0x310 frame,
+//         --id_off <n> to address loop k of a loops=N module (n = id_base + k*id_stride).
 // Example:
 //   ./ctrl_set vcan0 30.0 --kp 120 --ki 0.15 --kd 5 --kaw 4 --kpm 150 --kim 0.02 --kawm 8 --kvw -0.1 --kwv -0.03
 
@@ -48,12 +49,19 @@ EXPOSE void u16_to_le(uint8_t* b, uint16_t v){ b[0] = (uint8_t)(v & 0xFFu); b[1]
 EXPOSE int16_t  to_q01(float x){ long v = lroundf(x * 10.0f);  if (v < -32768) v = -32768; if (v >  32767) v =  32767; return (int16_t)v; }
 EXPOSE uint16_t to_q88(float x){ long v = lroundf(x * 256.0f); if (v < 0)      v = 0;      if (v > 65535) v = 65535; return (uint16_t)v; }
 EXPOSE uint8_t  to_q44(float x){ long v = lroundf(x * 16.0f);  if (v < 0)      v = 0;      if (v >   255) v =   255; return (uint8_t)v; }
+EXPOSE int32_t  to_q16(float x){ double v = round((double)x * 65536.0); if (v < -2147483648.0) v = -2147483648.0; if (v > 2147483647.0) v = 2147483647.0; return (int32_t)v; }
 
-/* Small helper to send a CAN frame (keeps main tiny) */
+/* Small helpers to send a CAN frame (keeps main tiny); only main uses them */
+#ifndef UNIT_TEST
 static void send_frame_or_die(int s, const struct can_frame* f, const char* tag){
     ssize_t n = send(s, f, sizeof(*f), 0);
     if (n != (ssize_t)sizeof(*f)) die(tag);
 }
+static void send_fd_frame_or_die(int s, const struct canfd_frame* f, const char* tag){
+    ssize_t n = send(s, f, sizeof(*f), 0);
+    if (n != (ssize_t)sizeof(*f)) die(tag);
+}
+#endif
 
 /* ---------- Parameter bundle ---------- */
 typedef struct {
@@ -61,6 +69,8 @@ typedef struct {
     float KpT, KiT, KdT, kawT;
     float Kpm, Kim, kawm, kvw, kwv;
     bool  send_params;
+    bool  fd;           /* one CAN FD 0x310 frame instead of 0x301 + 0x300 + 0x302 */
+    int   id_off;       /* added to every ID: the target loop's id_base + k*id_stride */
 } CtrlParams;
 
 /* Defaults (match your original controller defaults) */
@@ -69,7 +79,7 @@ static CtrlParams default_params(float Ts_sp){
         .Ts_sp_C = Ts_sp,
         .KpT = 100.6f, .KiT = 0.10f, .KdT = 4.0f,  .kawT = 5.0f,
         .Kpm = 130.0f, .Kim = 0.01f, .kawm = 10.0f, .kvw = -0.15f, .kwv = -0.02f,
-        .send_params = true
+        .send_params = true, .fd = false, .id_off = 0
     };
     return p;
 }
@@ -84,6 +94,16 @@ static bool parse_args(int argc, char** argv, CtrlParams* out){
     for (int i = 3; i < argc; i++){
         const char* a = argv[i];
         if (!strcmp(a, "--no-params")) { out->send_params = false; continue; }
+        if (!strcmp(a, "--fd"))        { out->fd = true; continue; }
+        if (!strcmp(a, "--id_off")) {
+            /* decimal or 0x hex, may be negative; 0x300..0x310 must stay 11-bit */
+            char* end = NULL;
+            if (i+1 >= argc) return false;
+            long off = strtol(argv[++i], &end, 0);
+            if (!*argv[i] || *end || 0x300 + off < 0 || 0x310 + off > CAN_SFF_MASK) return false;
+            out->id_off = (int)off;
+            continue;
+        }
         #define NEXT_FLOAT(VAR) do{ if (i+1 >= argc) return false; (VAR) = strtof(argv[++i], NULL); }while(0)
 
         if      (!strcmp(a, "--kp"))  NEXT_FLOAT(out->KpT);
@@ -102,16 +122,16 @@ static bool parse_args(int argc, char** argv, CtrlParams* out){
 }
 
 /* ---------- Frame builders (also used in tests) ---------- */
-EXPOSE void build_setpoint_frame(float Ts_sp_C, struct can_frame* sp){
+EXPOSE void build_setpoint_frame(const CtrlParams* p, struct can_frame* sp){
     memset(sp, 0, sizeof(*sp));
-    sp->can_id = 0x301; sp->len = 8;
-    u16_to_le(&sp->data[0], (uint16_t)to_q01(Ts_sp_C));
+    sp->can_id = 0x301 + p->id_off; sp->len = 8;
+    u16_to_le(&sp->data[0], (uint16_t)to_q01(p->Ts_sp_C));
 }
 
 EXPOSE void build_params_frames(const CtrlParams* p, struct can_frame* p1, struct can_frame* p2){
     /* 0x300: KpT/KiT/KdT (q8.8), kawT (q4.4) */
     memset(p1, 0, sizeof(*p1));
-    p1->can_id = 0x300; p1->len = 8;
+    p1->can_id = 0x300 + p->id_off; p1->len = 8;
     u16_to_le(&p1->data[0], to_q88(p->KpT));
     u16_to_le(&p1->data[2], to_q88(p->KiT));
     u16_to_le(&p1->data[4], to_q88(p->KdT));
@@ -119,7 +139,7 @@ EXPOSE void build_params_frames(const CtrlParams* p, struct can_frame* p1, struc
 
     /* 0x302: Kpm/Kim (q8.8), kawm/kvw/kwv (q4.4) */
     memset(p2, 0, sizeof(*p2));
-    p2->can_id = 0x302; p2->len = 8;
+    p2->can_id = 0x302 + p->id_off; p2->len = 8;
     u16_to_le(&p2->data[0], to_q88(p->Kpm));
     u16_to_le(&p2->data[2], to_q88(p->Kim));
     p2->data[4] = to_q44(p->kawm);
@@ -127,6 +147,21 @@ EXPOSE void build_params_frames(const CtrlParams* p, struct can_frame* p1, struc
     p2->data[6] = to_q44(p->kwv);
 }
 
+/* 0x310 (CAN FD, 48 bytes): Ts_sp and all nine gains as s32 Q16.16, LE; signed, so negative
+ * decoupling gains survive (q4.4 in 0x302 clamps them to 0). Layout: controller_core.h. */
+EXPOSE void build_params_fd_frame(const CtrlParams* p, struct canfd_frame* f){
+    const float v[10] = { p->Ts_sp_C, p->KpT, p->KiT, p->KdT, p->kawT,
+                          p->Kpm, p->Kim, p->kawm, p->kvw, p->kwv };
+    memset(f, 0, sizeof(*f));
+    f->can_id = 0x310 + p->id_off; f->len = 48;
+    f->flags  = CANFD_BRS;
+    for (int i = 0; i < 10; i++) {
+        uint32_t q = (uint32_t)to_q16(v[i]);
+        u16_to_le(&f->data[4*i],     (uint16_t)(q & 0xFFFFu));
+        u16_to_le(&f->data[4*i + 2], (uint16_t)(q >> 16));
+    }
+}
+
 /* Test-only consolidated builder to avoid sockets in gtests */
 #ifdef UNIT_TEST
 EXPOSE void build_ctrl_frames(const CtrlParams* p,
@@ -136,7 +171,7 @@ EXPOSE void build_ctrl_frames(const CtrlParams* p,
 {
 
     
-    if (sp)   build_setpoint_frame(p->Ts_sp_C, sp);
+    if (sp)   build_setpoint_frame(p, sp);
     if (p->send_params) {
         if (f300 && f302) build_params_frames(p, f300, f302);
     } else {
@@ -152,7 +187,7 @@ static void usage(const char* prog){
         "Usage: %s <ifname> <Ts_sp_C> "
         "[--kp KpT] [--ki KiT] [--kd KdT] [--kaw kawT] "
         "[--kpm Kpm] [--kim Kim] [--kawm kawm] [--kvw kvw] [--kwv kwv] "
-        "[--no-params]\n", prog);
+        "[--no-params] [--fd] [--id_off n]\n", prog);
 }
 
 /* ---------- Main (excluded in unit tests) ---------- */
@@ -168,19 +203,33 @@ int main(int argc, char** argv){
     if (s < 0) die("socket");
     bind_socket(s, ifname);
 
+    if (P.fd && P.send_params){
+        int on = 1;
+        if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on)) < 0) die("CAN_RAW_FD_FRAMES");
+        struct canfd_frame f310;
+        build_params_fd_frame(&P, &f310);
+        send_fd_frame_or_die(s, &f310, "send 0x310");
+        printf("[A] 0x%03X (FD) Ts_sp=%.3f°C KpT=%.4g KiT=%.4g KdT=%.4g kawT=%.4g "
+               "Kpm=%.4g Kim=%.4g kawm=%.4g kvw=%.4g kwv=%.4g\n", (unsigned)f310.can_id,
+               P.Ts_sp_C, P.KpT, P.KiT, P.KdT, P.kawT, P.Kpm, P.Kim, P.kawm, P.kvw, P.kwv);
+        close(s);
+        return 0;
+    }
+
     /* 0x301: setpoint */
     struct can_frame sp;
-    build_setpoint_frame(P.Ts_sp_C, &sp);
+    build_setpoint_frame(&P, &sp);
     send_frame_or_die(s, &sp, "send 0x301");
-    printf("[A] 0x301 Ts_sp=%.1f°C\n", P.Ts_sp_C);
+    printf("[A] 0x%03X Ts_sp=%.1f°C\n", (unsigned)sp.can_id, P.Ts_sp_C);
 
     if (P.send_params){
         struct can_frame f300, f302;
         build_params_frames(&P, &f300, &f302);
         send_frame_or_die(s, &f300, "send 0x300");
-        printf("[A] 0x300 KpT=%.3g KiT=%.3g KdT=%.3g kawT=%.3g\n", P.KpT, P.KiT, P.KdT, P.kawT);
+        printf("[A] 0x%03X KpT=%.3g KiT=%.3g KdT=%.3g kawT=%.3g\n", (unsigned)f300.can_id,
+               P.KpT, P.KiT, P.KdT, P.kawT);
         send_frame_or_die(s, &f302, "send 0x302");
-        printf("[A] 0x302 Kpm=%.3g Kim=%.3g kawm=%.3g kvw=%.3g kwv=%.3g\n",
+        printf("[A] 0x%03X Kpm=%.3g Kim=%.3g kawm=%.3g kvw=%.3g kwv=%.3g\n", (unsigned)f302.can_id,
                P.Kpm, P.Kim, P.kawm, P.kvw, P.kwv);
     }
 
@@ -6,6 +6,8 @@ typedef struct {
     float KpT, KiT, KdT, kawT;
     float Kpm, Kim, kawm, kvw, kwv;
     bool  send_params;
+    bool  fd;
+    int   id_off;
 } CtrlParams;
 
 #ifdef __cplusplus
@@ -17,11 +19,14 @@ void     u16_to_le(unsigned char* b, unsigned short v);
 short    to_q01(float x);
 unsigned short to_q88(float x);
 unsigned char  to_q44(float x);
+int            to_q16(float x);
 
 void build_ctrl_frames(const CtrlParams* p,
                        struct can_frame* sp,
                        struct can_frame* p1,
                        struct can_frame* p2);
+/* CAN FD 0x310: Ts_sp + all gains, s32 Q16.16 LE */
+void build_params_fd_frame(const CtrlParams* p, struct canfd_frame* f);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,441 @@
+// ctrl_tune.c — Gain sweep / auto-tuning over CtrlParams, evaluated in the offline closed loop
+// Build:  gcc -O2 -Wall -DUNIT_TEST -c plant_user.c plant_sim.c ctrl_set.c   (libraries, no main)
+//         gcc -O2 -Wall -pthread -o ctrl_tune ctrl_tune.c plant_user.o plant_sim.o ctrl_set.o controller/controller_core.c -lm
+// Usage:  ./ctrl_tune --param KpT:50:200 --param KiT:0.01:1:log --param Kpm:50:250
+//                     --sample lhs --n 2000 --Ts_sp 35 --hours 0.5 --top 10 --csv sweep.csv
+//
+// Each candidate goes through ctrl_set's 0x300/0x302 quantisation (q8.8 / q4.4) into the
+// controller core, so the ranking is for the gains the module would actually run; then a
+// sim_run() of plant_step + controller_step is scored by IAE/ISE, overshoot and actuator
+// effort. Candidates are spread over a work-stealing pthread pool: every worker owns a
+// contiguous index range, pops from its front, and steals half of a victim's remaining
+// range from the back when it runs dry.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <linux/can.h>
+
+#include "ctrl_set_api.h"
+#include "plant_sim_api.h"
+
+#ifdef UNIT_TEST
+  #define EXPOSE /* external linkage in tests */
+#else
+  #define EXPOSE static
+#endif
+
+typedef enum { TUNE_GRID, TUNE_RANDOM, TUNE_LHS } TuneSampling;
+
+typedef struct {
+    int    field;
+    double lo, hi;
+    bool   log;
+} TuneRange;
+
+typedef struct {
+    double   dt;
+    unsigned tx_every;
+    uint64_t steps;
+    Plant    init;
+    double   w_iae, w_ise, w_os, w_u;
+} TuneScenario;
+
+typedef struct {
+    CtrlParams p;
+    SimMetrics m;
+    double     cost;
+} TuneResult;
+
+/*** -------- Parameter space -------- ***/
+static const struct { const char* name; const char* flag; size_t off; } tune_fields[] = {
+    { "KpT",  "--kp",   offsetof(CtrlParams, KpT)  },
+    { "KiT",  "--ki",   offsetof(CtrlParams, KiT)  },
+    { "KdT",  "--kd",   offsetof(CtrlParams, KdT)  },
+    { "kawT", "--kaw",  offsetof(CtrlParams, kawT) },
+    { "Kpm",  "--kpm",  offsetof(CtrlParams, Kpm)  },
+    { "Kim",  "--kim",  offsetof(CtrlParams, Kim)  },
+    { "kawm", "--kawm", offsetof(CtrlParams, kawm) },
+    { "kvw",  "--kvw",  offsetof(CtrlParams, kvw)  },
+    { "kwv",  "--kwv",  offsetof(CtrlParams, kwv)  },
+};
+#define TUNE_NFIELDS (int)(sizeof(tune_fields) / sizeof(tune_fields[0]))
+
+EXPOSE int tune_field_index(const char* name){
+    for (int i = 0; i < TUNE_NFIELDS; i++)
+        if (!strcmp(name, tune_fields[i].name)) return i;
+    return -1;
+}
+
+EXPOSE const char* tune_field_name(int field){
+    return (field >= 0 && field < TUNE_NFIELDS) ? tune_fields[field].name : "?";
+}
+
+static float* tune_field(CtrlParams* p, int field){
+    return (float*)((char*)p + tune_fields[field].off);
+}
+
+static uint64_t splitmix64(uint64_t* s){
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+static double rng_u01(uint64_t* s){ return (double)(splitmix64(s) >> 11) * 0x1.0p-53; }
+
+static double range_at(const TuneRange* r, double u){
+    if (r->log && r->lo > 0.0 && r->hi > 0.0)
+        return exp(log(r->lo) + u * (log(r->hi) - log(r->lo)));
+    return r->lo + u * (r->hi - r->lo);
+}
+
+EXPOSE size_t tune_sample(const CtrlParams* base, const TuneRange* r, size_t nr,
+                          TuneSampling how, size_t n, uint64_t seed,
+                          CtrlParams* out, size_t cap){
+    size_t total = n;
+    if (how == TUNE_GRID){
+        total = 1;
+        for (size_t d = 0; d < nr; d++){
+            if (total > SIZE_MAX / (n ? n : 1)) return SIZE_MAX;
+            total *= n;
+        }
+    }
+    size_t m = total < cap ? total : cap;
+    uint64_t s = seed;
+
+    for (size_t i = 0; i < m; i++) out[i] = *base;
+
+    for (size_t d = 0; d < nr; d++){
+        if (how == TUNE_GRID){
+            size_t stride = 1;
+            for (size_t e = 0; e < d; e++) stride *= n;
+            for (size_t i = 0; i < m; i++){
+                size_t j = (i / stride) % n;
+                double u = n > 1 ? (double)j / (double)(n - 1) : 0.0;
+                *tune_field(&out[i], r[d].field) = (float)range_at(&r[d], u);
+            }
+        } else if (how == TUNE_RANDOM){
+            for (size_t i = 0; i < m; i++)
+                *tune_field(&out[i], r[d].field) = (float)range_at(&r[d], rng_u01(&s));
+        } else {
+            // Latin hypercube: one sample per 1/n stratum in every dimension
+            size_t* perm = malloc(n * sizeof(*perm));
+            if (!perm) return 0;
+            for (size_t i = 0; i < n; i++) perm[i] = i;
+            for (size_t i = n; i > 1; i--){
+                size_t j = (size_t)(splitmix64(&s) % i);
+                size_t t = perm[i - 1]; perm[i - 1] = perm[j]; perm[j] = t;
+            }
+            for (size_t i = 0; i < m; i++)
+                *tune_field(&out[i], r[d].field) =
+                    (float)range_at(&r[d], ((double)perm[i] + rng_u01(&s)) / (double)n);
+            free(perm);
+        }
+    }
+    return total;
+}
+
+/*** -------- One candidate -------- ***/
+static void ctrl_apply_params(struct ctrl_core* c, const CtrlParams* p){
+    CtrlParams q = *p;
+    q.send_params = true;
+    struct can_frame sp, f300, f302;
+    build_ctrl_frames(&q, &sp, &f300, &f302);
+    ctrl_reset(c);
+    ctrl_rx_frame(c, sp.can_id,   sp.data,   sp.len);
+    ctrl_rx_frame(c, f300.can_id, f300.data, f300.len);
+    ctrl_rx_frame(c, f302.can_id, f302.data, f302.len);
+}
+
+EXPOSE void tune_eval(const TuneScenario* sc, TuneResult* res){
+    struct ctrl_core c;
+    ctrl_apply_params(&c, &res->p);
+
+    Plant s = sc->init;
+    SimConfig cfg = {
+        .dt = sc->dt, .tx_every = sc->tx_every, .steps = sc->steps,
+        .metrics = &res->m,
+    };
+    sim_run(&cfg, &s, &c);
+
+    double T = (double)sc->steps * sc->dt;
+    res->cost = sc->w_iae * res->m.iae / T + sc->w_ise * res->m.ise / T
+              + sc->w_os * res->m.overshoot + sc->w_u * res->m.effort;
+    if (!isfinite(res->cost)) res->cost = INFINITY;
+}
+
+/*** -------- Work-stealing pool -------- ***/
+// Per-worker range [head, tail) packed with a 16-bit tag into one word, so both the owner's
+// pop and a thief's steal are a single CAS; the tag changes whenever the owner installs a
+// stolen range, which keeps a stale CAS from landing on a recycled (head, tail) pair.
+#define RQ_MAX         ((1u << 24) - 1)
+#define RQ_PACK(h,t,g) ((uint64_t)(h) | (uint64_t)(t) << 24 | (uint64_t)(g) << 48)
+#define RQ_HEAD(r)     ((uint32_t)((r) & RQ_MAX))
+#define RQ_TAIL(r)     ((uint32_t)(((r) >> 24) & RQ_MAX))
+#define RQ_TAG(r)      ((uint32_t)((r) >> 48))
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+} TuneDeque;
+
+typedef struct {
+    const TuneScenario* sc;
+    TuneResult*         res;
+    TuneDeque*          dq;
+    unsigned            nthreads;
+    _Atomic uint64_t    done;
+} TunePool;
+
+typedef struct { TunePool* pool; unsigned id; } TuneWorker;
+
+static bool rq_pop(TuneDeque* q, uint32_t* idx){
+    uint64_t r = atomic_load_explicit(&q->range, memory_order_acquire);
+    for (;;){
+        uint32_t h = RQ_HEAD(r), t = RQ_TAIL(r);
+        if (h >= t) return false;
+        if (atomic_compare_exchange_weak_explicit(&q->range, &r, RQ_PACK(h + 1, t, RQ_TAG(r)),
+                                                  memory_order_acq_rel, memory_order_acquire)){
+            *idx = h;
+            return true;
+        }
+    }
+}
+
+static bool rq_steal(TuneDeque* q, uint32_t* lo, uint32_t* hi){
+    uint64_t r = atomic_load_explicit(&q->range, memory_order_acquire);
+    for (;;){
+        uint32_t h = RQ_HEAD(r), t = RQ_TAIL(r);
+        if (h >= t) return false;
+        uint32_t n = (t - h + 1) / 2;
+        if (atomic_compare_exchange_weak_explicit(&q->range, &r, RQ_PACK(h, t - n, RQ_TAG(r)),
+                                                  memory_order_acq_rel, memory_order_acquire)){
+            *lo = t - n; *hi = t;
+            return true;
+        }
+    }
+}
+
+static void* tune_worker(void* arg){
+    TuneWorker* w = arg;
+    TunePool* P = w->pool;
+    TuneDeque* own = &P->dq[w->id];
+    uint64_t n_done = 0;
+
+    for (;;){
+        uint32_t i;
+        if (rq_pop(own, &i)){
+            tune_eval(P->sc, &P->res[i]);
+            n_done++;
+            continue;
+        }
+        bool got = false;
+        for (unsigned k = 1; k < P->nthreads && !got; k++){
+            uint32_t lo, hi;
+            if (rq_steal(&P->dq[(w->id + k) % P->nthreads], &lo, &hi)){
+                // Only this thread installs into its own (empty) range
+                uint64_t r = atomic_load_explicit(&own->range, memory_order_relaxed);
+                atomic_store_explicit(&own->range, RQ_PACK(lo + 1, hi, RQ_TAG(r) + 1),
+                                      memory_order_release);
+                tune_eval(P->sc, &P->res[lo]);
+                n_done++;
+                got = true;
+            }
+        }
+        if (!got) break;   // every range empty; in-flight stolen ranges finish on their thief
+    }
+    atomic_fetch_add(&P->done, n_done);
+    return NULL;
+}
+
+// Evaluates res[0..n) in place (res[i].p set by the caller). Returns 0, or -1 on bad input.
+EXPOSE int tune_run(const TuneScenario* sc, TuneResult* res, size_t n, unsigned threads){
+    if (n > RQ_MAX) return -1;
+    if (threads == 0) threads = 1;
+    if (threads > n) threads = n ? (unsigned)n : 1;
+
+    TunePool P = { .sc = sc, .res = res, .nthreads = threads };
+    atomic_init(&P.done, 0);
+    P.dq = aligned_alloc(64, threads * sizeof(TuneDeque));
+    TuneWorker* w = calloc(threads, sizeof(*w));
+    pthread_t* th = calloc(threads, sizeof(*th));
+    if (!P.dq || !w || !th){ free(P.dq); free(w); free(th); return -1; }
+
+    for (unsigned k = 0; k < threads; k++){
+        uint32_t lo = (uint32_t)(n * k / threads), hi = (uint32_t)(n * (k + 1) / threads);
+        atomic_init(&P.dq[k].range, RQ_PACK(lo, hi, 0));
+        w[k].pool = &P; w[k].id = k;
+    }
+
+    unsigned started = 0;
+    for (unsigned k = 1; k < threads; k++, started++)
+        if (pthread_create(&th[k], NULL, tune_worker, &w[k]) != 0) break;
+    tune_worker(&w[0]);                        // the caller works too (and steals from any
+    for (unsigned k = 1; k <= started; k++)    // worker that failed to start)
+        pthread_join(th[k], NULL);
+
+    int rc = atomic_load(&P.done) == n ? 0 : -1;
+    free(P.dq); free(w); free(th);
+    return rc;
+}
+
+static int cmp_cost(const void* a, const void* b){
+    double x = ((const TuneResult*)a)->cost, y = ((const TuneResult*)b)->cost;
+    return (x > y) - (x < y);
+}
+
+EXPOSE void tune_rank(TuneResult* res, size_t n){
+    qsort(res, n, sizeof(*res), cmp_cost);
+}
+
+/*** -------- Main -------- ***/
+#ifndef UNIT_TEST
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s --param NAME:lo:hi[:log] [--param ...] [options]\n"
+        "  NAME is one of KpT KiT KdT kawT Kpm Kim kawm kvw kwv (others stay at ctrl_set defaults)\n"
+        "  --sample <grid|random|lhs>  design (default lhs); grid uses --n points per parameter\n"
+        "  --n <N>            candidates (default 256)         --seed <S>    RNG seed (default 1)\n"
+        "  --threads <T>      workers (default: online CPUs)   --top <K>     rows to print (default 10)\n"
+        "  --csv <file>       every candidate, ranked\n"
+        "  --hours <h> --dt_ms <ms> --period_ms <ms> --Ts_sp <°C>   scenario (0.5 h, 10, 100, 35)\n"
+        "  --Ts/--Th/--Tc <°C> --mdot <kg/s> --v_prev <rpm>         initial plant state\n"
+        "  --w_iae --w_ise --w_os --w_u <w>   cost = w_iae*IAE/T + w_ise*ISE/T + w_os*overshoot\n"
+        "                                            + w_u*effort  (default 1, 0, 1, 1)\n"
+        "  --fast_math        table-driven mu_water/UA_func\n"
+        "Gains reach the controller through ctrl_set's q8.8/q4.4 frames; q4.4 terms (kawT, kawm,\n"
+        "kvw, kwv) cannot be negative on the wire and are clamped to 0..15.9375.\n",
+        prog);
+}
+
+int main(int argc, char** argv){
+    TuneRange ranges[16];
+    size_t nr = 0, n = 256, top = 10;
+    uint64_t seed = 1;
+    TuneSampling how = TUNE_LHS;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = ncpu > 0 ? (unsigned)ncpu : 1;
+    const char* csv = NULL;
+    double hours = 0.5, dt_ms = 10.0, period_ms = 100.0;
+    CtrlParams base = {
+        .Ts_sp_C = 35.0f,
+        .KpT = 100.6f, .KiT = 0.10f, .KdT = 4.0f,  .kawT = 5.0f,
+        .Kpm = 130.0f, .Kim = 0.01f, .kawm = 10.0f, .kvw = -0.15f, .kwv = -0.02f,
+        .send_params = true
+    };
+    TuneScenario sc = {
+        .init = { .Ts = 155.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.18, .v_prev = 0.0 },
+        .w_iae = 1.0, .w_ise = 0.0, .w_os = 1.0, .w_u = 1.0,
+    };
+
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--fast_math") == 0){ plant_set_fast_math(1); continue; }
+        if (i + 1 >= argc){ usage(argv[0]); return 1; }
+        const char* a = argv[i];
+        const char* v = argv[++i];
+        if (!strcmp(a, "--param")){
+            char name[16]; double lo, hi; char lg[8] = "";
+            int k = sscanf(v, "%15[^:]:%lf:%lf:%7s", name, &lo, &hi, lg);
+            int f = k >= 3 ? tune_field_index(name) : -1;
+            if (f < 0 || nr == sizeof(ranges) / sizeof(ranges[0])){
+                fprintf(stderr, "bad --param '%s'\n", v); usage(argv[0]); return 1;
+            }
+            ranges[nr++] = (TuneRange){ .field = f, .lo = lo, .hi = hi, .log = !strcmp(lg, "log") };
+        }
+        else if (!strcmp(a, "--sample")){
+            if      (!strcmp(v, "grid"))   how = TUNE_GRID;
+            else if (!strcmp(v, "random")) how = TUNE_RANDOM;
+            else if (!strcmp(v, "lhs"))    how = TUNE_LHS;
+            else { fprintf(stderr, "bad --sample '%s'\n", v); usage(argv[0]); return 1; }
+        }
+        else if (!strcmp(a, "--n"))         n         = (size_t)parse_or(v, (double)n);
+        else if (!strcmp(a, "--seed"))      seed      = (uint64_t)parse_or(v, (double)seed);
+        else if (!strcmp(a, "--threads"))   threads   = (unsigned)parse_or(v, threads);
+        else if (!strcmp(a, "--top"))       top       = (size_t)parse_or(v, (double)top);
+        else if (!strcmp(a, "--csv"))       csv       = v;
+        else if (!strcmp(a, "--hours"))     hours     = parse_or(v, hours);
+        else if (!strcmp(a, "--dt_ms"))     dt_ms     = parse_or(v, dt_ms);
+        else if (!strcmp(a, "--period_ms")) period_ms = parse_or(v, period_ms);
+        else if (!strcmp(a, "--Ts_sp"))     base.Ts_sp_C = (float)parse_or(v, base.Ts_sp_C);
+        else if (!strcmp(a, "--Ts"))        sc.init.Ts     = parse_or(v, sc.init.Ts);
+        else if (!strcmp(a, "--Th"))        sc.init.Th     = parse_or(v, sc.init.Th);
+        else if (!strcmp(a, "--Tc"))        sc.init.Tc     = parse_or(v, sc.init.Tc);
+        else if (!strcmp(a, "--mdot"))      sc.init.mdot   = parse_or(v, sc.init.mdot);
+        else if (!strcmp(a, "--v_prev"))    sc.init.v_prev = parse_or(v, sc.init.v_prev);
+        else if (!strcmp(a, "--w_iae"))     sc.w_iae = parse_or(v, sc.w_iae);
+        else if (!strcmp(a, "--w_ise"))     sc.w_ise = parse_or(v, sc.w_ise);
+        else if (!strcmp(a, "--w_os"))      sc.w_os  = parse_or(v, sc.w_os);
+        else if (!strcmp(a, "--w_u"))       sc.w_u   = parse_or(v, sc.w_u);
+        else { usage(argv[0]); return 1; }
+    }
+
+    dt_ms = round(sat(dt_ms, 1.0, 255.0));
+    sc.dt       = dt_ms * 1e-3;
+    sc.tx_every = (unsigned)fmax(1.0, round(period_ms / dt_ms));
+    sc.steps    = (uint64_t)llround(hours * 3600.0 / sc.dt);
+    if (sc.steps == 0){ fprintf(stderr, "empty scenario\n"); return 1; }
+
+    size_t total = tune_sample(&base, ranges, nr, how, n, seed, NULL, 0);
+    if (total == 0 || total > RQ_MAX){
+        fprintf(stderr, "design has %zu candidates (max %u)\n", total, RQ_MAX);
+        return 1;
+    }
+    CtrlParams* cand = malloc(total * sizeof(*cand));
+    TuneResult* res  = calloc(total, sizeof(*res));
+    if (!cand || !res){ perror("malloc"); return 1; }
+    tune_sample(&base, ranges, nr, how, n, seed, cand, total);
+    for (size_t i = 0; i < total; i++) res[i].p = cand[i];
+    free(cand);
+
+    printf("[Tune] %zu candidates x %.2f h (%llu steps) on %u threads\n",
+           total, hours, (unsigned long long)sc.steps, threads);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (tune_run(&sc, res, total, threads) != 0){ fprintf(stderr, "tune_run failed\n"); return 1; }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = (double)(t1.tv_sec - t0.tv_sec) + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+    tune_rank(res, total);
+
+    printf("[Tune] %.2f s, %.1f candidates/s, %.2f M plant steps/s\n",
+           wall, (double)total / wall, (double)total * (double)sc.steps / wall * 1e-6);
+    printf("rank      cost   IAE/T  ISE/T  overshoot effort |    KpT     KiT    KdT  kawT     Kpm     Kim  kawm    kvw    kwv\n");
+    double T = (double)sc.steps * sc.dt;
+    for (size_t i = 0; i < total && i < top; i++){
+        const TuneResult* r = &res[i];
+        printf("%4zu %9.4f %7.3f %6.2f %9.3f %6.3f | %6.2f %7.4f %6.3f %5.2f %7.2f %7.4f %5.2f %6.3f %6.3f\n",
+               i + 1, r->cost, r->m.iae / T, r->m.ise / T, r->m.overshoot, r->m.effort,
+               r->p.KpT, r->p.KiT, r->p.KdT, r->p.kawT, r->p.Kpm, r->p.Kim, r->p.kawm, r->p.kvw, r->p.kwv);
+    }
+    const CtrlParams* b = &res[0].p;
+    printf("[Tune] best: ./ctrl_set vcan0 %.1f", b->Ts_sp_C);
+    for (int f = 0; f < TUNE_NFIELDS; f++)
+        printf(" %s %g", tune_fields[f].flag, *tune_field((CtrlParams*)b, f));
+    printf("\n");
+
+    if (csv){
+        FILE* out = fopen(csv, "w");
+        if (!out){ perror(csv); return 1; }
+        fprintf(out, "rank,cost,iae,ise,overshoot,effort");
+        for (int f = 0; f < TUNE_NFIELDS; f++) fprintf(out, ",%s", tune_field_name(f));
+        fprintf(out, "\n");
+        for (size_t i = 0; i < total; i++){
+            fprintf(out, "%zu,%.6g,%.6g,%.6g,%.6g,%.6g", i + 1, res[i].cost, res[i].m.iae,
+                    res[i].m.ise, res[i].m.overshoot, res[i].m.effort);
+            for (int f = 0; f < TUNE_NFIELDS; f++) fprintf(out, ",%g", *tune_field(&res[i].p, f));
+            fprintf(out, "\n");
+        }
+        fclose(out);
+    }
+    free(res);
+    return 0;
+}
+#endif
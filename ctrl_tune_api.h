@@ -0,0 +1,49 @@
+/* ctrl_tune_api.h */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ctrl_set_api.h"
+#include "plant_sim_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Must match the definitions in ctrl_tune.c */
+typedef enum { TUNE_GRID, TUNE_RANDOM, TUNE_LHS } TuneSampling;
+
+typedef struct {
+    int    field;        /* tune_field_index() */
+    double lo, hi;
+    bool   log;          /* sample uniformly in log(lo)..log(hi) */
+} TuneRange;
+
+typedef struct {
+    double   dt;
+    unsigned tx_every;
+    uint64_t steps;
+    Plant    init;
+    double   w_iae, w_ise, w_os, w_u;   /* cost weights */
+} TuneScenario;
+
+typedef struct {
+    CtrlParams p;
+    SimMetrics m;
+    double     cost;
+} TuneResult;
+
+int    tune_field_index(const char* name);   /* "KpT".."kwv", or -1 */
+const char* tune_field_name(int field);
+/* Writes up to cap candidates (base with the ranged fields replaced) and returns how many
+ * the design has: n for random/LHS, n^nr for a grid. */
+size_t tune_sample(const CtrlParams* base, const TuneRange* r, size_t nr,
+                   TuneSampling how, size_t n, uint64_t seed,
+                   CtrlParams* out, size_t cap);
+void   tune_eval(const TuneScenario* sc, TuneResult* res);          /* res->p in, rest out */
+int    tune_run(const TuneScenario* sc, TuneResult* res, size_t n, unsigned threads);
+void   tune_rank(TuneResult* res, size_t n);                       /* ascending cost */
+
+#ifdef __cplusplus
+}
+#endif
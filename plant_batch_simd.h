@@ -0,0 +1,130 @@
+/* plant_batch_simd.h — one Heun step over a block of SoA plants, one ISA per inclusion.
+ *
+ * Included by plant_user.c (never on its own) with these defined:
+ *   BK_NAME  kernel function name        BK_ATTR  target attribute (may be empty)
+ *   BK_W     lanes per vector             bvec     vector type
+ *   BK_LOAD(p) BK_STORE(p,v) BK_SET1(x)
+ *   BK_ADD BK_SUB BK_MUL BK_DIV BK_MIN BK_MAX (a,b)   BK_SQRT(a)
+ *   BK_FMA(a,b,c)  a*b + c, fused where the ISA has it
+ *
+ * The body mirrors plant_rhs()/plant_step() term for term. Three things differ:
+ *   - divisions by the constant capacitances/inertance become reciprocal multiplies;
+ *   - UA is read from the batch cache (it only depends on v_cmd, see plant_batch_step);
+ *   - mu(Tstar)/mu(60) is folded into exp(B/(T_K-C) - B/(333.15-C)); with Tstar clamped
+ *     to [-10,120] °C the exponent stays in [-0.31, 0.73], i.e. within 0.52 of
+ *     exp_center, where a degree-13 Taylor polynomial is good to ~1e-15 relative,
+ *     so no libm call is left in the loop.
+ * Each loop iteration advances two independent vectors, so the div/sqrt latency
+ * of one overlaps the other's arithmetic; exp() is evaluated Estrin-style.
+ */
+
+#define BK_CAT_(a, b) a##b
+#define BK_CAT(a, b)  BK_CAT_(a, b)
+#define BK_INLINE __attribute__((always_inline))   /* one flat loop body to schedule */
+#define BK_SAT(x, lo, hi) BK_MAX(BK_SET1(lo), BK_MIN((x), BK_SET1(hi)))
+
+static inline BK_INLINE BK_ATTR bvec BK_CAT(BK_NAME, _mu_ratio)(bvec Tstar)
+{
+    bvec T_K = BK_ADD(BK_SAT(Tstar, -10.0, 120.0), BK_SET1(273.15));
+    bvec x = BK_SUB(BK_DIV(BK_SET1(mu_B), BK_SUB(T_K, BK_SET1(mu_C))),
+                    BK_SET1(mu_B / (60.0 + 273.15 - mu_C) + exp_center));
+    /* Estrin: pairs, then x^2, x^4, x^8 levels; four FMAs deep instead of 13 */
+    bvec x2 = BK_MUL(x, x), x4 = BK_MUL(x2, x2), x8 = BK_MUL(x4, x4);
+    bvec p[7];
+    for (int k = 0; k < 7; k++)
+        p[k] = BK_FMA(BK_SET1(exp_taylor[2 * k + 1]), x, BK_SET1(exp_taylor[2 * k]));
+    bvec q0 = BK_FMA(p[1], x2, p[0]), q1 = BK_FMA(p[3], x2, p[2]), q2 = BK_FMA(p[5], x2, p[4]);
+    bvec r0 = BK_FMA(q1, x4, q0),     r1 = BK_FMA(p[6], x4, q2);
+    return BK_MUL(BK_FMA(r1, x8, r0), BK_SET1(exp_center_val));
+}
+
+static inline BK_INLINE BK_ATTR void BK_CAT(BK_NAME, _rhs)(bvec Ts, bvec Th, bvec Tc, bvec mdot,
+                                                           bvec dP_pump_omega, bvec ua,
+                                                           bvec* dTs, bvec* dTh, bvec* dTc, bvec* dmdot)
+{
+    Ts   = BK_SAT(Ts, Ts_min, Ts_max);
+    Th   = BK_SAT(Th, Th_min, Th_max);
+    Tc   = BK_SAT(Tc, Tc_min, Tc_max);
+    mdot = BK_SAT(mdot, mdot_min, mdot_max);
+
+    bvec Tstar = BK_SAT(BK_MUL(BK_SET1(0.5), BK_ADD(Th, Tc)), Tc_min, Th_max);
+
+    bvec q_sh   = BK_MUL(BK_SET1(Gsh), BK_SUB(Ts, Th));
+    bvec q_conv = BK_MUL(BK_MUL(mdot, BK_SET1(cp)), BK_SUB(Th, Tc));
+
+    bvec p_sys = BK_MUL(BK_SET1(P_base),
+                        BK_FMA(BK_SET1(P_alpha), BK_SUB(Ts, BK_SET1(60.0)), BK_SET1(1.0)));
+    p_sys = BK_SAT(p_sys, 0.0, 2e5);
+
+    bvec dTs_loc = BK_MUL(BK_SUB(p_sys, q_sh), BK_SET1(1.0 / Cs));
+    bvec dTh_loc = BK_MUL(BK_SUB(q_sh, q_conv), BK_SET1(1.0 / Ch));
+    bvec dTc_loc = BK_MUL(BK_SUB(q_conv, BK_MUL(ua, BK_SUB(Tc, BK_SET1(T_amb)))), BK_SET1(1.0 / Cr));
+
+    bvec m_c     = BK_SAT(mdot, -10.0, 10.0);
+    bvec dP_pump = BK_SUB(dP_pump_omega, BK_MUL(BK_SET1(b), BK_MUL(m_c, m_c)));
+    bvec Rh      = BK_MUL(BK_SET1(Rh0), BK_CAT(BK_NAME, _mu_ratio)(Tstar));
+    bvec sabs    = BK_SQRT(BK_FMA(mdot, mdot, BK_SET1(1e-9 * 1e-9)));
+    bvec dP_loss = BK_MUL(BK_MUL(Rh, mdot), sabs);
+    bvec dm_loc  = BK_MUL(BK_SUB(dP_pump, dP_loss), BK_SET1(1.0 / Lh));
+
+    *dTs   = BK_SAT(dTs_loc, -500.0, 500.0);
+    *dTh   = BK_SAT(dTh_loc, -500.0, 500.0);
+    *dTc   = BK_SAT(dTc_loc, -500.0, 500.0);
+    *dmdot = BK_SAT(dm_loc,  -500.0,  50.0);
+}
+
+/* One vector of plants at i */
+static inline BK_INLINE BK_ATTR void BK_CAT(BK_NAME, _one)(PlantBatch* bt, size_t i,
+                                                           const double* omega_cmd_rpm,
+                                                           const double* v_cmd_rpm, bvec vdt)
+{
+    const bvec half = BK_SET1(0.5);
+
+    bvec Ts   = BK_LOAD(&bt->Ts[i]);
+    bvec Th   = BK_LOAD(&bt->Th[i]);
+    bvec Tc   = BK_LOAD(&bt->Tc[i]);
+    bvec mdot = BK_LOAD(&bt->mdot[i]);
+    bvec ua   = BK_LOAD(&bt->ua[i]);
+
+    bvec om   = BK_SAT(BK_LOAD(&omega_cmd_rpm[i]), -SQR_CAP_OMEGA, SQR_CAP_OMEGA);
+    bvec pump = BK_MUL(BK_SET1(a0), BK_MUL(om, om));
+
+    bvec dTs1, dTh1, dTc1, dmd1;
+    BK_CAT(BK_NAME, _rhs)(Ts, Th, Tc, mdot, pump, ua, &dTs1, &dTh1, &dTc1, &dmd1);
+
+    bvec dTs2, dTh2, dTc2, dmd2;
+    BK_CAT(BK_NAME, _rhs)(BK_FMA(dTs1, vdt, Ts), BK_FMA(dTh1, vdt, Th),
+                          BK_FMA(dTc1, vdt, Tc), BK_FMA(dmd1, vdt, mdot),
+                          pump, ua, &dTs2, &dTh2, &dTc2, &dmd2);
+
+    Ts   = BK_FMA(BK_MUL(half, BK_ADD(dTs1, dTs2)), vdt, Ts);
+    Th   = BK_FMA(BK_MUL(half, BK_ADD(dTh1, dTh2)), vdt, Th);
+    Tc   = BK_FMA(BK_MUL(half, BK_ADD(dTc1, dTc2)), vdt, Tc);
+    mdot = BK_FMA(BK_MUL(half, BK_ADD(dmd1, dmd2)), vdt, mdot);
+
+    BK_STORE(&bt->Ts[i],     BK_SAT(Ts, Ts_min, Ts_max));
+    BK_STORE(&bt->Th[i],     BK_SAT(Th, Th_min, Th_max));
+    BK_STORE(&bt->Tc[i],     BK_SAT(Tc, Tc_min, Tc_max));
+    BK_STORE(&bt->mdot[i],   BK_SAT(mdot, mdot_min, mdot_max));
+    BK_STORE(&bt->v_prev[i], BK_SAT(BK_LOAD(&v_cmd_rpm[i]), 0.0, v_max));
+}
+
+/* Advances plants [i0, i1); (i1 - i0) must be a multiple of BK_W. */
+static BK_ATTR void BK_NAME(PlantBatch* bt, size_t i0, size_t i1,
+                            const double* omega_cmd_rpm, const double* v_cmd_rpm, double dt)
+{
+    const bvec vdt = BK_SET1(dt);
+    size_t i = i0;
+
+    for (; i + 2 * BK_W <= i1; i += 2 * BK_W) {
+        BK_CAT(BK_NAME, _one)(bt, i,        omega_cmd_rpm, v_cmd_rpm, vdt);
+        BK_CAT(BK_NAME, _one)(bt, i + BK_W, omega_cmd_rpm, v_cmd_rpm, vdt);
+    }
+    if (i < i1)
+        BK_CAT(BK_NAME, _one)(bt, i, omega_cmd_rpm, v_cmd_rpm, vdt);
+}
+
+#undef BK_INLINE
+#undef BK_SAT
+#undef BK_CAT
+#undef BK_CAT_
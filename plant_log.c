@@ -0,0 +1,160 @@
+// plant_log.c — Asynchronous binary logger: SPSC ring + writer thread, levels, rate cap, drop counters
+// Build:  gcc -O2 -Wall -pthread -o plant_user plant_user.c plant_log.c plant_rec.c -lm
+//
+// The hot loop calls plog_push() with a small binary record (no formatting, no syscalls besides
+// the vDSO clock read); a writer thread turns records into text through the caller's format
+// callback. plog_push() never blocks: a full ring or an exhausted rate budget drops the record
+// and counts it. Exactly one producer thread and one consumer (the writer, or plog_drain()).
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "plant_log_api.h"
+
+struct Plog {
+    PlogConfig  cfg;
+    PlogRecord* ring;
+    size_t      mask;
+
+    // Producer-owned line
+    _Alignas(64) _Atomic size_t head;
+    size_t      tail_cache;     /* last tail seen, refreshed only when the ring looks full */
+    double      tokens;
+    uint64_t    last_ns;
+    _Atomic uint64_t enqueued, filtered, dropped_full, dropped_rate;
+
+    // Consumer-owned line
+    _Alignas(64) _Atomic size_t tail;
+    _Atomic uint64_t written;
+    _Atomic bool stop;
+    pthread_t    th;
+    bool         threaded;
+};
+
+static uint64_t mono_ns(void){
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void count(_Atomic uint64_t* c){
+    // single writer per counter: a relaxed load/store pair, no locked RMW on the hot path
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+PlogLevel plog_level_parse(const char* s, PlogLevel fallback){
+    static const char* names[] = { "debug", "info", "warn", "error", "off" };
+    for (int i = 0; s && i < 5; i++)
+        if (strcmp(s, names[i]) == 0) return (PlogLevel)i;
+    return fallback;
+}
+
+bool plog_push(Plog* lg, PlogLevel level, uint8_t kind, const void* payload, size_t len){
+    if (level < lg->cfg.level) { count(&lg->filtered); return false; }
+
+    uint64_t now = mono_ns();
+    if (lg->cfg.rate > 0.0) {
+        lg->tokens += (double)(now - lg->last_ns) * 1e-9 * lg->cfg.rate;
+        if (lg->tokens > lg->cfg.burst) lg->tokens = lg->cfg.burst;
+        lg->last_ns = now;
+        if (lg->tokens < 1.0) { count(&lg->dropped_rate); return false; }
+        lg->tokens -= 1.0;
+    }
+
+    size_t h = atomic_load_explicit(&lg->head, memory_order_relaxed);
+    if (h - lg->tail_cache > lg->mask) {
+        lg->tail_cache = atomic_load_explicit(&lg->tail, memory_order_acquire);
+        if (h - lg->tail_cache > lg->mask) { count(&lg->dropped_full); return false; }
+    }
+
+    PlogRecord* r = &lg->ring[h & lg->mask];
+    if (len > PLOG_PAYLOAD) len = PLOG_PAYLOAD;
+    r->t_ns  = now;
+    r->level = (uint8_t)level;
+    r->kind  = kind;
+    r->len   = (uint16_t)len;
+    if (len) memcpy(r->payload, payload, len);
+    atomic_store_explicit(&lg->head, h + 1, memory_order_release);
+    count(&lg->enqueued);
+    return true;
+}
+
+size_t plog_drain(Plog* lg){
+    size_t t = atomic_load_explicit(&lg->tail, memory_order_relaxed);
+    size_t h = atomic_load_explicit(&lg->head, memory_order_acquire);
+    size_t n = 0;
+    for (; t != h; t++, n++) {
+        if (lg->cfg.format) lg->cfg.format(lg->cfg.out, &lg->ring[t & lg->mask], lg->cfg.user);
+        // free the slot right away so the producer sees space during a long burst
+        atomic_store_explicit(&lg->tail, t + 1, memory_order_release);
+    }
+    if (n) {
+        fflush(lg->cfg.out);
+        atomic_store_explicit(&lg->written,
+            atomic_load_explicit(&lg->written, memory_order_relaxed) + n, memory_order_relaxed);
+    }
+    return n;
+}
+
+static void* writer_main(void* arg){
+    Plog* lg = arg;
+    struct timespec idle = { .tv_sec = 0, .tv_nsec = (long)lg->cfg.idle_us * 1000L };
+    while (!atomic_load_explicit(&lg->stop, memory_order_acquire)) {
+        if (plog_drain(lg) == 0) nanosleep(&idle, NULL);
+    }
+    plog_drain(lg);   // whatever was pushed before plog_close()
+    return NULL;
+}
+
+Plog* plog_open(const PlogConfig* cfg){
+    Plog* lg = aligned_alloc(64, (sizeof(Plog) + 63) & ~(size_t)63);
+    if (!lg) return NULL;
+    memset(lg, 0, sizeof(*lg));
+    lg->cfg = *cfg;
+    if (!lg->cfg.out)     lg->cfg.out = stdout;
+    if (!lg->cfg.idle_us) lg->cfg.idle_us = 1000;
+    if (lg->cfg.rate < 0.0) lg->cfg.rate = 0.0;
+    if (lg->cfg.burst < 1.0) lg->cfg.burst = lg->cfg.rate > 1.0 ? lg->cfg.rate : 1.0;
+    lg->tokens  = lg->cfg.burst;
+    lg->last_ns = mono_ns();
+
+    size_t cap = 1;
+    while (cap < (cfg->capacity ? cfg->capacity : 4096)) cap <<= 1;
+    lg->mask = cap - 1;
+    lg->ring = aligned_alloc(64, cap * sizeof(PlogRecord));
+    if (!lg->ring) { free(lg); return NULL; }
+
+    if (!lg->cfg.manual) {
+        int rc = pthread_create(&lg->th, NULL, writer_main, lg);
+        if (rc != 0) { free(lg->ring); free(lg); errno = rc; return NULL; }
+        lg->threaded = true;
+    }
+    return lg;
+}
+
+void plog_stats(const Plog* lg, PlogStats* st){
+    st->enqueued     = atomic_load_explicit(&lg->enqueued, memory_order_relaxed);
+    st->written      = atomic_load_explicit(&lg->written, memory_order_relaxed);
+    st->filtered     = atomic_load_explicit(&lg->filtered, memory_order_relaxed);
+    st->dropped_full = atomic_load_explicit(&lg->dropped_full, memory_order_relaxed);
+    st->dropped_rate = atomic_load_explicit(&lg->dropped_rate, memory_order_relaxed);
+}
+
+void plog_close(Plog* lg){
+    if (!lg) return;
+    if (lg->threaded) {
+        atomic_store_explicit(&lg->stop, true, memory_order_release);
+        pthread_join(lg->th, NULL);
+    } else {
+        plog_drain(lg);
+    }
+    free(lg->ring);
+    free(lg);
+}
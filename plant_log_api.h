@@ -0,0 +1,59 @@
+/* plant_log_api.h */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { PLOG_DEBUG, PLOG_INFO, PLOG_WARN, PLOG_ERROR, PLOG_OFF } PlogLevel;
+
+#define PLOG_PAYLOAD 112
+typedef struct {
+    uint64_t t_ns;              /* CLOCK_MONOTONIC at plog_push() */
+    uint8_t  level;             /* PlogLevel */
+    uint8_t  kind;              /* caller-defined record type */
+    uint16_t len;               /* payload bytes used */
+    uint8_t  payload[PLOG_PAYLOAD];
+} PlogRecord;                   /* 128 bytes */
+
+/* Runs on the writer thread, once per record, in enqueue order */
+typedef void (*PlogFormat)(FILE* out, const PlogRecord* r, void* user);
+
+typedef struct {
+    size_t     capacity;        /* records; rounded up to a power of two (default 4096) */
+    PlogLevel  level;           /* records below this are discarded (not counted as drops) */
+    double     rate;            /* records/s admitted by the token bucket, 0 = unlimited */
+    double     burst;           /* bucket depth (default: max(1, rate)) */
+    unsigned   idle_us;         /* writer sleep when the ring is empty (default 1000) */
+    bool       manual;          /* no writer thread: the owner calls plog_drain() */
+    FILE*      out;
+    PlogFormat format;
+    void*      user;
+} PlogConfig;
+
+typedef struct {
+    uint64_t enqueued, written;
+    uint64_t filtered;          /* below cfg.level */
+    uint64_t dropped_full;      /* ring full */
+    uint64_t dropped_rate;      /* over the rate cap */
+} PlogStats;
+
+typedef struct Plog Plog;
+
+Plog*  plog_open(const PlogConfig* cfg);       /* NULL on error (errno set) */
+/* Producer side (exactly one thread). Never blocks: false if filtered or dropped. */
+bool   plog_push(Plog* lg, PlogLevel level, uint8_t kind, const void* payload, size_t len);
+size_t plog_drain(Plog* lg);                    /* consumer side; records written */
+void   plog_stats(const Plog* lg, PlogStats* st);
+void   plog_close(Plog* lg);                    /* drains, joins the writer, frees */
+/* "debug".."off"; fallback for anything else, PLOG_LEVEL_INVALID to tell a bad name apart */
+#define PLOG_LEVEL_INVALID ((PlogLevel)-1)
+PlogLevel plog_level_parse(const char* s, PlogLevel fallback);
+
+#ifdef __cplusplus
+}
+#endif
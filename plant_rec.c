@@ -0,0 +1,228 @@
+// plant_rec.c — Flight recorder: memory-mapped, preallocated, append-only log of 0x201/0x202 + plant state
+// Build:  gcc -O2 -Wall -pthread -o plant_user plant_user.c plant_log.c plant_rec.c -lm
+//         gcc -O2 -Wall -o rec_dump rec_dump.c plant_rec.c        (reader / CSV export)
+//
+// File = 64-byte PrecHeader + fixed 40-byte slots. An event slot holds the frame, the time since
+// the previous record and the five state fields as float deltas against the state the reader
+// reconstructs (closed loop, so rounding does not accumulate: each field is within 2^-24 of its
+// last change). Every key_every records, and whenever the time delta would overflow, a two-slot
+// PREC_KEY with absolute time and exact doubles goes first. Appending is a memcpy into the
+// mapping and a store of hdr->used; a crashed writer leaves a readable prefix.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "controller/controller_core.h"
+#include "plant_rec_api.h"
+
+_Static_assert(sizeof(PrecHeader) == 64, "PrecHeader layout");
+_Static_assert(sizeof(PrecSlot) == 40, "PrecSlot layout");
+_Static_assert(sizeof(PrecKey) == 2 * sizeof(PrecSlot), "PrecKey must span two slots");
+_Static_assert(sizeof(PrecState) == 5 * sizeof(double), "PrecState is five packed doubles");
+
+static int64_t clock_ns(clockid_t id){
+    struct timespec ts; clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*** -------- Writer -------- ***/
+int prec_open(PlantRec* r, const char* path, size_t bytes, unsigned key_every){
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    if (bytes < sizeof(PrecHeader) + 4 * sizeof(PrecSlot)) { errno = EINVAL; return -1; }
+    uint64_t cap = (bytes - sizeof(PrecHeader)) / sizeof(PrecSlot);
+    r->map_len = sizeof(PrecHeader) + cap * sizeof(PrecSlot);
+
+    r->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (r->fd < 0) return -1;
+    // Reserve the blocks now: a full disk must not turn into SIGBUS inside the step loop
+    int rc = posix_fallocate(r->fd, 0, (off_t)r->map_len);
+    if (rc != 0) { close(r->fd); r->fd = -1; errno = rc; return -1; }
+
+    r->base = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->base == MAP_FAILED) { r->base = NULL; close(r->fd); r->fd = -1; return -1; }
+    madvise(r->base, r->map_len, MADV_SEQUENTIAL);
+
+    r->hdr   = (PrecHeader*)r->base;
+    r->slots = (PrecSlot*)(r->base + sizeof(PrecHeader));
+    r->hdr->magic      = PREC_MAGIC;
+    r->hdr->version    = PREC_VERSION;
+    r->hdr->slot_size  = sizeof(PrecSlot);
+    r->hdr->key_every  = key_every ? key_every : PREC_KEY_EVERY;
+    r->hdr->capacity   = cap;
+    r->hdr->t0_mono_ns = (uint64_t)clock_ns(CLOCK_MONOTONIC);
+    r->hdr->t0_real_ns = clock_ns(CLOCK_REALTIME);
+    return 0;
+}
+
+uint64_t prec_now_ns(const PlantRec* r){
+    return (uint64_t)clock_ns(CLOCK_MONOTONIC) - r->hdr->t0_mono_ns;
+}
+
+static void commit(PlantRec* r, uint64_t slots){
+    r->used += slots;
+    __atomic_store_n(&r->hdr->used, r->used, __ATOMIC_RELEASE);
+}
+
+int prec_append(PlantRec* r, uint8_t kind, uint64_t t_ns, const struct can_frame* f,
+                const PrecState* s, uint32_t aux){
+    uint64_t dt = t_ns >= r->last_t_ns ? t_ns - r->last_t_ns : 0;
+    bool key = r->used == 0 || r->since_key >= r->hdr->key_every || dt > UINT32_MAX;
+    uint64_t need = key ? 3 : 1;
+    if (r->used + need > r->hdr->capacity) { r->hdr->dropped++; return -1; }
+
+    double x[5], rc[5];
+    memcpy(x, s, sizeof(x));
+    if (key) {
+        PrecKey k;
+        memset(&k, 0, sizeof(k));
+        k.kind = PREC_KEY;
+        k.t_ns = t_ns;
+        memcpy(k.s, x, sizeof(x));
+        memcpy(&r->slots[r->used], &k, sizeof(k));
+        r->recon = *s;
+        r->since_key = 0;
+        dt = 0;
+        commit(r, 2);
+    }
+
+    PrecSlot e;
+    memset(&e, 0, sizeof(e));
+    e.dt_ns  = (uint32_t)dt;
+    e.kind   = kind;
+    e.len    = f->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : f->len;   // FD: true length, 8 bytes kept
+    e.can_id = (uint16_t)(f->can_id & CAN_SFF_MASK);
+    memcpy(e.data, f->data, e.len > 8 ? 8 : e.len);
+    memcpy(rc, &r->recon, sizeof(rc));
+    for (int i = 0; i < 5; i++) {
+        e.d[i] = (float)(x[i] - rc[i]);
+        rc[i] += (double)e.d[i];                  // exactly what prec_next() will do
+    }
+    memcpy(&r->recon, rc, sizeof(rc));
+    e.aux = aux;
+    memcpy(&r->slots[r->used], &e, sizeof(e));
+    r->last_t_ns = t_ns;
+    r->since_key++;
+    commit(r, 1);
+    return 0;
+}
+
+void prec_close(PlantRec* r){
+    if (!r->base) return;
+    size_t len = sizeof(PrecHeader) + r->used * sizeof(PrecSlot);
+    msync(r->base, r->map_len, MS_SYNC);
+    munmap(r->base, r->map_len);
+    if (ftruncate(r->fd, (off_t)len) < 0) perror("prec_close: ftruncate");
+    close(r->fd);
+    r->base = NULL;
+    r->fd = -1;
+}
+
+/*** -------- Reader -------- ***/
+int prec_reader_open(PrecReader* rd, const char* path){
+    memset(rd, 0, sizeof(*rd));
+    rd->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (rd->fd < 0) return -1;
+    struct stat sb;
+    if (fstat(rd->fd, &sb) < 0 || (size_t)sb.st_size < sizeof(PrecHeader)) {
+        close(rd->fd); errno = EINVAL; return -1;
+    }
+    rd->map_len = (size_t)sb.st_size;
+    rd->base = mmap(NULL, rd->map_len, PROT_READ, MAP_SHARED, rd->fd, 0);
+    if (rd->base == MAP_FAILED) { close(rd->fd); return -1; }
+    rd->hdr = (const PrecHeader*)rd->base;
+
+    uint64_t fit = (rd->map_len - sizeof(PrecHeader)) / sizeof(PrecSlot);
+    if (rd->hdr->magic != PREC_MAGIC || rd->hdr->version != PREC_VERSION ||
+        rd->hdr->slot_size != sizeof(PrecSlot)) {
+        prec_reader_close(rd); errno = EINVAL; return -1;
+    }
+    rd->end = __atomic_load_n(&rd->hdr->used, __ATOMIC_ACQUIRE);
+    if (rd->end > fit) rd->end = fit;
+    return 0;
+}
+
+int prec_next(PrecReader* rd, PrecEvent* ev){
+    const PrecSlot* slots = (const PrecSlot*)(rd->base + sizeof(PrecHeader));
+    for (;;) {
+        if (rd->pos >= rd->end) return 0;
+        PrecSlot e;
+        memcpy(&e, &slots[rd->pos], sizeof(e));
+
+        if (e.kind == PREC_KEY) {
+            if (rd->pos + 2 > rd->end) return -1;
+            PrecKey k;
+            memcpy(&k, &slots[rd->pos], sizeof(k));
+            rd->t_ns = k.t_ns;
+            memcpy(&rd->s, k.s, sizeof(rd->s));
+            rd->have_key = true;
+            rd->pos += 2;
+            continue;
+        }
+        if (!rd->have_key || (e.kind != PREC_RX_CMD && e.kind != PREC_TX_FB) || e.len > CANFD_MAX_DLEN)
+            return -1;
+
+        double x[5];
+        memcpy(x, &rd->s, sizeof(x));
+        for (int i = 0; i < 5; i++) x[i] += (double)e.d[i];
+        memcpy(&rd->s, x, sizeof(x));
+        rd->t_ns += e.dt_ns;
+        rd->pos++;
+
+        memset(ev, 0, sizeof(*ev));
+        ev->t_ns = rd->t_ns;
+        ev->kind = e.kind;
+        ev->aux  = e.aux;
+        ev->f.can_id = e.can_id;
+        ev->f.len    = e.len;
+        memcpy(ev->f.data, e.data, e.len > 8 ? 8 : e.len);
+        ev->s = rd->s;
+        return 1;
+    }
+}
+
+void prec_reader_close(PrecReader* rd){
+    if (rd->base && rd->base != MAP_FAILED) munmap((void*)rd->base, rd->map_len);
+    if (rd->fd >= 0) close(rd->fd);
+    rd->base = NULL;
+    rd->fd = -1;
+}
+
+long prec_export_csv(const char* path, FILE* out){
+    PrecReader rd;
+    if (prec_reader_open(&rd, path) < 0) return -1;
+    fprintf(out, "t_s,wall_s,dir,id,dlc,data,omega_cmd,v_cmd,dt_step_s,Ts,Th,Tc,mdot,v_prev\n");
+    PrecEvent ev;
+    long rows = 0;
+    int rc;
+    while ((rc = prec_next(&rd, &ev)) == 1) {
+        double t = (double)ev.t_ns * 1e-9;
+        fprintf(out, "%.9f,%.6f,%s,0x%03X,%u,", t, (double)rd.hdr->t0_real_ns * 1e-9 + t,
+                ev.kind == PREC_RX_CMD ? "rx" : "tx", (unsigned)ev.f.can_id, (unsigned)ev.f.len);
+        for (int i = 0; i < ev.f.len && i < 8; i++) fprintf(out, "%02X", ev.f.data[i]);
+        if (ev.kind == PREC_RX_CMD && ev.f.len == CTRL_FD_CMD_LEN)   // CAN FD: Q16.16 rpm
+            fprintf(out, ",%.17g,%.17g,", le_to_u32(&ev.f.data[0]) / 65536.0, le_to_u32(&ev.f.data[4]) / 65536.0);
+        else if (ev.kind == PREC_RX_CMD && ev.f.len >= 4)
+            fprintf(out, ",%u,%u,", (unsigned)(ev.f.data[0] | (ev.f.data[1] << 8)),
+                    (unsigned)(ev.f.data[2] | (ev.f.data[3] << 8)));
+        else
+            fprintf(out, ",,,");
+        if (ev.kind == PREC_TX_FB) fprintf(out, "%.9f", (double)(ev.aux & ~PREC_AUX_CATCHUP) * 1e-9);
+        fprintf(out, ",%.17g,%.17g,%.17g,%.17g,%.17g\n",
+                ev.s.Ts, ev.s.Th, ev.s.Tc, ev.s.mdot, ev.s.v_prev);
+        rows++;
+    }
+    prec_reader_close(&rd);
+    if (rc < 0) { errno = EINVAL; return -1; }
+    return rows;
+}
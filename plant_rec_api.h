@@ -0,0 +1,100 @@
+/* plant_rec_api.h */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <linux/can.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PREC_MAGIC     0x43524C50u   /* "PLRC" */
+#define PREC_VERSION   1u
+#define PREC_KEY_EVERY 4096u         /* default keyframe interval (records) */
+
+enum { PREC_RX_CMD = 1, PREC_TX_FB = 2, PREC_KEY = 3 };
+/* PREC_TX_FB aux flag: a catch-up step of the same --rt wakeup as the previous TX, run with the
+ * command and default v of that wakeup's first step (steps are at most 255 ms, so bit 31 is free) */
+#define PREC_AUX_CATCHUP 0x80000000u
+
+/* Full-precision plant state; same layout as Plant in plant_user.c */
+typedef struct { double Ts, Th, Tc, mdot, v_prev; } PrecState;
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t slot_size, key_every;
+    uint64_t capacity;          /* slots after the header */
+    uint64_t used;              /* slots committed; a reader never looks past this */
+    uint64_t dropped;           /* records refused because the file was full */
+    uint64_t t0_mono_ns;        /* CLOCK_MONOTONIC at open (timestamps are relative to it) */
+    int64_t  t0_real_ns;        /* CLOCK_REALTIME at open, for wall-clock export */
+    uint8_t  pad[8];
+} PrecHeader;                   /* 64 bytes */
+
+/* One frame event: 40 bytes. State fields are float deltas against the state a reader
+ * reconstructs, so rounding never accumulates; PREC_KEY slots carry exact doubles. */
+typedef struct {
+    uint32_t dt_ns;             /* since the previous record */
+    uint8_t  kind, len;         /* len: frame length, up to 64 for CAN FD */
+    uint16_t can_id;
+    uint8_t  data[8];           /* first 8 payload bytes */
+    float    d[5];              /* Ts, Th, Tc, mdot, v_prev */
+    uint32_t aux;               /* PREC_TX_FB: integration step in ns | PREC_AUX_CATCHUP */
+} PrecSlot;
+
+/* PREC_KEY: absolute time and exact state, two slots long */
+typedef struct {
+    uint32_t dt_ns;
+    uint8_t  kind, pad0[3];
+    uint64_t t_ns;              /* since t0_mono_ns */
+    double   s[5];
+    uint8_t  pad1[24];
+} PrecKey;                      /* 80 bytes = 2 slots */
+
+typedef struct {
+    int         fd;
+    uint8_t*    base;
+    size_t      map_len;
+    PrecHeader* hdr;
+    PrecSlot*   slots;
+    uint64_t    used, last_t_ns, since_key;
+    PrecState   recon;          /* what a reader will have reconstructed so far */
+} PlantRec;
+
+typedef struct {
+    uint64_t  t_ns;             /* since t0_mono_ns */
+    uint8_t   kind;             /* PREC_RX_CMD or PREC_TX_FB */
+    uint32_t  aux;
+    struct can_frame f;         /* f.len may exceed 8 (CAN FD); f.data holds the first 8 bytes */
+    PrecState s;
+} PrecEvent;
+
+typedef struct {
+    int               fd;
+    const uint8_t*    base;
+    size_t            map_len;
+    const PrecHeader* hdr;
+    uint64_t          pos, end, t_ns;
+    PrecState         s;
+    bool              have_key;
+} PrecReader;
+
+/* Writer: preallocates bytes (rounded down to whole slots) and maps them shared */
+int  prec_open(PlantRec* r, const char* path, size_t bytes, unsigned key_every);  /* 0 / -1 */
+uint64_t prec_now_ns(const PlantRec* r);   /* CLOCK_MONOTONIC relative to t0 */
+/* Append one event; -1 if the file is full (counted in hdr->dropped) */
+int  prec_append(PlantRec* r, uint8_t kind, uint64_t t_ns, const struct can_frame* f,
+                 const PrecState* s, uint32_t aux);
+void prec_close(PlantRec* r);              /* msync + truncate to the used length */
+
+/* Reader: events in order, state reconstructed from keyframes + deltas */
+int  prec_reader_open(PrecReader* rd, const char* path);   /* 0 / -1 (errno, EINVAL on bad header) */
+int  prec_next(PrecReader* rd, PrecEvent* ev);              /* 1 event, 0 end, -1 corrupt */
+void prec_reader_close(PrecReader* rd);
+long prec_export_csv(const char* path, FILE* out);         /* rows written or -1 */
+
+#ifdef __cplusplus
+}
+#endif
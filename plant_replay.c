@@ -0,0 +1,398 @@
+// plant_replay.c — Deterministic, socket-free replay of recorded 0x201 streams through the plant model
+// Build:  gcc -O2 -Wall -DUNIT_TEST -c plant_user.c        (plant model as a library, no main)
+//         gcc -O2 -Wall -o plant_replay plant_replay.c plant_user.o plant_rec.c -lm
+// Run:    ./plant_replay flight.rec --traj replay.csv --frames replay.log
+//         ./plant_replay candump-2024-01-01.log --mdot 0.25 --hold
+//
+// Input is a plant_user --rec file or a `candump -L` log. Each recorded 0x202 is one plant step
+// with its recorded dt; each 0x201 is a command. By default a command drives only the next
+// wakeup and the plant falls back to omega=0, v=v_prev afterwards, exactly like plant_user's
+// loop; --hold keeps the last command instead. A .rec marks the catch-up steps of an overrun
+// --rt wakeup, which keep that wakeup's inputs; a candump log cannot, so each 0x202 there is
+// its own wakeup. No clocks, sockets or threads are involved, so the
+// output is bit-identical run to run; the printed FNV-1a hash makes build-to-build diffs cheap.
+// From a .rec file the recorded state after every step is compared with the replayed one.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <linux/can.h>
+
+#include "plant_user_api.h"
+#include "plant_rec_api.h"
+
+#ifdef UNIT_TEST
+  #define EXPOSE /* external linkage in tests */
+#else
+  #define EXPOSE static
+#endif
+
+/*** -------- Event stream -------- ***/
+typedef enum { RP_CMD, RP_STEP } ReplayKind;
+
+typedef struct {
+    uint64_t   t_ns;
+    ReplayKind kind;
+    double     omega_cmd, v_cmd;
+    double     dt;
+    bool       catchup;
+    bool       has_ref;
+    Plant      ref;
+} ReplayEvent;
+
+typedef struct {
+    ReplayEvent* ev;
+    size_t       n, cap;
+    Plant        init;
+    bool         have_init;
+} ReplayStream;
+
+static int push(ReplayStream* rs, const ReplayEvent* e){
+    if (rs->n == rs->cap) {
+        size_t cap = rs->cap ? rs->cap * 2 : 4096;
+        ReplayEvent* p = realloc(rs->ev, cap * sizeof(*p));
+        if (!p) return -1;
+        rs->ev = p; rs->cap = cap;
+    }
+    rs->ev[rs->n++] = *e;
+    return 0;
+}
+
+EXPOSE void replay_free(ReplayStream* rs){
+    free(rs->ev);
+    memset(rs, 0, sizeof(*rs));
+}
+
+static int hexval(char c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+EXPOSE int replay_parse_candump_line(const char* line, uint64_t* t_ns, struct canfd_frame* f){
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '\n' || *line == '#') return 0;
+
+    unsigned long long sec = 0, usec = 0;
+    char ifname[32], body[128];
+    if (sscanf(line, "(%llu.%llu) %31s %127s", &sec, &usec, ifname, body) != 4) return -1;
+
+    char* hash = strchr(body, '#');
+    if (!hash) return -1;
+    size_t idlen = (size_t)(hash - body);
+    if (idlen != 3) return 0;                              // 29-bit IDs are not ours
+    if (hash[1] == 'R' || hash[1] == 'r') return 0;       // remote
+
+    uint32_t id = 0;
+    for (size_t i = 0; i < idlen; i++) {
+        int v = hexval(body[i]);
+        if (v < 0) return -1;
+        id = (id << 4) | (uint32_t)v;
+    }
+    memset(f, 0, sizeof(*f));
+    f->can_id = id;
+    const char* d = hash + 1;
+    size_t max = CAN_MAX_DLEN;
+    if (d[0] == '#') {                                     // CAN FD: "##<flags nibble><data>"
+        int fl = hexval(d[1]);
+        if (fl < 0) return -1;
+        f->flags = (uint8_t)(fl | CANFD_FDF);
+        max = CANFD_MAX_DLEN;
+        d += 2;
+    }
+    while (d[0] && d[0] != '\n') {
+        if (d[0] == '.') { d++; continue; }             // candump's optional byte separators
+        int hi = hexval(d[0]), lo = d[1] ? hexval(d[1]) : -1;
+        if (hi < 0 || lo < 0 || f->len == max) return -1;
+        f->data[f->len++] = (uint8_t)(hi << 4 | lo);
+        d += 2;
+    }
+    *t_ns = (uint64_t)sec * 1000000000ULL + (uint64_t)usec * 1000ULL;
+    return 1;
+}
+
+static double unq_temp(const uint8_t* b){ return (double)(int16_t)(b[0] | (b[1] << 8)) / 10.0; }
+static double unq16(const uint8_t* b){ return (double)le_to_s32(b) / 65536.0; }
+
+EXPOSE long replay_load_candump(ReplayStream* rs, FILE* in){
+    char line[256];
+    long lineno = 0;
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        uint64_t t;
+        struct canfd_frame f;
+        int rc = replay_parse_candump_line(line, &t, &f);
+        if (rc < 0) { fprintf(stderr, "candump line %ld: cannot parse\n", lineno); errno = EINVAL; return -1; }
+        if (rc == 0) continue;
+
+        ReplayEvent e = { .t_ns = t };
+        if (plant_unpack_cmd_fd(&f, &e.omega_cmd, &e.v_cmd)) {
+            e.kind = RP_CMD;
+        } else if (f.can_id == 0x202 && f.len == CTRL_FD_FEEDBACK_LEN) {
+            if (!rs->have_init) {
+                // FD feedback carries Q16.16 temperatures and mdot as well
+                rs->init.Ts     = unq16(&f.data[0]);
+                rs->init.Th     = unq16(&f.data[4]);
+                rs->init.Tc     = unq16(&f.data[8]);
+                rs->init.mdot   = unq16(&f.data[12]);
+                rs->init.v_prev = (double)le_to_u32(&f.data[16]) / 65536.0;
+                rs->have_init = true;
+                continue;
+            }
+            uint32_t us = le_to_u32(&f.data[20]);
+            e.kind = RP_STEP;
+            e.dt   = (us ? us : 1) * 1e-6;
+        } else if (f.can_id == 0x202 && f.len == 8) {
+            if (!rs->have_init) {
+                // the first feedback is where we start; mdot is not on the bus
+                rs->init.Ts = unq_temp(&f.data[0]);
+                rs->init.Th = unq_temp(&f.data[2]);
+                rs->init.Tc = unq_temp(&f.data[4]);
+                rs->init.v_prev = f.data[6] * 10.0;
+                rs->have_init = true;
+                continue;
+            }
+            e.kind = RP_STEP;
+            e.dt   = (f.data[7] ? f.data[7] : 1) * 1e-3;
+        } else {
+            continue;
+        }
+        if (push(rs, &e) < 0) return -1;
+    }
+    return (long)rs->n;
+}
+
+static Plant from_prec(const PrecState* p){
+    Plant s = { .Ts = p->Ts, .Th = p->Th, .Tc = p->Tc, .mdot = p->mdot, .v_prev = p->v_prev };
+    return s;
+}
+
+EXPOSE long replay_load_rec(ReplayStream* rs, const char* path){
+    PrecReader rd;
+    if (prec_reader_open(&rd, path) < 0) return -1;
+    PrecEvent pe;
+    int rc;
+    while ((rc = prec_next(&rd, &pe)) == 1) {
+        if (!rs->have_init) {
+            // An RX record holds the state the step will start from; a TX record is already
+            // past its step, so it only provides the starting point
+            rs->init = from_prec(&pe.s);
+            rs->have_init = true;
+            if (pe.kind == PREC_TX_FB) continue;
+        }
+        ReplayEvent e = { .t_ns = pe.t_ns };
+        if (pe.kind == PREC_RX_CMD) {
+            if (!plant_unpack_cmd(&pe.f, &e.omega_cmd, &e.v_cmd)) continue;
+            e.kind = RP_CMD;
+        } else {
+            e.kind    = RP_STEP;
+            uint32_t step_ns = pe.aux & ~PREC_AUX_CATCHUP;
+            e.dt      = step_ns ? (double)step_ns * 1e-9 : (pe.f.data[7] ? pe.f.data[7] : 1) * 1e-3;
+            e.catchup = (pe.aux & PREC_AUX_CATCHUP) != 0;
+            e.has_ref = true;
+            e.ref     = from_prec(&pe.s);
+        }
+        if (push(rs, &e) < 0) { prec_reader_close(&rd); return -1; }
+    }
+    prec_reader_close(&rd);
+    if (rc < 0) { errno = EINVAL; return -1; }
+    return (long)rs->n;
+}
+
+/*** -------- Replay -------- ***/
+typedef enum { REPLAY_HEUN, REPLAY_RK45, REPLAY_ROS2 } ReplayIntegrator;
+
+typedef struct {
+    ReplayIntegrator integrator;
+    double rtol;
+    bool   hold;
+    FILE*  frames;
+    FILE*  traj;
+} ReplayConfig;
+
+typedef struct {
+    uint64_t steps, cmds;
+    uint64_t hash;
+    uint64_t ref_steps;
+    double   max_dev[5];
+} ReplayResult;
+
+static uint64_t fnv1a(uint64_t h, const void* p, size_t n){
+    const uint8_t* b = p;
+    for (size_t i = 0; i < n; i++) { h ^= b[i]; h *= 0x100000001b3ULL; }
+    return h;
+}
+
+EXPOSE int replay_run(const ReplayStream* rs, const ReplayConfig* cfg, Plant* s, ReplayResult* res){
+    memset(res, 0, sizeof(*res));
+    res->hash = 0xcbf29ce484222325ULL;
+
+    PlantAdaptive integ;
+    plant_adaptive_init(&integ, cfg->rtol > 0.0 ? cfg->rtol : 1e-5);
+
+    double cmd_om = 0.0, cmd_v = s->v_prev;
+    double om = 0.0, v = s->v_prev;               // inputs of the current wakeup
+    bool pending = false, have_cmd = false;
+    double t = 0.0;
+    struct can_frame tx;
+
+    if (cfg->traj) fprintf(cfg->traj, "t,dt,omega_cmd,v_cmd,Ts,Th,Tc,mdot,v_prev\n");
+
+    for (size_t i = 0; i < rs->n; i++) {
+        const ReplayEvent* e = &rs->ev[i];
+        if (e->kind == RP_CMD) {
+            cmd_om = e->omega_cmd; cmd_v = e->v_cmd;
+            pending = have_cmd = true;
+            res->cmds++;
+            continue;
+        }
+
+        // Catch-up steps of an --rt wakeup reuse its first step's inputs, like plant_user does
+        if (!e->catchup) {
+            om = 0.0; v = s->v_prev;              // plant_user's default when nothing arrived
+            if (pending || (cfg->hold && have_cmd)) { om = cmd_om; v = cmd_v; }
+            pending = false;
+        }
+
+        switch (cfg->integrator) {
+        case REPLAY_RK45: plant_step_adaptive(s, om, v, e->dt, &integ); break;
+        case REPLAY_ROS2: plant_step_rosenbrock(s, om, v, e->dt);       break;
+        default:          plant_step(s, om, v, e->dt);                  break;
+        }
+        t += e->dt;
+        res->steps++;
+
+        plant_pack_feedback(s, e->dt, &tx);
+        res->hash = fnv1a(res->hash, s, sizeof(*s));
+        res->hash = fnv1a(res->hash, tx.data, 8);
+
+        if (e->has_ref) {
+            const double got[5] = { s->Ts, s->Th, s->Tc, s->mdot, s->v_prev };
+            const double ref[5] = { e->ref.Ts, e->ref.Th, e->ref.Tc, e->ref.mdot, e->ref.v_prev };
+            for (int k = 0; k < 5; k++)
+                res->max_dev[k] = fmax(res->max_dev[k], fabs(got[k] - ref[k]));
+            res->ref_steps++;
+        }
+        if (cfg->frames) {
+            // candump -L on a virtual "replay" interface, timestamps = simulated time
+            uint64_t us = (uint64_t)llround(t * 1e6);
+            fprintf(cfg->frames, "(%llu.%06llu) replay 202#", (unsigned long long)(us / 1000000),
+                    (unsigned long long)(us % 1000000));
+            for (int k = 0; k < 8; k++) fprintf(cfg->frames, "%02X", tx.data[k]);
+            fputc('\n', cfg->frames);
+        }
+        if (cfg->traj)
+            fprintf(cfg->traj, "%.9f,%.9g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+                    t, e->dt, om, v, s->Ts, s->Th, s->Tc, s->mdot, s->v_prev);
+    }
+    return 0;
+}
+
+/*** -------- Main -------- ***/
+#ifndef UNIT_TEST
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s <file.rec | candump.log> [options]\n"
+        "  --frames <file>    replayed 0x202 frames, candump -L format (simulated time)\n"
+        "  --traj <file.csv>  one row per step: t,dt,omega_cmd,v_cmd,Ts,Th,Tc,mdot,v_prev\n"
+        "  --hold             hold the last 0x201 (default: one step, then omega=0, v=v_prev)\n"
+        "  --integrator <heun|rk45|ros2> [--rtol r]   must match the recorded run\n"
+        "  --fast_math        table-driven mu_water/UA_func (must match the recorded run)\n"
+        "  --Ts/--Th/--Tc <°C> --mdot <kg/s> --v_prev <rpm>  override the initial state\n"
+        "                     (candump logs carry no mdot; default 0.18)\n",
+        prog);
+}
+
+int main(int argc, char** argv){
+    ReplayConfig cfg = { .integrator = REPLAY_HEUN, .rtol = 1e-5 };
+    const char* in_path = NULL;
+    const char* frames_path = NULL;
+    const char* traj_path = NULL;
+    double init[5];
+    bool   init_set[5] = { false };
+    static const char* init_opt[5] = { "--Ts", "--Th", "--Tc", "--mdot", "--v_prev" };
+    double mdot_default = 0.18;
+
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--fast_math") == 0){ plant_set_fast_math(1); continue; }
+        if (strcmp(argv[i], "--hold") == 0)     { cfg.hold = true; continue; }
+        if (argv[i][0] != '-' && !in_path)      { in_path = argv[i]; continue; }
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 || i + 1 >= argc){
+            usage(argv[0]);
+            return 1;
+        }
+        const char* v = argv[++i];
+        const char* opt = argv[i-1];
+        if      (strcmp(opt, "--frames") == 0) frames_path = v;
+        else if (strcmp(opt, "--traj")   == 0) traj_path   = v;
+        else if (strcmp(opt, "--rtol")   == 0) cfg.rtol    = parse_or(v, cfg.rtol);
+        else if (strcmp(opt, "--integrator") == 0) {
+            if      (strcmp(v, "rk45") == 0) cfg.integrator = REPLAY_RK45;
+            else if (strcmp(v, "ros2") == 0) cfg.integrator = REPLAY_ROS2;
+            else if (strcmp(v, "heun") == 0) cfg.integrator = REPLAY_HEUN;
+            else { fprintf(stderr, "bad --integrator '%s'\n", v); usage(argv[0]); return 1; }
+        }
+        else for (int k = 0; k < 5; k++)
+            if (strcmp(opt, init_opt[k]) == 0) { init[k] = parse_or(v, 0.0); init_set[k] = true; }
+    }
+    if (!in_path){ fprintf(stderr, "%s: no input file\n", argv[0]); return 1; }
+
+    // A .rec file starts with the recorder magic; anything else is treated as candump text
+    ReplayStream rs = { 0 };
+    long n;
+    FILE* in = fopen(in_path, "r");
+    if (!in){ perror(in_path); return 1; }
+    uint32_t magic = 0;
+    bool is_rec = fread(&magic, sizeof(magic), 1, in) == 1 && magic == PREC_MAGIC;
+    if (is_rec) {
+        fclose(in);
+        n = replay_load_rec(&rs, in_path);
+    } else {
+        rewind(in);
+        rs.init.mdot = mdot_default;
+        n = replay_load_candump(&rs, in);
+        fclose(in);
+    }
+    if (n < 0){ perror(in_path); return 1; }
+
+    Plant st = rs.init;
+    double* f[5] = { &st.Ts, &st.Th, &st.Tc, &st.mdot, &st.v_prev };
+    for (int k = 0; k < 5; k++) if (init_set[k]) *f[k] = init[k];
+    if (!rs.have_init && !(init_set[0] && init_set[1] && init_set[2]))
+        fprintf(stderr, "[Replay] warning: no 0x202 in the log, initial state is all defaults\n");
+
+    if (frames_path && !(cfg.frames = fopen(frames_path, "w"))){ perror(frames_path); return 1; }
+    if (traj_path   && !(cfg.traj   = fopen(traj_path, "w")))  { perror(traj_path);   return 1; }
+    if (cfg.frames) setvbuf(cfg.frames, NULL, _IOFBF, 1 << 20);
+    if (cfg.traj)   setvbuf(cfg.traj,   NULL, _IOFBF, 1 << 20);
+
+    ReplayResult res;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    replay_run(&rs, &cfg, &st, &res);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = (double)(t1.tv_sec - t0.tv_sec) + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+
+    if (cfg.frames) fclose(cfg.frames);
+    if (cfg.traj)   fclose(cfg.traj);
+
+    printf("[Replay] %s: %llu steps, %llu commands in %.3f s (%.2f M steps/s)\n",
+           is_rec ? "rec" : "candump", (unsigned long long)res.steps,
+           (unsigned long long)res.cmds, wall, wall > 0 ? (double)res.steps / wall * 1e-6 : 0.0);
+    printf("[Replay] final Ts=%.6f Th=%.6f Tc=%.6f mdot=%.6f v=%.0f  hash=%016llx\n",
+           st.Ts, st.Th, st.Tc, st.mdot, st.v_prev, (unsigned long long)res.hash);
+    if (res.ref_steps)
+        printf("[Replay] vs recording (%llu steps): max |dTs|=%.3g |dTh|=%.3g |dTc|=%.3g |dmdot|=%.3g |dv|=%.3g\n",
+               (unsigned long long)res.ref_steps, res.max_dev[0], res.max_dev[1], res.max_dev[2],
+               res.max_dev[3], res.max_dev[4]);
+    replay_free(&rs);
+    return 0;
+}
+#endif
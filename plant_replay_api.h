@@ -0,0 +1,67 @@
+/* plant_replay_api.h */
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <linux/can.h>
+#include "plant_user_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Must match the definitions in plant_replay.c */
+typedef enum { RP_CMD, RP_STEP } ReplayKind;
+
+typedef struct {
+    uint64_t   t_ns;            /* as recorded (informational; replay runs on dt only) */
+    ReplayKind kind;
+    double     omega_cmd, v_cmd;   /* RP_CMD */
+    double     dt;                 /* RP_STEP, s */
+    bool       catchup;            /* RP_STEP: later step of the previous step's --rt wakeup */
+    bool       has_ref;            /* RP_STEP from a .rec: recorded state after the step */
+    Plant      ref;
+} ReplayEvent;
+
+typedef struct {
+    ReplayEvent* ev;
+    size_t       n, cap;
+    Plant        init;          /* state before the first event */
+    bool         have_init;
+} ReplayStream;
+
+typedef enum { REPLAY_HEUN, REPLAY_RK45, REPLAY_ROS2 } ReplayIntegrator;
+
+typedef struct {
+    ReplayIntegrator integrator;
+    double rtol;                /* rk45 */
+    bool   hold;                /* hold the last command; default = plant_user (one step) */
+    FILE*  frames;              /* optional: 0x202 frames, candump -L format */
+    FILE*  traj;                /* optional: CSV, one row per step, %.17g */
+} ReplayConfig;
+
+typedef struct {
+    uint64_t steps, cmds;
+    uint64_t hash;              /* FNV-1a over every post-step state and 0x202 payload */
+    uint64_t ref_steps;         /* steps that had a recorded state to compare against */
+    double   max_dev[5];        /* max |replayed - recorded| for Ts, Th, Tc, mdot, v_prev */
+} ReplayResult;
+
+/* "(1700000000.123456) vcan0 201#E803B004" -> 1, FD "202##1<hex>" -> 1 with CANFD_FDF set;
+ * comments, blanks, EFF/RTR -> 0; junk -> -1 */
+int  replay_parse_candump_line(const char* line, uint64_t* t_ns, struct canfd_frame* f);
+/* 0x201 -> RP_CMD, 0x202 -> RP_STEP with dt from byte 7 (FD: dt in us); the first 0x202 seeds
+ * init (0.1 °C / 10 rpm resolution and mdot left as given; FD: Q16.16 including mdot).
+ * Returns events or -1. */
+long replay_load_candump(ReplayStream* rs, FILE* in);
+/* plant_user --rec file: exact initial state and a recorded state for every step */
+long replay_load_rec(ReplayStream* rs, const char* path);
+void replay_free(ReplayStream* rs);
+
+/* Runs from *s (normally rs->init); deterministic for a given build and flags */
+int  replay_run(const ReplayStream* rs, const ReplayConfig* cfg, Plant* s, ReplayResult* res);
+
+#ifdef __cplusplus
+}
+#endif
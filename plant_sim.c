@@ -0,0 +1,204 @@
+// plant_sim.c — Offline closed loop: plant_step() + the Node B Q16.16 controller, no CAN socket, no kernel module
+// Build:  gcc -O2 -Wall -DUNIT_TEST -c plant_user.c        (plant model as a library, no main)
+//         gcc -O2 -Wall -o plant_sim plant_sim.c plant_user.o controller/controller_core.c -lm
+// Run:    ./plant_sim --hours 8 --dt_ms 10 --period_ms 10 --Ts_sp 30 --out traj.csv --every 100
+//
+// Every plant step is one 0x202 frame into the controller (which runs controller_step() on it,
+// like nodeb_rx_work); every period_ms a 0x201 frame goes back to the plant and is held until
+// the next one. The controller is controller/controller_core.c, the code compiled into
+// controller_kernel.ko. Frames are packed/parsed by the same code as plant_user and the module,
+// so quantisation (0.1 °C, 10 rpm, 1 ms; with --fd Q16.16 and 1 us) is part of the loop.
+// Simulated time runs as fast as the CPU allows.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <linux/can.h>
+
+#include "plant_user_api.h"
+#include "controller/controller_core.h"
+
+#ifdef UNIT_TEST
+  #define EXPOSE /* external linkage in tests */
+#else
+  #define EXPOSE static
+#endif
+
+/*** -------- Controller I/O -------- ***/
+static void ctrl_rx_can(struct ctrl_core* c, const struct can_frame* f){
+    ctrl_rx_frame(c, f->can_id & CAN_SFF_MASK, f->data, f->len);
+}
+
+static void ctrl_tx_can(const struct ctrl_core* c, struct can_frame* f){
+    memset(f, 0, sizeof(*f));
+    f->can_id = 0x201; f->len = 8;
+    ctrl_tx_payload(c, f->data);
+}
+
+static void ctrl_tx_canfd(const struct ctrl_core* c, struct canfd_frame* f){
+    memset(f, 0, sizeof(*f));
+    f->can_id = 0x201;
+    f->len = ctrl_tx_payload_fd(c, f->data);
+}
+
+/*** -------- Closed loop -------- ***/
+typedef struct {
+    double iae, ise;
+    double overshoot;
+    double effort;
+} SimMetrics;
+
+typedef struct {
+    double   dt;
+    unsigned tx_every;
+    uint64_t steps;
+    unsigned log_every;
+    FILE*    out;
+    SimMetrics* metrics;
+    bool     fd;
+} SimConfig;
+
+EXPOSE uint64_t sim_run(const SimConfig* cfg, Plant* s, struct ctrl_core* c){
+    double omega_cmd = 0.0, v_cmd = s->v_prev;   // nothing sent until the first 0x201
+    unsigned tx_every = cfg->tx_every ? cfg->tx_every : 1;
+    unsigned tx_phase = 0, log_phase = 0;
+    uint64_t n_tx = 0;
+    struct can_frame f;
+    struct canfd_frame ff;
+
+    SimMetrics* m = cfg->metrics;
+    double sp = 0.0, dir = 1.0, w_om = 0.0, w_v = 0.0;
+    if (m){
+        memset(m, 0, sizeof(*m));
+        sp  = (double)c->cfg.Ts_sp / 65536.0;
+        dir = s->Ts >= sp ? 1.0 : -1.0;          // overshoot = crossing to the far side
+        w_om = 1.0 / (double)c->cfg.omega_max_rpm;
+        w_v  = 1.0 / (double)c->cfg.v_max_rpm;
+    }
+
+    for (uint64_t k = 0; k < cfg->steps; k++){
+        plant_step(s, omega_cmd, v_cmd, cfg->dt);
+
+        if (cfg->fd){
+            plant_pack_feedback_fd(s, cfg->dt, &ff);
+            ctrl_rx_frame(c, ff.can_id & CAN_SFF_MASK, ff.data, ff.len);
+        } else {
+            plant_pack_feedback(s, cfg->dt, &f);
+            ctrl_rx_can(c, &f);
+        }
+
+        if (++tx_phase == tx_every){
+            tx_phase = 0;
+            if (cfg->fd){
+                ctrl_tx_canfd(c, &ff);
+                if (plant_unpack_cmd_fd(&ff, &omega_cmd, &v_cmd)) n_tx++;
+            } else {
+                ctrl_tx_can(c, &f);
+                if (plant_unpack_cmd(&f, &omega_cmd, &v_cmd)) n_tx++;
+            }
+        }
+
+        if (m){
+            double e = sp - s->Ts;
+            m->iae += fabs(e) * cfg->dt;
+            m->ise += e * e * cfg->dt;
+            if (e * dir > m->overshoot) m->overshoot = e * dir;
+            m->effort += (omega_cmd * w_om) * (omega_cmd * w_om) + (v_cmd * w_v) * (v_cmd * w_v);
+        }
+
+        if (cfg->out && cfg->log_every && ++log_phase == cfg->log_every){
+            log_phase = 0;
+            fprintf(cfg->out, "%.3f,%.3f,%.3f,%.3f,%.5f,%.0f,%.0f,%.0f\n",
+                    (double)(k + 1) * cfg->dt, s->Ts, s->Th, s->Tc, s->mdot, s->v_prev,
+                    omega_cmd, v_cmd);
+        }
+    }
+    if (m && cfg->steps) m->effort /= (double)cfg->steps;
+    return n_tx;
+}
+
+/*** -------- Main -------- ***/
+#ifndef UNIT_TEST
+int main(int argc, char** argv){
+    double hours = 1.0, dt_ms = 10.0, period_ms = 10.0;
+    double Ts_sp = 25.0;
+    unsigned every = 100;
+    bool fd = false;
+    const char* out_path = NULL;
+    Plant st = { .Ts = 155.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.18, .v_prev = 0.0 };
+
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--fast_math") == 0){ plant_set_fast_math(1); continue; }
+        if (strcmp(argv[i], "--fd") == 0){ fd = true; continue; }
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 || i + 1 >= argc){
+            fprintf(stderr,
+                "Usage: %s [options]\n"
+                "  --hours <h>        simulated time (default 1)\n"
+                "  --dt_ms <ms>       plant step / 0x202 period, 1..255 (default 10)\n"
+                "  --period_ms <ms>   0x201 period, rounded to a multiple of dt_ms (default 10)\n"
+                "  --Ts_sp <°C>       setpoint, delivered as a 0x301 frame (default 25)\n"
+                "  --Ts/--Th/--Tc <°C> --mdot <kg/s> --v_prev <rpm>  initial plant state\n"
+                "  --out <file.csv>   trajectory: t,Ts,Th,Tc,mdot,v_prev,omega_cmd,v_cmd\n"
+                "  --every <N>        write every Nth step (default 100)\n"
+                "  --fast_math        table-driven mu_water/UA_func\n"
+                "  --fd               CAN FD frames: Q16.16 feedback/commands, dt in us\n",
+                argv[0]);
+            return 1;
+        }
+        const char* v = argv[++i];
+        if      (strcmp(argv[i-1], "--hours")     == 0) hours     = parse_or(v, hours);
+        else if (strcmp(argv[i-1], "--dt_ms")     == 0) dt_ms     = parse_or(v, dt_ms);
+        else if (strcmp(argv[i-1], "--period_ms") == 0) period_ms = parse_or(v, period_ms);
+        else if (strcmp(argv[i-1], "--Ts_sp")     == 0) Ts_sp     = parse_or(v, Ts_sp);
+        else if (strcmp(argv[i-1], "--Ts")        == 0) st.Ts     = parse_or(v, st.Ts);
+        else if (strcmp(argv[i-1], "--Th")        == 0) st.Th     = parse_or(v, st.Th);
+        else if (strcmp(argv[i-1], "--Tc")        == 0) st.Tc     = parse_or(v, st.Tc);
+        else if (strcmp(argv[i-1], "--mdot")      == 0) st.mdot   = parse_or(v, st.mdot);
+        else if (strcmp(argv[i-1], "--v_prev")    == 0) st.v_prev = parse_or(v, st.v_prev);
+        else if (strcmp(argv[i-1], "--every")     == 0) every     = (unsigned)parse_or(v, every);
+        else if (strcmp(argv[i-1], "--out")       == 0) out_path  = v;
+    }
+    dt_ms = round(sat(dt_ms, 1.0, 255.0));
+
+    SimConfig cfg = {
+        .dt        = dt_ms * 1e-3,
+        .tx_every  = (unsigned)fmax(1.0, round(period_ms / dt_ms)),
+        .steps     = (uint64_t)llround(hours * 3600.0 / (dt_ms * 1e-3)),
+        .log_every = every,
+        .fd        = fd,
+    };
+
+    if (out_path){
+        cfg.out = fopen(out_path, "w");
+        if (!cfg.out){ perror(out_path); return 1; }
+        setvbuf(cfg.out, NULL, _IOFBF, 1 << 20);
+        fprintf(cfg.out, "t,Ts,Th,Tc,mdot,v_prev,omega_cmd,v_cmd\n");
+    }
+
+    struct ctrl_core ctrl;
+    ctrl_reset(&ctrl);
+    struct can_frame sp = { .can_id = 0x301, .len = 2 };
+    le_from_u16(&sp.data[0], &sp.data[1], (uint16_t)pack_temp_q10(Ts_sp));
+    ctrl_rx_can(&ctrl, &sp);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t n_tx = sim_run(&cfg, &st, &ctrl);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = (double)(t1.tv_sec - t0.tv_sec) + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+
+    if (cfg.out) fclose(cfg.out);
+
+    printf("[Sim] %.2f h simulated in %.3f s (%.0fx real time), %llu steps, %llu 0x201 frames, %.2f M steps/s\n",
+           (double)cfg.steps * cfg.dt / 3600.0, wall, (double)cfg.steps * cfg.dt / wall,
+           (unsigned long long)cfg.steps, (unsigned long long)n_tx, (double)cfg.steps / wall * 1e-6);
+    printf("[Sim] final Ts=%.2f Th=%.2f Tc=%.2f mdot=%.4f v=%.0f | omega_cmd=%u v_cmd=%u\n",
+           st.Ts, st.Th, st.Tc, st.mdot, st.v_prev, ctrl.omega_cmd_rpm, ctrl.v_cmd_rpm);
+    return 0;
+}
+#endif
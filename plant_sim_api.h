@@ -0,0 +1,37 @@
+/* plant_sim_api.h */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <linux/can.h>
+#include "plant_user_api.h"
+#include "controller/controller_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Closed-loop figures of merit against the controller's Ts_sp */
+typedef struct {
+    double iae, ise;     /* ∫|Ts_sp - Ts| dt (°C·s), ∫(Ts_sp - Ts)² dt (°C²·s) */
+    double overshoot;    /* largest excursion past Ts_sp, away from the start side (°C) */
+    double effort;       /* mean of (omega/omega_max)² + (v/v_max)² over the commands applied */
+} SimMetrics;
+
+typedef struct {
+    double   dt;          /* plant step = 0x202 period, s */
+    unsigned tx_every;    /* 0x201 every N plant steps (period_ms / dt_ms) */
+    uint64_t steps;
+    unsigned log_every;   /* one CSV row every N steps; 0 = no trajectory */
+    FILE*    out;
+    SimMetrics* metrics;  /* optional, filled by sim_run() */
+    bool     fd;          /* CAN FD frames (Q16.16 32-byte 0x202, 12-byte 0x201) */
+} SimConfig;
+
+/* Closed loop for cfg->steps plant steps; commands are held between 0x201 frames.
+ * Returns the number of 0x201 frames delivered. */
+uint64_t sim_run(const SimConfig* cfg, Plant* s, struct ctrl_core* c);
+
+#ifdef __cplusplus
+}
+#endif
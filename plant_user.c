@@ -1,5 +1,5 @@
 // plant_user.c — Plant on C: RX (0x201) omega_cmd,v_cmd; integrate plant; TX (0x202) Ts,Th,Tc,v_prev,dt
-// Build:  gcc -O2 -Wall -o plant_user plant_user.c -lm
+// Build:  gcc -O2 -Wall -pthread -o plant_user plant_user.c plant_log.c plant_rec.c -lm
 // Run:    ./plant_user vcan0 --Ts 60 --Th 40 --Tc 20 --v_prev 1200 --dt_ms 15 --mdot 0.25
 
 #define _GNU_SOURCE
@@ -13,11 +13,21 @@
 #include <time.h>
 #include <errno.h>
 #include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
+
+#include "controller/controller_core.h"
+#include "plant_log_api.h"
+#include "plant_rec_api.h"
 
 #ifdef UNIT_TEST
   #define EXPOSE /* external linkage in tests */
@@ -92,12 +102,18 @@ static const double omega_max=4000.0, v_max=2800.0;
 // Soft-abs / square caps
 static const double SQR_CAP_OMEGA = 20000.0;
 
+// Water viscosity (Vogel form, mu = A*exp(B/(T_K - C)))
+static const double mu_A = 2.414e-5, mu_B = 247.8, mu_C = 140.0;
+
+// System heat load
+static const double P_base  = 180.0;  // W at Ts = 60 °C
+static const double P_alpha = 0.002;  // per K
+
 /*** -------- Models -------- ***/
 EXPOSE double mu_water(double T_c){ // Pa·s, viscosity vs temperature (like your Python mu())
     double T_c_clip = sat(T_c, -10.0, 120.0);
     double T_K = T_c_clip + 273.15;
-    const double A=2.414e-5, B=247.8, C=140.0;
-    return A * exp(B / (T_K - C));
+    return mu_A * exp(mu_B / (T_K - mu_C));
 }
 EXPOSE double UA_func(double v_cmd, double Tstar){
     (void)Tstar; // not used in UA but keep signature for parity
@@ -109,22 +125,66 @@ EXPOSE double UA_func(double v_cmd, double Tstar){
 }
 EXPOSE double Psys(double t, double Ts){
     (void)t;
-    double base = 180.0;            // W
-    double alpha = 0.002;           // per K
-    double p = base * (1.0 + alpha*(Ts - 60.0));
+    double p = P_base * (1.0 + P_alpha*(Ts - 60.0));
     if (p < 0.0) p = 0.0;
     if (p > 2e5) p = 2e5;
     return p;
 }
 
+/*** -------- Fast-math model path (tables) -------- ***/
+// Both model functions clamp their input, so they tabulate exactly over a
+// fixed range. Linear interpolation; max relative error vs. the libm path,
+// measured over the whole clamp range (see plant_user_test.cc):
+//   mu_water_fast : < 1e-6   (0.1 °C grid on [-10, 120])
+//   UA_func_fast  : < 5e-6   (grid uniform in v^(1/4) on [0, 600] rpm, which
+//                             keeps v^0.65 = u^2.6 smooth near v = 0)
+#define MU_TAB_N 1301
+#define UA_TAB_N 1025
+static const double mu_tab_lo = -10.0, mu_tab_h = 0.1;
+static const double ua_tab_umax = 4.949232003839765;   // 600^(1/4)
+static double mu_tab[MU_TAB_N];
+static double ua_tab[UA_TAB_N];
+static double mu60;             // mu_water(60.0), the Rh reference
+static int    fast_math = 0;
+
+__attribute__((constructor))
+static void model_tables_init(void){
+    mu60 = mu_water(60.0);
+    for (int i = 0; i < MU_TAB_N; i++)
+        mu_tab[i] = mu_water(mu_tab_lo + i*mu_tab_h);
+    for (int i = 0; i < UA_TAB_N; i++){
+        double u = ua_tab_umax * i / (UA_TAB_N - 1);
+        ua_tab[i] = UA_func((u*u)*(u*u), 0.0);
+    }
+}
+
+EXPOSE double mu_water_fast(double T_c){
+    double x = (sat(T_c, -10.0, 120.0) - mu_tab_lo) / mu_tab_h;
+    int i = (int)x;
+    if (i > MU_TAB_N - 2) i = MU_TAB_N - 2;
+    double f = x - i;
+    return mu_tab[i] + f*(mu_tab[i+1] - mu_tab[i]);
+}
+EXPOSE double UA_func_fast(double v_cmd, double Tstar){
+    (void)Tstar;
+    double x = sqrt(sqrt(sat(v_cmd, 0.0, 600.0))) * ((UA_TAB_N - 1) / ua_tab_umax);
+    int i = (int)x;
+    if (i > UA_TAB_N - 2) i = UA_TAB_N - 2;
+    double f = x - i;
+    return ua_tab[i] + f*(ua_tab[i+1] - ua_tab[i]);
+}
+
+// Runtime switch for plant_rhs(); off by default (bit-exact libm model)
+EXPOSE void plant_set_fast_math(int on){ fast_math = on ? 1 : 0; }
+
 /*** -------- Plant state and RHS -------- ***/
 typedef struct {
     double Ts, Th, Tc, mdot;
     double v_prev; // last applied v_cmd (for logging/feedback)
 } Plant;
 
-static void plant_rhs(const Plant* s, double omega_cmd_rpm, double v_cmd_rpm,
-                      double *dTs, double *dTh, double *dTc, double *dmdot)
+// Unguarded RHS: f = {dTs, dTh, dTc, dmdot}
+static void plant_rhs_raw(const Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double f[4])
 {
     // Convert omega rpm -> rad/s-equivalent for pump law: we used omega (rad/s) in Python safe_square
     // In your Python, a0 multiplies omega_cmd^2 where omega_cmd looked like "rpm" numbers;
@@ -141,23 +201,76 @@ static void plant_rhs(const Plant* s, double omega_cmd_rpm, double v_cmd_rpm,
     double q_conv = mdot * cp * (Th - Tc);          // W
 
     // System node
-    double dTs_loc = (Psys(0.0, Ts) - q_sh) / Cs;
+    f[0] = (Psys(0.0, Ts) - q_sh) / Cs;
 
     // Fluid nodes
-    double dTh_loc = ( q_sh - q_conv ) / Ch;
-    double dTc_loc = ( q_conv - UA_func(v_cmd_rpm, Tstar)*(Tc - T_amb) ) / Cr;
+    f[1] = ( q_sh - q_conv ) / Ch;
+    double UA = fast_math ? UA_func_fast(v_cmd_rpm, Tstar) : UA_func(v_cmd_rpm, Tstar);
+    f[2] = ( q_conv - UA*(Tc - T_amb) ) / Cr;
 
     // Hydraulics
     double dP_pump = a0 * safe_sq(omega_cmd_rpm, SQR_CAP_OMEGA) - b * safe_sq(mdot, 10.0);
-    double Rh = Rh0 * (mu_water(Tstar)/mu_water(60.0));
+    double mu = fast_math ? mu_water_fast(Tstar) : mu_water(Tstar);
+    double Rh = Rh0 * (mu/mu60);
     double dP_loss = Rh * mdot * softabs(mdot, 1e-9);
-    double dmdot_loc = (dP_pump - dP_loss) / Lh;
+    f[3] = (dP_pump - dP_loss) / Lh;
+}
+
+static void plant_rhs(const Plant* s, double omega_cmd_rpm, double v_cmd_rpm,
+                      double *dTs, double *dTh, double *dTc, double *dmdot)
+{
+    double f[4];
+    plant_rhs_raw(s, omega_cmd_rpm, v_cmd_rpm, f);
 
     // Guard derivatives
-    *dTs = sat(dTs_loc, -500.0,  500.0);
-    *dTh = sat(dTh_loc, -500.0,  500.0);
-    *dTc = sat(dTc_loc, -500.0,  500.0);
-    *dmdot= sat(dmdot_loc, -500.0,  50.0);
+    *dTs = sat(f[0], -500.0,  500.0);
+    *dTh = sat(f[1], -500.0,  500.0);
+    *dTc = sat(f[2], -500.0,  500.0);
+    *dmdot= sat(f[3], -500.0,  50.0);
+}
+
+// Analytic Jacobian J[i][j] = d f_i / d y_j of plant_rhs_raw, y = {Ts, Th, Tc, mdot}.
+// Inside a state clamp the clamped variable is treated as frozen.
+static void plant_jac(const Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double J[4][4])
+{
+    (void)omega_cmd_rpm;
+    double Ts = sat(s->Ts, Ts_min, Ts_max);
+    double Th = sat(s->Th, Th_min, Th_max);
+    double Tc = sat(s->Tc, Tc_min, Tc_max);
+    double mdot = sat(s->mdot, mdot_min, mdot_max);
+    double Tstar = sat(0.5*(Th + Tc), Tc_min, Th_max);
+    double UA = fast_math ? UA_func_fast(v_cmd_rpm, Tstar) : UA_func(v_cmd_rpm, Tstar);
+
+    memset(J, 0, 16 * sizeof(double));
+
+    double p = P_base * (1.0 + P_alpha*(Ts - 60.0));
+    double dP_dTs = (p > 0.0 && p < 2e5) ? P_base * P_alpha : 0.0;
+    J[0][0] = (dP_dTs - Gsh) / Cs;
+    J[0][1] = Gsh / Cs;
+
+    J[1][0] = Gsh / Ch;
+    J[1][1] = (-Gsh - mdot*cp) / Ch;
+    J[1][2] = mdot*cp / Ch;
+    J[1][3] = -cp*(Th - Tc) / Ch;
+
+    J[2][1] = mdot*cp / Cr;
+    J[2][2] = (-mdot*cp - UA) / Cr;
+    J[2][3] = cp*(Th - Tc) / Cr;
+
+    // Rh(T*) = Rh0*mu(T*)/mu60, dmu/dT = -mu*B/(T_K - C)^2 inside the viscosity clamp
+    double mu = fast_math ? mu_water_fast(Tstar) : mu_water(Tstar);
+    double Rh = Rh0 * (mu/mu60);
+    double dRh_dTstar = 0.0;
+    if (Tstar > -10.0 && Tstar < 120.0) {
+        double d = Tstar + 273.15 - mu_C;
+        dRh_dTstar = -Rh * mu_B / (d*d);
+    }
+    double sabs = softabs(mdot, 1e-9);
+    double dloss_dT = 0.5 * dRh_dTstar * mdot * sabs;
+    J[3][1] = -dloss_dT / Lh;
+    J[3][2] = -dloss_dT / Lh;
+    double dsq = (mdot < 10.0) ? 2.0*mdot : 0.0;
+    J[3][3] = -(b*dsq + Rh*(sabs + mdot*mdot/sabs)) / Lh;
 }
 
 EXPOSE void plant_step(Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double dt){
@@ -184,6 +297,447 @@ EXPOSE void plant_step(Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double
     s->v_prev = sat(v_cmd_rpm, 0.0, v_max);
 }
 
+/*** -------- Adaptive Dormand–Prince 5(4) -------- ***/
+// Steps are sized by error control alone, independent of the frame period.
+// Frames that fall inside an accepted step are served from the 4th-order
+// dense output (no RHS evaluations); a command change or an external write
+// to the Plant restarts integration at the current frame time.
+typedef struct {
+    double rtol, atol_T, atol_m;   // tolerances (relative; °C; kg/s)
+    double h, h_min, h_max;        // next internal step, carried across calls
+    unsigned long steps, rejected, rhs_evals, restarts;
+
+    // integrator state (internal)
+    bool   live;
+    double omega_cmd, v_cmd;       // commands the current step was taken with
+    double t_out;                  // time of the last frame served
+    double t0, t1;                 // current accepted step [t0, t1]
+    double y1[4], k1[4];           // state / derivative at t1 (FSAL)
+    double rc[5][4];               // dense-output coefficients over [t0, t1]
+    Plant  last;                   // what we last wrote to the caller's Plant
+} PlantAdaptive;
+
+EXPOSE void plant_adaptive_init(PlantAdaptive* a, double rtol){
+    memset(a, 0, sizeof(*a));
+    a->rtol   = rtol;
+    a->atol_T = 1e-4;
+    a->atol_m = 1e-7;
+    a->h_min  = 1e-6;
+    a->h_max  = 5.0;
+}
+
+static void rhs4(const double y[4], double omega_cmd_rpm, double v_cmd_rpm, double k[4]){
+    Plant p = { .Ts = y[0], .Th = y[1], .Tc = y[2], .mdot = y[3] };
+    plant_rhs(&p, omega_cmd_rpm, v_cmd_rpm, &k[0], &k[1], &k[2], &k[3]);
+}
+
+// One accepted step from (t1, y1); fills the dense-output coefficients.
+// Returns -1 if the step had to be forced at h_min.
+static int dopri_step(PlantAdaptive* a){
+    static const double
+        a21 = 1.0/5,
+        a31 = 3.0/40,       a32 = 9.0/40,
+        a41 = 44.0/45,      a42 = -56.0/15,      a43 = 32.0/9,
+        a51 = 19372.0/6561, a52 = -25360.0/2187, a53 = 64448.0/6561, a54 = -212.0/729,
+        a61 = 9017.0/3168,  a62 = -355.0/33,     a63 = 46732.0/5247, a64 = 49.0/176,
+        a65 = -5103.0/18656,
+        b1 = 35.0/384, b3 = 500.0/1113, b4 = 125.0/192, b5 = -2187.0/6784, b6 = 11.0/84,
+        e1 = 71.0/57600, e3 = -71.0/16695, e4 = 71.0/1920, e5 = -17253.0/339200,
+        e6 = 22.0/525, e7 = -1.0/40,
+        // Hairer's continuous extension
+        d1 = -12715105075.0/11282082432.0, d3 = 87487479700.0/32700410799.0,
+        d4 = -10690763975.0/1880347072.0,  d5 = 701980252875.0/199316789632.0,
+        d6 = -1453857185.0/822651844.0,    d7 = 69997945.0/29380423.0;
+
+    const double om = a->omega_cmd, vc = a->v_cmd;
+    const double* y = a->y1;
+    const double* k1 = a->k1;
+    double k2[4], k3[4], k4[4], k5[4], k6[4], k7[4], yt[4], yn[4];
+
+    for (;;) {
+        double h = sat(a->h, a->h_min, a->h_max);
+
+        for (int i = 0; i < 4; i++) yt[i] = y[i] + h*(a21*k1[i]);
+        rhs4(yt, om, vc, k2);
+        for (int i = 0; i < 4; i++) yt[i] = y[i] + h*(a31*k1[i] + a32*k2[i]);
+        rhs4(yt, om, vc, k3);
+        for (int i = 0; i < 4; i++) yt[i] = y[i] + h*(a41*k1[i] + a42*k2[i] + a43*k3[i]);
+        rhs4(yt, om, vc, k4);
+        for (int i = 0; i < 4; i++) yt[i] = y[i] + h*(a51*k1[i] + a52*k2[i] + a53*k3[i] + a54*k4[i]);
+        rhs4(yt, om, vc, k5);
+        for (int i = 0; i < 4; i++) yt[i] = y[i] + h*(a61*k1[i] + a62*k2[i] + a63*k3[i] + a64*k4[i] + a65*k5[i]);
+        rhs4(yt, om, vc, k6);
+        for (int i = 0; i < 4; i++) yn[i] = y[i] + h*(b1*k1[i] + b3*k3[i] + b4*k4[i] + b5*k5[i] + b6*k6[i]);
+        rhs4(yn, om, vc, k7);
+        a->rhs_evals += 6;
+
+        // RMS of the embedded error, scaled per state
+        double err = 0.0;
+        for (int i = 0; i < 4; i++) {
+            double atol = (i == 3) ? a->atol_m : a->atol_T;
+            double sc = atol + a->rtol * fmax(fabs(y[i]), fabs(yn[i]));
+            double ei = h*(e1*k1[i] + e3*k3[i] + e4*k4[i] + e5*k5[i] + e6*k6[i] + e7*k7[i]) / sc;
+            err += ei*ei;
+        }
+        err = sqrt(err / 4.0);
+        double fac = (err > 0.0) ? sat(0.9 * pow(err, -0.2), 0.2, 5.0) : 5.0;
+
+        if (err > 1.0 && h > a->h_min) {
+            a->rejected++;
+            a->h = h * fac;
+            continue;
+        }
+
+        for (int i = 0; i < 4; i++) {
+            double dy = yn[i] - y[i];
+            double bs = h*k1[i] - dy;
+            a->rc[0][i] = y[i];
+            a->rc[1][i] = dy;
+            a->rc[2][i] = bs;
+            a->rc[3][i] = dy - h*k7[i] - bs;
+            a->rc[4][i] = h*(d1*k1[i] + d3*k3[i] + d4*k4[i] + d5*k5[i] + d6*k6[i] + d7*k7[i]);
+        }
+        a->t0 = a->t1;
+        a->t1 += h;
+        memcpy(a->y1, yn, sizeof(yn));
+        memcpy(a->k1, k7, sizeof(k7));   // FSAL
+        a->steps++;
+        a->h = h * fac;
+        return (err > 1.0) ? -1 : 0;
+    }
+}
+
+// Advances the caller's Plant by exactly dt (one CAN frame period).
+// Returns 0, or -1 if some internal step was forced at h_min.
+EXPOSE int plant_step_adaptive(Plant* s, double omega_cmd_rpm, double v_cmd_rpm,
+                               double dt, PlantAdaptive* a){
+    int rc = 0;
+    bool touched = memcmp(s, &a->last, sizeof(*s)) != 0;
+
+    if (!a->live || touched || omega_cmd_rpm != a->omega_cmd || v_cmd_rpm != a->v_cmd) {
+        if (a->live) a->restarts++;
+        a->live = true;
+        a->omega_cmd = omega_cmd_rpm;
+        a->v_cmd     = v_cmd_rpm;
+        a->t_out = a->t0 = a->t1 = 0.0;
+        a->y1[0] = s->Ts; a->y1[1] = s->Th; a->y1[2] = s->Tc; a->y1[3] = s->mdot;
+        rhs4(a->y1, omega_cmd_rpm, v_cmd_rpm, a->k1);
+        a->rhs_evals++;
+        if (a->h <= 0.0) a->h = dt;
+    }
+
+    a->t_out += dt;
+    while (a->t1 < a->t_out)
+        if (dopri_step(a) < 0) rc = -1;
+
+    // dense output at t_out inside [t0, t1]
+    double th = (a->t_out - a->t0) / (a->t1 - a->t0), th1 = 1.0 - th;
+    double y[4];
+    for (int i = 0; i < 4; i++)
+        y[i] = a->rc[0][i] + th*(a->rc[1][i] + th1*(a->rc[2][i] + th*(a->rc[3][i] + th1*a->rc[4][i])));
+
+    s->Ts = sat(y[0], Ts_min, Ts_max);
+    s->Th = sat(y[1], Th_min, Th_max);
+    s->Tc = sat(y[2], Tc_min, Tc_max);
+    s->mdot = sat(y[3], mdot_min, mdot_max);
+    s->v_prev = sat(v_cmd_rpm, 0.0, v_max);
+    a->last = *s;
+    return rc;
+}
+
+/*** -------- Linearly implicit Rosenbrock (ROS2) -------- ***/
+// In-place LU with partial pivoting of a 4x4 matrix; returns -1 if singular.
+static int lu4(double A[4][4], int piv[4]){
+    for (int k = 0; k < 4; k++) {
+        int p = k;
+        for (int i = k + 1; i < 4; i++)
+            if (fabs(A[i][k]) > fabs(A[p][k])) p = i;
+        if (A[p][k] == 0.0) return -1;
+        piv[k] = p;
+        if (p != k)
+            for (int j = 0; j < 4; j++) { double t = A[k][j]; A[k][j] = A[p][j]; A[p][j] = t; }
+        for (int i = k + 1; i < 4; i++) {
+            A[i][k] /= A[k][k];
+            for (int j = k + 1; j < 4; j++) A[i][j] -= A[i][k] * A[k][j];
+        }
+    }
+    return 0;
+}
+
+static void lu4_solve(const double A[4][4], const int piv[4], double x[4]){
+    for (int k = 0; k < 4; k++) {
+        double t = x[k]; x[k] = x[piv[k]]; x[piv[k]] = t;
+        for (int i = k + 1; i < 4; i++) x[i] -= A[i][k] * x[k];
+    }
+    for (int k = 3; k >= 0; k--) {
+        for (int j = k + 1; j < 4; j++) x[k] -= A[k][j] * x[j];
+        x[k] /= A[k][k];
+    }
+}
+
+// Two-stage L-stable Rosenbrock-W method (Verwer et al., ROS2), gamma = 1 + 1/sqrt(2):
+//   W = I - gamma*dt*J,  W k1 = f(y),  W k2 = f(y + dt*k1) - 2*k1,
+//   y' = y + dt*(1.5*k1 + 0.5*k2)
+// Uses the unguarded RHS: the implicit solve keeps the fast mdot mode stable at the
+// 255 ms frame limit, so the derivative clamps plant_step() relies on are not needed.
+// Falls back to plant_step() if the iteration matrix is singular.
+EXPOSE void plant_step_rosenbrock(Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double dt){
+    const double gamma = 1.0 + 1.0/sqrt(2.0);
+    double J[4][4], W[4][4], k1[4], k2[4];
+    int piv[4];
+
+    // ROS2 keeps order 2 for any W, so J may be taken at a better point than y.
+    // The m*|m| loss has zero slope at mdot = 0, where a pump start would see no
+    // hydraulic stiffness at all; linearize at least at the quasi-steady flow
+    // a0*omega^2 = (b + Rh)*mdot^2 that the pump is driving towards.
+    Plant lin = *s;
+    double Tstar = sat(0.5*(sat(s->Th, Th_min, Th_max) + sat(s->Tc, Tc_min, Tc_max)), Tc_min, Th_max);
+    double Rh = Rh0 * ((fast_math ? mu_water_fast(Tstar) : mu_water(Tstar)) / mu60);
+    double mdot_ss = sqrt(a0 * safe_sq(omega_cmd_rpm, SQR_CAP_OMEGA) / (b + Rh));
+    if (lin.mdot < mdot_ss) lin.mdot = mdot_ss;
+    plant_jac(&lin, omega_cmd_rpm, v_cmd_rpm, J);
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            W[i][j] = (i == j ? 1.0 : 0.0) - gamma*dt*J[i][j];
+    if (lu4(W, piv) < 0) { plant_step(s, omega_cmd_rpm, v_cmd_rpm, dt); return; }
+
+    plant_rhs_raw(s, omega_cmd_rpm, v_cmd_rpm, k1);
+    lu4_solve(W, piv, k1);
+
+    Plant p = *s;
+    p.Ts += dt*k1[0]; p.Th += dt*k1[1]; p.Tc += dt*k1[2]; p.mdot += dt*k1[3];
+    plant_rhs_raw(&p, omega_cmd_rpm, v_cmd_rpm, k2);
+    for (int i = 0; i < 4; i++) k2[i] -= 2.0*k1[i];
+    lu4_solve(W, piv, k2);
+
+    s->Ts   += dt*(1.5*k1[0] + 0.5*k2[0]);
+    s->Th   += dt*(1.5*k1[1] + 0.5*k2[1]);
+    s->Tc   += dt*(1.5*k1[2] + 0.5*k2[2]);
+    s->mdot += dt*(1.5*k1[3] + 0.5*k2[3]);
+
+    s->Ts = sat(s->Ts, Ts_min, Ts_max);
+    s->Th = sat(s->Th, Th_min, Th_max);
+    s->Tc = sat(s->Tc, Tc_min, Tc_max);
+    s->mdot = sat(s->mdot, mdot_min, mdot_max);
+    s->v_prev = sat(v_cmd_rpm, 0.0, v_max);
+}
+
+/*** -------- Batched SoA fleet (library build only) -------- ***/
+// Same model as plant_step(), N plants per call; the CAN node itself steps one plant.
+#ifdef UNIT_TEST
+typedef struct {
+    size_t  n;
+    double *Ts, *Th, *Tc, *mdot, *v_prev;
+    double *ua_v, *ua;   // UA cache keyed on the v_cmd it was computed for
+} PlantBatch;
+
+// exp() on the narrow viscosity-ratio exponent range (plant_batch_simd.h):
+// Taylor series in 1/k! around exp_center, scaled by exp(exp_center)
+static const double exp_center     = 0.2125;
+static const double exp_center_val = 1.2367661135652848;
+static const double exp_taylor[14] = {
+    1.0, 1.0, 1.0/2.0, 1.0/6.0, 1.0/24.0, 1.0/120.0, 1.0/720.0, 1.0/5040.0,
+    1.0/40320.0, 1.0/362880.0, 1.0/3628800.0, 1.0/39916800.0, 1.0/479001600.0,
+    1.0/6227020800.0
+};
+
+// Scalar instantiation: tail lanes and CPUs without AVX2
+#define BK_NAME  batch_kernel_scalar
+#define BK_ATTR
+#define BK_W     1
+#define bvec     double
+#define BK_LOAD(p)     (*(p))
+#define BK_STORE(p, v) (*(p) = (v))
+#define BK_SET1(x)     ((double)(x))
+#define BK_ADD(a, c)   ((a) + (c))
+#define BK_SUB(a, c)   ((a) - (c))
+#define BK_MUL(a, c)   ((a) * (c))
+#define BK_DIV(a, c)   ((a) / (c))
+#define BK_MIN(a, c)   ((a) < (c) ? (a) : (c))
+#define BK_MAX(a, c)   ((a) > (c) ? (a) : (c))
+#define BK_SQRT(a)     sqrt(a)
+#define BK_FMA(a, c, d) ((a) * (c) + (d))
+#include "plant_batch_simd.h"
+#undef BK_NAME
+#undef BK_ATTR
+#undef BK_W
+#undef bvec
+#undef BK_LOAD
+#undef BK_STORE
+#undef BK_SET1
+#undef BK_ADD
+#undef BK_SUB
+#undef BK_MUL
+#undef BK_DIV
+#undef BK_MIN
+#undef BK_MAX
+#undef BK_SQRT
+#undef BK_FMA
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BK_HAVE_X86 1
+
+#define BK_NAME  batch_kernel_avx2
+#define BK_ATTR  __attribute__((target("avx2,fma")))
+#define BK_W     4
+#define bvec     __m256d
+#define BK_LOAD(p)     _mm256_loadu_pd(p)
+#define BK_STORE(p, v) _mm256_storeu_pd((p), (v))
+#define BK_SET1(x)     _mm256_set1_pd(x)
+#define BK_ADD(a, c)   _mm256_add_pd((a), (c))
+#define BK_SUB(a, c)   _mm256_sub_pd((a), (c))
+#define BK_MUL(a, c)   _mm256_mul_pd((a), (c))
+#define BK_DIV(a, c)   _mm256_div_pd((a), (c))
+#define BK_MIN(a, c)   _mm256_min_pd((a), (c))
+#define BK_MAX(a, c)   _mm256_max_pd((a), (c))
+#define BK_SQRT(a)     _mm256_sqrt_pd(a)
+#define BK_FMA(a, c, d) _mm256_fmadd_pd((a), (c), (d))
+#include "plant_batch_simd.h"
+#undef BK_NAME
+#undef BK_ATTR
+#undef BK_W
+#undef bvec
+#undef BK_LOAD
+#undef BK_STORE
+#undef BK_SET1
+#undef BK_ADD
+#undef BK_SUB
+#undef BK_MUL
+#undef BK_DIV
+#undef BK_MIN
+#undef BK_MAX
+#undef BK_SQRT
+#undef BK_FMA
+
+#define BK_NAME  batch_kernel_avx512
+#define BK_ATTR  __attribute__((target("avx512f")))
+#define BK_W     8
+#define bvec     __m512d
+#define BK_LOAD(p)     _mm512_loadu_pd(p)
+#define BK_STORE(p, v) _mm512_storeu_pd((p), (v))
+#define BK_SET1(x)     _mm512_set1_pd(x)
+#define BK_ADD(a, c)   _mm512_add_pd((a), (c))
+#define BK_SUB(a, c)   _mm512_sub_pd((a), (c))
+#define BK_MUL(a, c)   _mm512_mul_pd((a), (c))
+#define BK_DIV(a, c)   _mm512_div_pd((a), (c))
+#define BK_MIN(a, c)   _mm512_min_pd((a), (c))
+#define BK_MAX(a, c)   _mm512_max_pd((a), (c))
+#define BK_SQRT(a)     _mm512_sqrt_pd(a)
+#define BK_FMA(a, c, d) _mm512_fmadd_pd((a), (c), (d))
+#include "plant_batch_simd.h"
+#undef BK_NAME
+#undef BK_ATTR
+#undef BK_W
+#undef bvec
+#undef BK_LOAD
+#undef BK_STORE
+#undef BK_SET1
+#undef BK_ADD
+#undef BK_SUB
+#undef BK_MUL
+#undef BK_DIV
+#undef BK_MIN
+#undef BK_MAX
+#undef BK_SQRT
+#undef BK_FMA
+#endif
+
+enum { BATCH_ISA_SCALAR, BATCH_ISA_AVX2, BATCH_ISA_AVX512 };
+static int batch_isa = -1;   // -1: not chosen yet
+
+static int batch_isa_supported(int isa){
+    if (isa == BATCH_ISA_SCALAR) return 1;
+#ifdef BK_HAVE_X86
+    __builtin_cpu_init();
+    if (isa == BATCH_ISA_AVX2)   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == BATCH_ISA_AVX512) return __builtin_cpu_supports("avx512f");
+#endif
+    return 0;
+}
+
+// Select the kernel: "scalar", "avx2", "avx512", or NULL for the widest supported.
+// Returns 0, or -1 if the CPU (or this build) cannot run the requested one.
+EXPOSE int plant_batch_select_isa(const char* name){
+    if (!name){
+        batch_isa = batch_isa_supported(BATCH_ISA_AVX512) ? BATCH_ISA_AVX512
+                  : batch_isa_supported(BATCH_ISA_AVX2)   ? BATCH_ISA_AVX2
+                  : BATCH_ISA_SCALAR;
+        return 0;
+    }
+    int isa;
+    if      (!strcmp(name, "scalar")) isa = BATCH_ISA_SCALAR;
+    else if (!strcmp(name, "avx2"))   isa = BATCH_ISA_AVX2;
+    else if (!strcmp(name, "avx512")) isa = BATCH_ISA_AVX512;
+    else return -1;
+    if (!batch_isa_supported(isa)) return -1;
+    batch_isa = isa;
+    return 0;
+}
+
+EXPOSE const char* plant_batch_isa(void){
+    if (batch_isa < 0) plant_batch_select_isa(NULL);
+    static const char* const names[] = { "scalar", "avx2", "avx512" };
+    return names[batch_isa];
+}
+
+EXPOSE int plant_batch_init(PlantBatch* bt, size_t n){
+    memset(bt, 0, sizeof(*bt));
+    size_t cap = (n + 7) & ~(size_t)7;          // whole 64-byte lines per array
+    if (cap == 0) cap = 8;
+    double* blk = aligned_alloc(64, 7 * cap * sizeof(double));
+    if (!blk) return -1;
+    memset(blk, 0, 7 * cap * sizeof(double));
+    bt->n = n;
+    bt->Ts   = blk;          bt->Th     = blk + 1*cap; bt->Tc = blk + 2*cap;
+    bt->mdot = blk + 3*cap;  bt->v_prev = blk + 4*cap;
+    bt->ua_v = blk + 5*cap;  bt->ua     = blk + 6*cap;
+    for (size_t i = 0; i < cap; i++) bt->ua_v[i] = NAN;   // force first UA_func()
+    return 0;
+}
+
+EXPOSE void plant_batch_free(PlantBatch* bt){
+    free(bt->Ts);   // single block, see plant_batch_init
+    memset(bt, 0, sizeof(*bt));
+}
+
+EXPOSE void plant_batch_set(PlantBatch* bt, size_t i, const Plant* s){
+    bt->Ts[i] = s->Ts; bt->Th[i] = s->Th; bt->Tc[i] = s->Tc;
+    bt->mdot[i] = s->mdot; bt->v_prev[i] = s->v_prev;
+}
+
+EXPOSE void plant_batch_get(const PlantBatch* bt, size_t i, Plant* s){
+    s->Ts = bt->Ts[i]; s->Th = bt->Th[i]; s->Tc = bt->Tc[i];
+    s->mdot = bt->mdot[i]; s->v_prev = bt->v_prev[i];
+}
+
+EXPOSE void plant_batch_step(PlantBatch* bt, const double* omega_cmd_rpm,
+                             const double* v_cmd_rpm, double dt){
+    if (batch_isa < 0) plant_batch_select_isa(NULL);
+
+    // UA only depends on the fan command, which is held across many steps:
+    // one pow() per command change instead of two per step.
+    for (size_t i = 0; i < bt->n; i++){
+        if (v_cmd_rpm[i] != bt->ua_v[i]){
+            bt->ua_v[i] = v_cmd_rpm[i];
+            bt->ua[i]   = UA_func(v_cmd_rpm[i], 0.0);
+        }
+    }
+
+    size_t done = 0;
+#ifdef BK_HAVE_X86
+    if (batch_isa == BATCH_ISA_AVX512){
+        done = bt->n & ~(size_t)7;
+        batch_kernel_avx512(bt, 0, done, omega_cmd_rpm, v_cmd_rpm, dt);
+    } else if (batch_isa == BATCH_ISA_AVX2){
+        done = bt->n & ~(size_t)3;
+        batch_kernel_avx2(bt, 0, done, omega_cmd_rpm, v_cmd_rpm, dt);
+    }
+#endif
+    batch_kernel_scalar(bt, done, bt->n, omega_cmd_rpm, v_cmd_rpm, dt);
+}
+#endif /* UNIT_TEST */
+
 /*** -------- Packing helpers -------- ***/
 EXPOSE  int16_t pack_temp_q10(double T_c){
     // 0.1°C per LSB
@@ -211,22 +765,527 @@ EXPOSE  void le_from_u16(uint8_t* b0, uint8_t* b1, uint16_t v){
     *b1 = (uint8_t)((v >> 8) & 0xFF);
 }
 
+/*** -------- Frame codecs (also used by plant_sim.c) -------- ***/
+// 0x202 feedback: Ts,Th,Tc (0.1 °C, LE s16), v_prev (10 rpm), dt (ms)
+EXPOSE void plant_pack_feedback(const Plant* s, double dt, struct can_frame* tx){
+    memset(tx, 0, sizeof(*tx));
+    tx->can_id = 0x202; tx->len = 8;
+    le_from_u16(&tx->data[0], &tx->data[1], (uint16_t)pack_temp_q10(s->Ts));
+    le_from_u16(&tx->data[2], &tx->data[3], (uint16_t)pack_temp_q10(s->Th));
+    le_from_u16(&tx->data[4], &tx->data[5], (uint16_t)pack_temp_q10(s->Tc));
+    tx->data[6] = pack_v_prev_q10(s->v_prev);
+    tx->data[7] = pack_dt_ms(dt);
+}
+
+// CAN FD variants (CAN_RAW_FD_FRAMES), same IDs, told apart by length; layouts are the
+// CTRL_FD_* ones in controller/controller_core.h:
+//   0x202, 32 bytes: Ts,Th,Tc,mdot s32 Q16.16 | v_prev u32 Q16.16 rpm | dt u32 us | seq | 7 reserved
+//   0x201, 12 bytes: omega_cmd, v_cmd u32 Q16.16 rpm | echo of the 0x202 seq | 3 reserved
+// A classic 0x201 carries the echo in byte 4: the count of 0x202 frames the controller latched.
+
+EXPOSE  int32_t pack_q16(double x){
+    double q = round(x * 65536.0);
+    if (q < -2147483648.0) q = -2147483648.0;
+    if (q >  2147483647.0) q =  2147483647.0;
+    return (int32_t)q;
+}
+
+EXPOSE void plant_pack_feedback_fd(const Plant* s, double dt, struct canfd_frame* tx){
+    memset(tx, 0, sizeof(*tx));
+    tx->can_id = 0x202; tx->len = CTRL_FD_FEEDBACK_LEN;
+    tx->flags  = CANFD_BRS;
+    le_put_u32(&tx->data[0],  (uint32_t)pack_q16(s->Ts));
+    le_put_u32(&tx->data[4],  (uint32_t)pack_q16(s->Th));
+    le_put_u32(&tx->data[8],  (uint32_t)pack_q16(s->Tc));
+    le_put_u32(&tx->data[12], (uint32_t)pack_q16(s->mdot));
+    le_put_u32(&tx->data[16], (uint32_t)pack_q16(sat(s->v_prev, 0.0, 65535.0)));
+    le_put_u32(&tx->data[20], (uint32_t)lround(sat(dt * 1e6, 1.0, 1e6)));
+}
+
+// 0x201 command: classic = omega_cmd, v_cmd (rpm, LE u16); FD = the same in Q16.16 (u32), both
+// in bytes 0..7 so a recorder digest of the first 8 bytes still decodes.
+static bool unpack_cmd(uint32_t id, const uint8_t* d, uint8_t len, double* omega_cmd, double* v_cmd){
+    if ((id & CAN_SFF_MASK) != 0x201 || len < 4) return false;
+    double om, vc;
+    if (len == CTRL_FD_CMD_LEN) {
+        om = (double)le_to_u32(&d[0]) / 65536.0;
+        vc = (double)le_to_u32(&d[4]) / 65536.0;
+    } else {
+        om = (double)(uint16_t)(d[0] | (d[1] << 8));
+        vc = (double)(uint16_t)(d[2] | (d[3] << 8));
+    }
+    *omega_cmd = sat(om, 0, omega_max);
+    *v_cmd     = sat(vc, 0, v_max);
+    return true;
+}
+
+// Returns false if f is not a command.
+#ifdef UNIT_TEST   /* library build (plant_sim, plant_replay); the socket loop only sees canfd_frame */
+EXPOSE bool plant_unpack_cmd(const struct can_frame* f, double* omega_cmd, double* v_cmd){
+    return unpack_cmd(f->can_id, f->data, f->len, omega_cmd, v_cmd);
+}
+#endif
+EXPOSE bool plant_unpack_cmd_fd(const struct canfd_frame* f, double* omega_cmd, double* v_cmd){
+    return unpack_cmd(f->can_id, f->data, f->len, omega_cmd, v_cmd);
+}
+
+/*** -------- Batched socket I/O -------- ***/
+#define PLANT_RX_BATCH 32
+#define PLANT_TX_BATCH 32
+
+// Kernel receive timestamps: SO_TIMESTAMPING (software), else SO_TIMESTAMPNS.
+// Returns 1 / 2 for the one enabled, -1 if neither is available.
+EXPOSE int plant_enable_rx_timestamps(int fd){
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) return 1;
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0) return 2;
+    return -1;
+}
+
+static uint64_t realtime_ns(void){
+    struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cmsg_rx_ns(struct msghdr* h){
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c)) {
+        if (c->cmsg_level != SOL_SOCKET) continue;
+        struct timespec ts[3];
+        if (c->cmsg_type == SCM_TIMESTAMPING) memcpy(ts, CMSG_DATA(c), sizeof(ts));
+        else if (c->cmsg_type == SCM_TIMESTAMPNS) memcpy(ts, CMSG_DATA(c), sizeof(ts[0]));
+        else continue;
+        if (ts[0].tv_sec || ts[0].tv_nsec)
+            return (uint64_t)ts[0].tv_sec * 1000000000ULL + (uint64_t)ts[0].tv_nsec;
+    }
+    return 0;
+}
+
+// Added to 0x201/0x202 on the socket only (loop k of a loops=N controller: its
+// id_base + k*id_stride); decoders, the recorder and replay keep loop 0's IDs
+static canid_t id_off = 0;
+EXPOSE void plant_set_id_off(int off){ id_off = (canid_t)off; }
+
+// Drain everything queued on fd without blocking (recvmmsg, PLANT_RX_BATCH per call).
+// Commands are decoded in arrival order so the newest 0x201 wins; *newest gets its raw
+// frame if non-NULL, and on_cmd (if set) sees every command frame in order with its receive
+// time (kernel timestamp if enabled, else CLOCK_REALTIME when the batch was read). Buffers are
+// CANFD_MTU wide: classic frames arrive as CAN_MTU bytes, FD frames (CAN_RAW_FD_FRAMES) as
+// CANFD_MTU, and the first CAN_MTU bytes of both layouts coincide.
+// Returns frames read (0 if none) or -1 with errno set.
+typedef void (*PlantFrameHook)(const struct canfd_frame* f, uint64_t rx_ns, void* user);
+EXPOSE int plant_rx_drain(int fd, double* omega_cmd, double* v_cmd,
+                          struct canfd_frame* newest, unsigned* n_cmd,
+                          PlantFrameHook on_cmd, void* user){
+    struct canfd_frame buf[PLANT_RX_BATCH];
+    struct iovec     iov[PLANT_RX_BATCH];
+    struct mmsghdr   msg[PLANT_RX_BATCH];
+    union {
+        char cmsg[CMSG_SPACE(3 * sizeof(struct timespec))];
+        struct cmsghdr align;
+    } ctl[PLANT_RX_BATCH];
+    int total = 0;
+    unsigned cmds = 0;
+
+    for (;;) {
+        memset(msg, 0, sizeof(msg));
+        for (int i = 0; i < PLANT_RX_BATCH; i++) {
+            iov[i].iov_base = &buf[i];
+            iov[i].iov_len  = sizeof(buf[i]);
+            msg[i].msg_hdr.msg_iov    = &iov[i];
+            msg[i].msg_hdr.msg_iovlen = 1;
+            if (on_cmd) {
+                msg[i].msg_hdr.msg_control    = ctl[i].cmsg;
+                msg[i].msg_hdr.msg_controllen = sizeof(ctl[i].cmsg);
+            }
+        }
+        int r = recvmmsg(fd, msg, PLANT_RX_BATCH, MSG_DONTWAIT, NULL);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        uint64_t now = on_cmd ? realtime_ns() : 0;
+        for (int i = 0; i < r; i++) {
+            if (msg[i].msg_len != CAN_MTU && msg[i].msg_len != CANFD_MTU) continue;
+            total++;
+            buf[i].can_id -= id_off;
+            if (plant_unpack_cmd_fd(&buf[i], omega_cmd, v_cmd)) {
+                cmds++;
+                if (newest) *newest = buf[i];
+                if (on_cmd) {
+                    uint64_t ts = cmsg_rx_ns(&msg[i].msg_hdr);
+                    on_cmd(&buf[i], ts ? ts : now, user);
+                }
+            }
+        }
+        if (r < PLANT_RX_BATCH) break;   // queue is empty, skip the EAGAIN round trip
+    }
+    if (n_cmd) *n_cmd = cmds;
+    return total;
+}
+
+// Send n frames with as few sendmmsg calls as possible. Returns n or -1 with errno set.
+static int tx_batch(int fd, const void* frames, size_t mtu, unsigned n){
+    const uint8_t* f = frames;
+    struct iovec   iov[PLANT_TX_BATCH];
+    struct mmsghdr msg[PLANT_TX_BATCH];
+    unsigned sent = 0;
+
+    while (sent < n) {
+        unsigned k = n - sent;
+        if (k > PLANT_TX_BATCH) k = PLANT_TX_BATCH;
+        memset(msg, 0, sizeof(msg[0]) * k);
+        for (unsigned i = 0; i < k; i++) {
+            iov[i].iov_base = (void*)(f + (size_t)(sent + i) * mtu);
+            iov[i].iov_len  = mtu;
+            msg[i].msg_hdr.msg_iov    = &iov[i];
+            msg[i].msg_hdr.msg_iovlen = 1;
+        }
+        int r = sendmmsg(fd, msg, k, 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += (unsigned)r;
+    }
+    return (int)sent;
+}
+EXPOSE int plant_tx_batch(int fd, const struct can_frame* f, unsigned n){
+    return tx_batch(fd, f, CAN_MTU, n);
+}
+EXPOSE int plant_tx_batch_fd(int fd, const struct canfd_frame* f, unsigned n){
+    return tx_batch(fd, f, CANFD_MTU, n);
+}
+
 
+/*** -------- Real-time pacing statistics -------- ***/
+// Wakeup latency = time the step actually started minus its absolute deadline.
+// Bucket 0 holds < 1 us; bucket k >= 1 holds [2^(k-1), 2^k) us; the last one is open-ended.
+#define RT_HIST_BUCKETS 24
+typedef struct {
+    uint64_t n;                 /* wakeups */
+    uint64_t overruns;          /* wakeups that found more than one timer expiration */
+    uint64_t missed;            /* deadlines skipped in total (expirations - 1, summed) */
+    uint64_t lat_sum_ns, lat_max_ns;
+    uint64_t bucket[RT_HIST_BUCKETS];
+} RtHist;
+
+EXPOSE void rt_hist_add(RtHist* h, uint64_t lat_ns, uint64_t expirations){
+    uint64_t us = lat_ns / 1000;
+    unsigned k = 0;
+    while (us && k < RT_HIST_BUCKETS - 1) { us >>= 1; k++; }
+    h->bucket[k]++;
+    h->n++;
+    h->lat_sum_ns += lat_ns;
+    if (lat_ns > h->lat_max_ns) h->lat_max_ns = lat_ns;
+    if (expirations > 1) { h->overruns++; h->missed += expirations - 1; }
+}
+
+// Upper edge (us) of the bucket containing quantile q, i.e. a conservative bound
+EXPOSE uint64_t rt_hist_quantile_us(const RtHist* h, double q){
+    if (h->n == 0) return 0;
+    uint64_t want = (uint64_t)ceil(q * (double)h->n), seen = 0;
+    if (want == 0) want = 1;
+    for (unsigned k = 0; k < RT_HIST_BUCKETS; k++){
+        seen += h->bucket[k];
+        if (seen >= want) return (uint64_t)1 << k;
+    }
+    return (uint64_t)1 << (RT_HIST_BUCKETS - 1);
+}
+
+EXPOSE void rt_hist_print(const RtHist* h, FILE* out){
+    fprintf(out, "[C/Plant] rt: wakeups=%llu overruns=%llu missed=%llu  lat mean=%.1fus max=%.1fus"
+                 "  p50<=%lluus p99<=%lluus p99.9<=%lluus\n",
+            (unsigned long long)h->n, (unsigned long long)h->overruns, (unsigned long long)h->missed,
+            h->n ? (double)h->lat_sum_ns / (double)h->n / 1e3 : 0.0, (double)h->lat_max_ns / 1e3,
+            (unsigned long long)rt_hist_quantile_us(h, 0.50),
+            (unsigned long long)rt_hist_quantile_us(h, 0.99),
+            (unsigned long long)rt_hist_quantile_us(h, 0.999));
+    for (unsigned k = 0; k < RT_HIST_BUCKETS; k++){
+        if (!h->bucket[k]) continue;
+        unsigned long long lo = k ? 1ULL << (k - 1) : 0, hi = 1ULL << k;
+        if (k == RT_HIST_BUCKETS - 1)
+            fprintf(out, "  [%8llu,      inf) us %10llu  %6.2f%%\n", lo,
+                    (unsigned long long)h->bucket[k], 100.0 * (double)h->bucket[k] / (double)h->n);
+        else
+            fprintf(out, "  [%8llu, %8llu) us %10llu  %6.2f%%\n", lo, hi,
+                    (unsigned long long)h->bucket[k], 100.0 * (double)h->bucket[k] / (double)h->n);
+    }
+}
+
+/*** -------- Control-loop round trip (0x202 sent -> matching 0x201 received) -------- ***/
+// Log-linear buckets in ns: values < 16 exact, then 16 sub-buckets per power of two, so a
+// quantile is bounded to within 1/16 of its value. Timestamps are CLOCK_REALTIME, the clock of
+// SO_TIMESTAMPING software / SO_TIMESTAMPNS receive stamps.
+#define RTT_SUB_BITS  4
+#define RTT_SUB       (1u << RTT_SUB_BITS)
+#define RTT_BUCKETS   (RTT_SUB * 38)            /* up to 2^41 ns (~37 min); last is open-ended */
+#define RTT_STALE_NS  1000000000ULL             /* an echo this late is not this 0x202's answer */
+typedef struct {
+    uint64_t n, sum_ns, min_ns, max_ns;
+    uint64_t bucket[RTT_BUCKETS];
+} RttHist;
+
+typedef struct {
+    uint64_t tx_ns[256];        /* send time by sequence; 0 = answered or never sent */
+    uint64_t sent;              /* sequences handed out; the low byte is the last (first is 1) */
+    bool     counted;           /* classic: the echo is the controller's 0x202 count, not a tag */
+    bool     desynced;          /* counted: an echo jumped, nothing measured until back in step */
+    uint64_t echo_at;           /* counted: `sent` value the last in-step echo named */
+    uint64_t matched, unmatched, stale, desync;
+    RttHist  h;
+} RttTrack;
+
+static unsigned rtt_index(uint64_t ns){
+    if (ns < RTT_SUB) return (unsigned)ns;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(ns);
+    unsigned k = (msb - RTT_SUB_BITS + 1) * RTT_SUB + (unsigned)((ns >> (msb - RTT_SUB_BITS)) & (RTT_SUB - 1));
+    return k < RTT_BUCKETS ? k : RTT_BUCKETS - 1;
+}
+// Exclusive upper edge of bucket k
+static uint64_t rtt_upper(unsigned k){
+    if (k < RTT_SUB) return k + 1;
+    unsigned shift = k / RTT_SUB - 1;
+    return (uint64_t)(RTT_SUB + k % RTT_SUB + 1) << shift;
+}
+
+EXPOSE void rtt_hist_add(RttHist* h, uint64_t ns){
+    h->bucket[rtt_index(ns)]++;
+    if (h->n == 0 || ns < h->min_ns) h->min_ns = ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->sum_ns += ns;
+    h->n++;
+}
+
+// Upper bucket edge for quantile q, capped at the observed max
+EXPOSE uint64_t rtt_hist_quantile_ns(const RttHist* h, double q){
+    if (h->n == 0) return 0;
+    uint64_t want = (uint64_t)ceil(q * (double)h->n), seen = 0;
+    if (want == 0) want = 1;
+    for (unsigned k = 0; k < RTT_BUCKETS; k++){
+        seen += h->bucket[k];
+        if (seen >= want) { uint64_t u = rtt_upper(k) - 1; return u < h->max_ns ? u : h->max_ns; }
+    }
+    return h->max_ns;
+}
+
+EXPOSE void rtt_hist_print(const RttHist* h, FILE* out, bool buckets){
+    fprintf(out, "[C/Plant] rtt: n=%llu min=%.1fus p50<=%.1fus p99<=%.1fus max=%.1fus mean=%.1fus\n",
+            (unsigned long long)h->n, (double)h->min_ns / 1e3,
+            (double)rtt_hist_quantile_ns(h, 0.50) / 1e3, (double)rtt_hist_quantile_ns(h, 0.99) / 1e3,
+            (double)h->max_ns / 1e3, h->n ? (double)h->sum_ns / (double)h->n / 1e3 : 0.0);
+    if (!buckets || !h->n) return;
+    // one row per power of two
+    for (unsigned k = 0; k < RTT_BUCKETS; ){
+        unsigned end = k < RTT_SUB ? RTT_SUB : k + RTT_SUB;
+        uint64_t lo = k ? rtt_upper(k - 1) : 0, hi = rtt_upper(end - 1), c = 0;
+        for (; k < end; k++) c += h->bucket[k];
+        if (c) fprintf(out, "  [%10.1f, %10.1f) us %10llu  %6.2f%%\n", (double)lo / 1e3, (double)hi / 1e3,
+                       (unsigned long long)c, 100.0 * (double)c / (double)h->n);
+    }
+}
+
+// Sequence for the next 0x202 (wraps at 256; the classic count in the controller does too)
+EXPOSE uint8_t rtt_next_seq(RttTrack* t){
+    return (uint8_t)++t->sent;
+}
+
+// The 0x202 carrying seq left at tx_ns
+EXPOSE void rtt_on_tx(RttTrack* t, uint8_t seq, uint64_t tx_ns){
+    t->tx_ns[seq] = tx_ns ? tx_ns : 1;
+}
+
+// Classic echoes are the controller's count of latched 0x202s, which only matches ours while
+// both started together and lost nothing. Place the echo in our count: it must name a 0x202
+// already sent and not one before the last in-step echo (the count never goes back), and that
+// echo must be under one wrap old so the 8-bit value is unambiguous. Anything else means the
+// counts have parted (plant restarted within idle_ms, controller reloaded or idle-restarted);
+// then no echo is trusted until one names the newest 0x202, which a parted count only does
+// by coincidence; a run starts that way too. A 0x202 lost before the controller shifts the
+// count without a jump.
+static bool rtt_in_step(RttTrack* t, uint8_t seq){
+    uint64_t back = (uint8_t)((uint8_t)t->sent - seq);   /* 0x202s sent after the named one */
+    bool ok = (t->desynced || t->sent - t->echo_at >= 256)
+            ? back == 0
+            : back <= t->sent && t->sent - back >= t->echo_at;
+    t->desynced = !ok;
+    if (ok) t->echo_at = t->sent - back;
+    return ok;
+}
+
+// A 0x201 echoing seq arrived at rx_ns. Only the first answer to a 0x202 counts: the
+// controller repeats the same echo until a newer 0x202 is latched. Returns true if measured.
+EXPOSE bool rtt_on_rx(RttTrack* t, uint8_t seq, uint64_t rx_ns){
+    if (t->counted && !rtt_in_step(t, seq)) { t->desync++; return false; }
+    uint64_t tx = t->tx_ns[seq];
+    if (!tx) { t->unmatched++; return false; }
+    t->tx_ns[seq] = 0;
+    if (rx_ns < tx || rx_ns - tx > RTT_STALE_NS) { t->stale++; return false; }
+    rtt_hist_add(&t->h, rx_ns - tx);
+    t->matched++;
+    return true;
+}
+
+// Echo byte of a 0x201 (classic byte 4, FD byte 8); -1 if the frame has none
+EXPOSE int plant_cmd_echo(const struct canfd_frame* f){
+    if (f->len == CTRL_FD_CMD_LEN) return f->data[CTRL_FD_ECHO_BYTE];
+    return f->len > CTRL_ECHO_BYTE ? f->data[CTRL_ECHO_BYTE] : -1;
+}
+
+#ifndef UNIT_TEST
+/*** -------- Console log records (formatted on the plant_log writer thread) -------- ***/
+enum { LOG_RX, LOG_STATUS, LOG_RK45, LOG_RTT };
+typedef struct { struct canfd_frame f; unsigned n_cmd; double omega_cmd, v_cmd; } LogRx;
+typedef struct { Plant st; double omega_cmd, v_cmd; unsigned dt_q; } LogStatus;
+typedef struct { unsigned long steps, rejected, rhs_evals, restarts; double h; } LogRk45;
+typedef struct { uint64_t n, min_ns, p50_ns, p99_ns, max_ns, unmatched, stale, desync; } LogRtt;
+_Static_assert(sizeof(LogStatus) <= PLOG_PAYLOAD, "log record payload too large");
+_Static_assert(sizeof(LogRx) <= PLOG_PAYLOAD, "log record payload too large");
+_Static_assert(sizeof(LogRtt) <= PLOG_PAYLOAD, "log record payload too large");
+
+static void log_format(FILE* out, const PlogRecord* r, void* user){
+    (void)user;
+    switch (r->kind) {
+    case LOG_RX: {
+        const LogRx* x = (const void*)r->payload;
+        fprintf(out, "[C] RX 0x%03X [%d]:", x->f.can_id & CAN_SFF_MASK, x->f.len);
+        for (int i = 0; i < x->f.len && i < CANFD_MAX_DLEN; i++) fprintf(out, " %02X", x->f.data[i]);
+        if (x->n_cmd > 1) fprintf(out, "  (newest of %u)", x->n_cmd);
+        fprintf(out, "\n→ omega=%.0f rpm, v=%.0f rpm\n", x->omega_cmd, x->v_cmd);
+        break;
+    }
+    case LOG_STATUS: {
+        const LogStatus* x = (const void*)r->payload;
+        fprintf(out, "[C/Plant] Ts=%.1f Th=%.1f Tc=%.1f mdot=%.3f  v=%.0f rpm  dt=%ums  | omega_cmd=%.0f v_cmd=%.0f\n",
+                x->st.Ts, x->st.Th, x->st.Tc, x->st.mdot, x->st.v_prev, x->dt_q,
+                x->omega_cmd, x->v_cmd);
+        break;
+    }
+    case LOG_RK45: {
+        const LogRk45* x = (const void*)r->payload;
+        fprintf(out, "[C/Plant] rk45: steps=%lu rejected=%lu rhs=%lu restarts=%lu h=%.3gs\n",
+                x->steps, x->rejected, x->rhs_evals, x->restarts, x->h);
+        break;
+    }
+    case LOG_RTT: {
+        const LogRtt* x = (const void*)r->payload;
+        fprintf(out, "[C/Plant] rtt: n=%llu min=%.1fus p50<=%.1fus p99<=%.1fus max=%.1fus"
+                     " (unmatched=%llu stale=%llu desync=%llu)\n",
+                (unsigned long long)x->n, (double)x->min_ns / 1e3, (double)x->p50_ns / 1e3,
+                (double)x->p99_ns / 1e3, (double)x->max_ns / 1e3,
+                (unsigned long long)x->unmatched, (unsigned long long)x->stale,
+                (unsigned long long)x->desync);
+        break;
+    }
+    }
+}
+
+/*** -------- Flight recorder and RTT glue -------- ***/
+typedef struct { PlantRec* rec; const Plant* st; uint64_t t_ns; RttTrack* rtt; } RxCtx;
+
+static PrecState prec_state(const Plant* s){
+    return (PrecState){ s->Ts, s->Th, s->Tc, s->mdot, s->v_prev };
+}
+// A slot holds 8 data bytes: FD frames keep their length and the first 8 bytes, which is the
+// whole 0x201 command and Ts/Th of a 0x202 (the slot has the exact state anyway)
+static struct can_frame rec_digest(const struct canfd_frame* f){
+    struct can_frame d;
+    memset(&d, 0, sizeof(d));
+    d.can_id = f->can_id;
+    d.len    = f->len;
+    memcpy(d.data, f->data, sizeof(d.data));
+    return d;
+}
+// plant_rx_drain hook: every 0x201 closes its round trip and is recorded with the state it
+// arrived at
+static void rx_cmd(const struct canfd_frame* f, uint64_t rx_ns, void* user){
+    RxCtx* c = user;
+    int echo = plant_cmd_echo(f);
+    if (echo >= 0) rtt_on_rx(c->rtt, (uint8_t)echo, rx_ns);
+    if (!c->rec) return;
+    PrecState ps = prec_state(c->st);
+    struct can_frame d = rec_digest(f);
+    prec_append(c->rec, PREC_RX_CMD, c->t_ns, &d, &ps, 0);
+}
+
+static volatile sig_atomic_t stop_requested;
+static void on_stop(int sig){ (void)sig; stop_requested = 1; }
+
+// Best effort: each knob only warns if it is refused (no CAP_SYS_NICE, RLIMIT_MEMLOCK, ...)
+static void rt_setup(int prio, int cpu, bool lock){
+    if (cpu >= 0){
+        cpu_set_t set; CPU_ZERO(&set); CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) perror("sched_setaffinity");
+    }
+    if (prio > 0){
+        struct sched_param sp = { .sched_priority = prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) perror("sched_setscheduler(SCHED_FIFO)");
+    }
+    if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) perror("mlockall");
+}
+
+// SO_RCVBUF/SO_SNDBUF; prints what the kernel actually granted (it doubles the request
+// and caps it at net.core.{r,w}mem_max)
+static void set_sock_buf(int s, int opt, int bytes, const char* name){
+    if (bytes <= 0) return;
+    if (setsockopt(s, SOL_SOCKET, opt, &bytes, sizeof(bytes)) < 0) { perror(name); return; }
+    int got = 0; socklen_t len = sizeof(got);
+    if (getsockopt(s, SOL_SOCKET, opt, &got, &len) == 0)
+        printf("[C/Plant] %s=%d bytes (requested %d)\n", name, got, bytes);
+}
+
+static int64_t ts_diff_ns(const struct timespec* a, const struct timespec* b){
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000LL + (a->tv_nsec - b->tv_nsec);
+}
+static void ts_add_ns(struct timespec* t, uint64_t ns){
+    ns += (uint64_t)t->tv_nsec;
+    t->tv_sec  += (time_t)(ns / 1000000000ULL);
+    t->tv_nsec  = (long)(ns % 1000000000ULL);
+}
+#endif
 
 /*** -------- Main -------- ***/
 #ifndef UNIT_TEST
+static void usage(const char* prog){
+    fprintf(stderr,
+        "Usage: %s <ifname> [Ts] [Th] [v_prev] [dt_ms]\n"
+        "Optional named args:\n"
+        "  --Ts <°C>      system temperature (default 155.0)\n"
+        "  --Th <°C>      hot-leg temperature (default 35.0)\n"
+        "  --Tc <°C>      cold-leg temperature (default 25.0)\n"
+        "  --v_prev <rpm> last fan speed (default 0.0)\n"
+        "  --dt_ms <ms>   fixed timestep (default auto)\n"
+        "  --mdot <kg/s>  flow rate (default 0.18)\n"
+        "  --fast_math    table-driven mu_water/UA_func (rel. error < 5e-6)\n"
+        "  --integrator <heun|rk45|ros2>  fixed-step Heun (default), adaptive\n"
+        "                 Dormand-Prince, or linearly implicit Rosenbrock (stiff-stable)\n"
+        "  --rtol <r>     rk45 relative tolerance (default 1e-5)\n"
+        "  --rt           pace steps on an absolute dt_ms timer instead of frame arrival;\n"
+        "                 prints a wakeup-latency/overrun histogram on exit (Ctrl-C)\n"
+        "  --rt_prio <p>  with --rt: SCHED_FIFO priority 1..99\n"
+        "  --cpu <n>      with --rt: pin to CPU n\n"
+        "  --mlock        with --rt: mlockall(MCL_CURRENT|MCL_FUTURE)\n"
+        "  --rcvbuf <B>   SO_RCVBUF in bytes (default: kernel default)\n"
+        "  --sndbuf <B>   SO_SNDBUF in bytes (default: kernel default)\n"
+        "  --log_level <debug|info|warn|error|off>  console log level (default info)\n"
+        "  --log_rate <n> cap console records at n/s, 0 = no cap (default 0)\n"
+        "  --rec <file>   flight recorder: every RX 0x201 / TX 0x202 with the full plant state\n"
+        "                 (export with ./rec_dump <file>)\n"
+        "  --rec_mb <MB>  recorder file preallocation (default 256)\n"
+        "  --rtt_every <s> 0x202 -> 0x201 round-trip summary period (default 5, 0 = exit only);\n"
+        "                 classic frames carry no sequence, so classic RTT rests on both ends\n"
+        "                 counting 0x202s alike and is only trustworthy with desync=0 (use --fd)\n"
+        "  --fd           CAN FD: 32-byte Q16.16 0x202 (adds mdot, dt in us), accepts 12-byte\n"
+        "                 Q16.16 0x201; needs an FD-capable interface (vcan: mtu 72)\n"
+        "  --id_off <n>   talk to loop k of a loops=N controller: n = id_base + k*id_stride\n"
+        "                 is added to 0x201/0x202 on the bus (default 0)\n",
+        prog);
+}
+
 int main(int argc, char** argv){
     if (argc < 2){
-        fprintf(stderr,
-            "Usage: %s <ifname> [Ts] [Th] [v_prev] [dt_ms]\n"
-            "Optional named args:\n"
-            "  --Ts <°C>      system temperature (default 155.0)\n"
-            "  --Th <°C>      hot-leg temperature (default 35.0)\n"
-            "  --Tc <°C>      cold-leg temperature (default 25.0)\n"
-            "  --v_prev <rpm> last fan speed (default 0.0)\n"
-            "  --dt_ms <ms>   fixed timestep (default auto)\n"
-            "  --mdot <kg/s>  flow rate (default 0.18)\n",
-            argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
@@ -239,6 +1298,16 @@ int main(int argc, char** argv){
     double vprev_init = 0.0;
     double dt_fixed_s = -1.0;
     double mdot_init = 0.18;
+    enum { INTEG_HEUN, INTEG_RK45, INTEG_ROS2 } integrator = INTEG_HEUN;
+    double rtol = 1e-5;
+    bool rt = false, rt_mlock = false, fd_mode = false;
+    int rt_prio = 0, rt_cpu = -1;
+    int rcvbuf = 0, sndbuf = 0;
+    PlogLevel log_level = PLOG_INFO;
+    double log_rate = 0.0;
+    const char* rec_path = NULL;
+    double rec_mb = 256.0;
+    double rtt_every = 5.0;
 
     // ---- Positional backward compatibility ----
 
@@ -260,6 +1329,48 @@ int main(int argc, char** argv){
             if (ms >= 1.0 && ms <= 255.0) dt_fixed_s = ms * 1e-3;
         }
         else if (strcmp(argv[i], "--mdot")   == 0) mdot_init   = parse_or(argv[i+1], mdot_init);
+        else if (strcmp(argv[i], "--integrator") == 0) {
+            if      (strcmp(argv[i+1], "rk45") == 0) integrator = INTEG_RK45;
+            else if (strcmp(argv[i+1], "ros2") == 0) integrator = INTEG_ROS2;
+            else if (strcmp(argv[i+1], "heun") == 0) integrator = INTEG_HEUN;
+            else {
+                fprintf(stderr, "bad --integrator '%s'\n", argv[i+1]);
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--rtol")   == 0) rtol        = parse_or(argv[i+1], rtol);
+        else if (strcmp(argv[i], "--rt_prio") == 0) rt_prio    = (int)sat(parse_or(argv[i+1], 0), 0, 99);
+        else if (strcmp(argv[i], "--cpu")    == 0) rt_cpu      = (int)parse_or(argv[i+1], -1);
+        else if (strcmp(argv[i], "--rcvbuf") == 0) rcvbuf      = (int)parse_or(argv[i+1], 0);
+        else if (strcmp(argv[i], "--sndbuf") == 0) sndbuf      = (int)parse_or(argv[i+1], 0);
+        else if (strcmp(argv[i], "--log_level") == 0) {
+            log_level = plog_level_parse(argv[i+1], PLOG_LEVEL_INVALID);
+            if (log_level == PLOG_LEVEL_INVALID) {
+                fprintf(stderr, "bad --log_level '%s'\n", argv[i+1]);
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--log_rate") == 0) log_rate  = parse_or(argv[i+1], log_rate);
+        else if (strcmp(argv[i], "--rec")    == 0) rec_path    = argv[i+1];
+        else if (strcmp(argv[i], "--rec_mb") == 0) rec_mb      = parse_or(argv[i+1], rec_mb);
+        else if (strcmp(argv[i], "--rtt_every") == 0) rtt_every = parse_or(argv[i+1], rtt_every);
+        else if (strcmp(argv[i], "--id_off") == 0) {
+            double off = parse_or(argv[i+1], NAN);
+            if (!(off == floor(off) && 0x201 + off >= 0 && 0x202 + off <= CAN_SFF_MASK)) {
+                fprintf(stderr, "bad --id_off '%s'\n", argv[i+1]);
+                usage(argv[0]);
+                return 1;
+            }
+            plant_set_id_off((int)off);
+        }
+    }
+    for (int i = 2; i < argc; i++) {
+        if      (strcmp(argv[i], "--fast_math") == 0) plant_set_fast_math(1);
+        else if (strcmp(argv[i], "--rt")        == 0) rt = true;
+        else if (strcmp(argv[i], "--mlock")     == 0) rt_mlock = true;
+        else if (strcmp(argv[i], "--fd")        == 0) fd_mode = true;
     }
 
     // ---- Socket setup (unchanged) ----
@@ -267,11 +1378,25 @@ int main(int argc, char** argv){
     if (s < 0) die("socket");
 
     struct can_filter flt;
-    flt.can_id = 0x201; flt.can_mask = CAN_SFF_MASK;
+    flt.can_id = 0x201 + id_off; flt.can_mask = CAN_SFF_MASK;
     if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &flt, sizeof(flt)) < 0) die("setsockopt");
+    if (fd_mode) {
+        int on = 1;
+        if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on)) < 0) die("CAN_RAW_FD_FRAMES");
+    }
+    set_sock_buf(s, SO_RCVBUF, rcvbuf, "SO_RCVBUF");
+    set_sock_buf(s, SO_SNDBUF, sndbuf, "SO_SNDBUF");
+    int tsmode = plant_enable_rx_timestamps(s);
     bind_socket(s, ifname);
 
-    printf("[C/Plant] RX 0x201 (omega_cmd,v_cmd), TX 0x202 (Ts,Th,Tc,v_prev,dt)\n");
+    if (fd_mode)
+        printf("[C/Plant] CAN FD: RX 0x%03X (omega_cmd,v_cmd Q16.16), TX 0x%03X [32] (Ts,Th,Tc,mdot,v_prev Q16.16, dt us)\n",
+               0x201 + id_off, 0x202 + id_off);
+    else
+        printf("[C/Plant] RX 0x%03X (omega_cmd,v_cmd), TX 0x%03X (Ts,Th,Tc,v_prev,dt)\n",
+               0x201 + id_off, 0x202 + id_off);
+    printf("[C/Plant] rtt: RX stamps from %s\n", tsmode == 1 ? "SO_TIMESTAMPING" :
+           tsmode == 2 ? "SO_TIMESTAMPNS" : "clock_gettime after recvmmsg");
 
     // ---- Initial plant state ----
     Plant st = {
@@ -282,69 +1407,193 @@ int main(int argc, char** argv){
         .v_prev= vprev_init
     };
 
+    PlantAdaptive integ;
+    plant_adaptive_init(&integ, rtol);
+
     uint64_t next_print = now_ms() + 500;
 
+    // Ctrl-C / SIGTERM end the loop (no SA_RESTART, so poll/read return EINTR)
+    struct sigaction sa = { .sa_handler = on_stop };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // fixed step (never 0)
+    double dt = dt_fixed_s;
+    if (dt < 0.0005) dt = 0.0005;     // 0.5 ms minimum
+    if (dt > 0.255)  dt = 0.255;      // cap to 255 ms (fits in uint8)
+
+    // ---- Real-time mode: absolute deadlines every dt on CLOCK_MONOTONIC ----
+    int tfd = -1;
+    uint64_t period_ns = (uint64_t)llround(dt * 1e9);
+    struct timespec deadline;
+    RtHist hist;
+    memset(&hist, 0, sizeof(hist));
+    if (rt) {
+        rt_setup(rt_prio, rt_cpu, rt_mlock);
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (tfd < 0) die("timerfd_create");
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        ts_add_ns(&deadline, period_ns);
+        struct itimerspec its = {
+            .it_value    = deadline,
+            .it_interval = { .tv_sec = (time_t)(period_ns / 1000000000ULL),
+                             .tv_nsec = (long)(period_ns % 1000000000ULL) },
+        };
+        if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) die("timerfd_settime");
+        printf("[C/Plant] rt: period=%.3f ms prio=%d cpu=%d mlock=%d\n",
+               dt * 1e3, rt_prio, rt_cpu, (int)rt_mlock);
+    }
+
+    // Console output leaves the loop as binary records; a writer thread does the printf
+    PlogConfig lcfg = { .capacity = 4096, .level = log_level, .rate = log_rate,
+                        .out = stdout, .format = log_format };
+    Plog* lg = plog_open(&lcfg);
+    if (!lg) die("plog_open");
 
-    for(;;){
-        // poll for command frame with a small timeout (e.g., 50 ms)
-        struct pollfd pfd = { .fd = s, .events = POLLIN };
-        int pr = poll(&pfd, 1, 50);
-        if (pr < 0) die("poll");
+    // Round trip: each 0x202 gets a sequence (FD: byte 24; classic: implied by its position in
+    // the stream, counted by the controller) that the answering 0x201 echoes back
+    RttTrack rtt;
+    memset(&rtt, 0, sizeof(rtt));
+    rtt.counted = rtt.desynced = !fd_mode;   // classic: trust the count once an echo names the newest 0x202
+    uint64_t rtt_period_ms = rtt_every > 0.0 ? (uint64_t)llround(rtt_every * 1e3) : 0;
+    uint64_t next_rtt = now_ms() + rtt_period_ms;
 
-        // compute dt since last loop (never 0)
-        double dt = dt_fixed_s;
-        if (dt < 0.0005) dt = 0.0005;     // 0.5 ms minimum
-        if (dt > 0.255)  dt = 0.255;      // cap to 255 ms (fits in uint8)
+    PlantRec rec;
+    RxCtx rctx = { .rec = rec_path ? &rec : NULL, .st = &st, .rtt = &rtt };
+    if (rec_path) {
+        if (prec_open(&rec, rec_path, (size_t)(sat(rec_mb, 1.0, 1048576.0) * 1048576.0), 0) < 0)
+            die(rec_path);
+        printf("[C/Plant] rec: %s, %llu slots preallocated\n", rec_path,
+               (unsigned long long)rec.hdr->capacity);
+    }
+    PlantFrameHook on_cmd = rx_cmd;
 
+    while (!stop_requested) {
         double omega_cmd = 0.0, v_cmd = st.v_prev; // default to last v if nothing received
+        uint64_t nsteps = 1;
+        struct canfd_frame f;                      // newest 0x201 of this wakeup, if n_cmd
+        unsigned n_cmd = 0;
 
-        if (pr > 0 && (pfd.revents & POLLIN)) {
-            struct can_frame f;
-            if (recv(s, &f, sizeof(f), 0) < 0) die("recv");
-        
-            printf("[C] RX 0x%03X [%d]:", f.can_id & CAN_SFF_MASK, f.len);
-            for (int i = 0; i < f.len && i < 8; i++) printf(" %02X", f.data[i]);
-            printf("\n");
-        
-            if ((f.can_id & CAN_SFF_MASK) == 0x201 && f.len >= 4) {
-                uint16_t om = f.data[0] | (f.data[1] << 8);
-                uint16_t vc = f.data[2] | (f.data[3] << 8);
-                omega_cmd = sat((double)om, 0, omega_max);
-                v_cmd     = sat((double)vc, 0, v_max);
-                printf("→ omega=%.0f rpm, v=%.0f rpm\n", omega_cmd, v_cmd);
+        if (rt) {
+            // Block until the next deadline; >1 expirations means we overran
+            uint64_t exp = 0;
+            if (read(tfd, &exp, sizeof(exp)) != (ssize_t)sizeof(exp)) {
+                if (errno == EINTR) continue;
+                die("read(timerfd)");
             }
-        }
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t lat = ts_diff_ns(&now, &deadline);
+            rt_hist_add(&hist, lat > 0 ? (uint64_t)lat : 0, exp);
+            ts_add_ns(&deadline, exp * period_ns);
 
-        // integrate plant one step with commands
-        plant_step(&st, omega_cmd, v_cmd, dt);
+            // Drain every queued 0x201 in the same wakeup; the newest one wins
+            if (rec_path) rctx.t_ns = prec_now_ns(&rec);
+            if (plant_rx_drain(s, &omega_cmd, &v_cmd, &f, &n_cmd, on_cmd, &rctx) < 0) die("recvmmsg");
+            // Keep simulated time locked to wall time across overruns
+            nsteps = exp;
+        } else {
+            // Legacy mode: step once per poll return (50 ms timeout)
+            struct pollfd pfd = { .fd = s, .events = POLLIN };
+            int pr = poll(&pfd, 1, 50);
+            if (pr < 0) {
+                if (errno == EINTR) continue;
+                die("poll");
+            }
 
-        // Build feedback frame (one 8-byte message)
-        struct can_frame tx = {0};
-        tx.can_id = 0x202; tx.len = 8;
+            if (pr > 0 && (pfd.revents & POLLIN)) {
+                // Take the whole burst; stale commands are skipped, not replayed step by step
+                if (rec_path) rctx.t_ns = prec_now_ns(&rec);
+                if (plant_rx_drain(s, &omega_cmd, &v_cmd, &f, &n_cmd, on_cmd, &rctx) < 0) die("recvmmsg");
+            }
+        }
+        if (n_cmd) {
+            LogRx x = { .f = f, .n_cmd = n_cmd, .omega_cmd = omega_cmd, .v_cmd = v_cmd };
+            plog_push(lg, PLOG_INFO, LOG_RX, &x, sizeof(x));
+        }
 
-        int16_t Ts_q = pack_temp_q10(st.Ts);
-        int16_t Th_q = pack_temp_q10(st.Th);
-        int16_t Tc_q = pack_temp_q10(st.Tc);
-        uint8_t vprev_q = pack_v_prev_q10(st.v_prev);
+        // integrate plant with commands (one step per elapsed deadline in rt mode);
+        // every step gets its 0x202, flushed with one sendmmsg per PLANT_TX_BATCH
+        struct can_frame   tx[PLANT_TX_BATCH];
+        struct canfd_frame txfd[PLANT_TX_BATCH];
+        uint8_t seq[PLANT_TX_BATCH];
+        unsigned ntx = 0;
+        for (uint64_t k = 0; k < nsteps; k++) {
+            switch (integrator) {
+            case INTEG_RK45: plant_step_adaptive(&st, omega_cmd, v_cmd, dt, &integ); break;
+            case INTEG_ROS2: plant_step_rosenbrock(&st, omega_cmd, v_cmd, dt);       break;
+            default:         plant_step(&st, omega_cmd, v_cmd, dt);                  break;
+            }
+            seq[ntx] = rtt_next_seq(&rtt);
+            if (fd_mode) {
+                plant_pack_feedback_fd(&st, dt, &txfd[ntx]);
+                txfd[ntx].data[CTRL_FD_SEQ_BYTE] = seq[ntx];
+                tx[ntx] = rec_digest(&txfd[ntx]);
+            } else {
+                plant_pack_feedback(&st, dt, &tx[ntx]);
+            }
+            if (rec_path) {
+                PrecState ps = prec_state(&st);
+                prec_append(&rec, PREC_TX_FB, prec_now_ns(&rec), &tx[ntx], &ps,
+                            (uint32_t)period_ns | (k ? PREC_AUX_CATCHUP : 0u));
+            }
+            if (fd_mode) txfd[ntx].can_id += id_off;
+            else         tx[ntx].can_id   += id_off;
+            ntx++;
+            if (ntx == PLANT_TX_BATCH || k + 1 == nsteps) {
+                uint64_t t_tx = realtime_ns();
+                for (unsigned j = 0; j < ntx; j++) rtt_on_tx(&rtt, seq[j], t_tx);
+                int r = fd_mode ? plant_tx_batch_fd(s, txfd, ntx) : plant_tx_batch(s, tx, ntx);
+                if (r < 0) die("sendmmsg");
+                ntx = 0;
+            }
+        }
         uint8_t dt_q = pack_dt_ms(dt);
 
-        le_from_u16(&tx.data[0], &tx.data[1], (uint16_t)Ts_q);
-        le_from_u16(&tx.data[2], &tx.data[3], (uint16_t)Th_q);
-        le_from_u16(&tx.data[4], &tx.data[5], (uint16_t)Tc_q);
-        tx.data[6] = vprev_q;
-        tx.data[7] = dt_q;
-
-        if (send(s, &tx, sizeof(tx), 0) < 0) die("send");
-
         // light console print
         uint64_t nowm = now_ms();
         if ((int64_t)(nowm - next_print) >= 0){
-            printf("[C/Plant] Ts=%.1f Th=%.1f Tc=%.1f mdot=%.3f  v=%.0f rpm  dt=%ums  | omega_cmd=%.0f v_cmd=%.0f\n",
-                   st.Ts, st.Th, st.Tc, st.mdot, st.v_prev, (unsigned)dt_q,
-                   omega_cmd, v_cmd);
+            LogStatus x = { .st = st, .omega_cmd = omega_cmd, .v_cmd = v_cmd, .dt_q = dt_q };
+            plog_push(lg, PLOG_INFO, LOG_STATUS, &x, sizeof(x));
+            if (integrator == INTEG_RK45) {
+                LogRk45 k = { integ.steps, integ.rejected, integ.rhs_evals, integ.restarts, integ.h };
+                plog_push(lg, PLOG_INFO, LOG_RK45, &k, sizeof(k));
+            }
             next_print = nowm + 500;
         }
+        if (rtt_period_ms && (int64_t)(nowm - next_rtt) >= 0){
+            LogRtt x = { rtt.h.n, rtt.h.min_ns, rtt_hist_quantile_ns(&rtt.h, 0.50),
+                         rtt_hist_quantile_ns(&rtt.h, 0.99), rtt.h.max_ns, rtt.unmatched, rtt.stale,
+                         rtt.desync };
+            plog_push(lg, PLOG_INFO, LOG_RTT, &x, sizeof(x));
+            next_rtt = nowm + rtt_period_ms;
+        }
+    }
+
+    PlogStats ls;
+    plog_stats(lg, &ls);
+    plog_close(lg);
+    if (ls.dropped_full || ls.dropped_rate)
+        printf("[C/Plant] log: records=%llu dropped_full=%llu dropped_rate=%llu\n",
+               (unsigned long long)ls.enqueued, (unsigned long long)ls.dropped_full,
+               (unsigned long long)ls.dropped_rate);
+
+    if (rec_path) {
+        printf("[C/Plant] rec: %llu slots used, %llu records dropped (file full)\n",
+               (unsigned long long)rec.used, (unsigned long long)rec.hdr->dropped);
+        prec_close(&rec);
+    }
+
+    rtt_hist_print(&rtt.h, stdout, true);
+    printf("[C/Plant] rtt: %llu matched, %llu unmatched, %llu stale, %llu desync 0x201\n",
+           (unsigned long long)rtt.matched, (unsigned long long)rtt.unmatched,
+           (unsigned long long)rtt.stale, (unsigned long long)rtt.desync);
+
+    if (rt) {
+        rt_hist_print(&hist, stdout);
+        close(tfd);
     }
+    close(s);
     return 0;
 }
 #endif
\ No newline at end of file
@@ -1,6 +1,12 @@
 /* plant_user_api.h */
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <linux/can.h>
+
+#include "controller/controller_core.h"   /* CTRL_FD_* frame layouts, LE helpers */
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,14 +25,132 @@ double safe_sq(double x, double cap);
 double mu_water(double T_c);
 double UA_func(double v_cmd, double Tstar);
 double Psys(double t, double Ts);
+/* Table-driven versions used when fast math is on; max relative error vs. the
+ * functions above: mu_water_fast < 1e-6, UA_func_fast < 5e-6. */
+double mu_water_fast(double T_c);
+double UA_func_fast(double v_cmd, double Tstar);
+void   plant_set_fast_math(int on);
 void   plant_step(Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double dt);
 
+/* Adaptive Dormand–Prince 5(4) with dense output: steps are sized by error
+ * control, frames inside an accepted step are interpolated without RHS calls.
+ * Must match the definition in plant_user.c. */
+typedef struct {
+    double rtol, atol_T, atol_m;   /* tolerances (relative; °C; kg/s) */
+    double h, h_min, h_max;        /* next internal step, carried across calls */
+    unsigned long steps, rejected, rhs_evals, restarts;
+
+    /* integrator state (internal) */
+    bool   live;
+    double omega_cmd, v_cmd;
+    double t_out, t0, t1;
+    double y1[4], k1[4];
+    double rc[5][4];
+    Plant  last;
+} PlantAdaptive;
+
+void   plant_adaptive_init(PlantAdaptive* a, double rtol);
+int    plant_step_adaptive(Plant* s, double omega_cmd_rpm, double v_cmd_rpm,
+                           double dt, PlantAdaptive* a);   /* 0, or -1 if forced at h_min */
+
+/* Linearly implicit ROS2 step with an analytic Jacobian; stable at dt = 255 ms
+ * without the derivative clamps plant_step() needs */
+void   plant_step_rosenbrock(Plant* s, double omega_cmd_rpm, double v_cmd_rpm, double dt);
+
+/* Batched fleet: N plants in structure-of-arrays form, advanced together by
+ * plant_batch_step() (AVX-512 / AVX2 / scalar, picked at runtime).
+ * After 2000 steps each state stays within 1e-9 * (1 + |x|) of N plant_step()
+ * calls made with fast math off. The batch always uses the exact UA and its own exp()
+ * polynomial: plant_set_fast_math() does not apply to it. */
+typedef struct {
+    size_t  n;
+    double *Ts, *Th, *Tc, *mdot, *v_prev;
+    double *ua_v, *ua;   /* internal UA cache */
+} PlantBatch;
+
+int    plant_batch_init(PlantBatch* b, size_t n);   /* 0 or -1 (ENOMEM) */
+void   plant_batch_free(PlantBatch* b);
+void   plant_batch_set(PlantBatch* b, size_t i, const Plant* s);
+void   plant_batch_get(const PlantBatch* b, size_t i, Plant* s);
+void   plant_batch_step(PlantBatch* b, const double* omega_cmd_rpm,
+                        const double* v_cmd_rpm, double dt);
+int    plant_batch_select_isa(const char* name);     /* "scalar"/"avx2"/"avx512"/NULL=auto */
+const char* plant_batch_isa(void);
+
 int16_t  pack_temp_q10(double T_c);
 uint8_t  pack_v_prev_q10(double v_rpm);
 uint8_t  pack_dt_ms(double dt);
 uint16_t u16_from_le(uint8_t b0, uint8_t b1);
 void     le_from_u16(uint8_t* b0, uint8_t* b1, uint16_t v);
 
+/* 0x202 feedback / 0x201 command frames, exactly as sent and parsed by plant_user */
+void     plant_pack_feedback(const Plant* s, double dt, struct can_frame* tx);
+bool     plant_unpack_cmd(const struct can_frame* f, double* omega_cmd_rpm, double* v_cmd_rpm);
+
+/* CAN FD (--fd): 32-byte Q16.16 0x202 with mdot and dt in us, 12-byte Q16.16 0x201; lengths
+ * and byte offsets are the CTRL_FD_* / CTRL_ECHO_BYTE ones in controller/controller_core.h.
+ * plant_unpack_cmd*() take either length. */
+int32_t  pack_q16(double x);
+void     plant_pack_feedback_fd(const Plant* s, double dt, struct canfd_frame* tx);
+bool     plant_unpack_cmd_fd(const struct canfd_frame* f, double* omega_cmd_rpm, double* v_cmd_rpm);
+
+/* Batched socket I/O (recvmmsg/sendmmsg). plant_rx_drain() empties the queue without
+ * blocking and leaves the newest 0x201 (classic or FD) in omega/v; all return frames or -1. */
+#define PLANT_RX_BATCH 32
+#define PLANT_TX_BATCH 32
+typedef void (*PlantFrameHook)(const struct canfd_frame* f, uint64_t rx_ns, void* user);
+int      plant_rx_drain(int fd, double* omega_cmd_rpm, double* v_cmd_rpm,
+                        struct canfd_frame* newest, unsigned* n_cmd,
+                        PlantFrameHook on_cmd, void* user);   /* on_cmd: every 0x201, in order */
+/* rx_ns (CLOCK_REALTIME) comes from the kernel once this returns 1 (SO_TIMESTAMPING) or
+ * 2 (SO_TIMESTAMPNS); -1: neither, plant_rx_drain() reads the clock itself */
+int      plant_enable_rx_timestamps(int fd);
+/* Added to 0x201/0x202 on the socket only; frames handed to callers keep loop 0's IDs */
+void     plant_set_id_off(int off);
+int      plant_tx_batch(int fd, const struct can_frame* f, unsigned n);
+int      plant_tx_batch_fd(int fd, const struct canfd_frame* f, unsigned n);
+
+/* --rt pacing statistics: wakeup latency (actual start - absolute deadline) in log2 us
+ * buckets plus timer overruns. Must match the definition in plant_user.c. */
+#define RT_HIST_BUCKETS 24
+typedef struct {
+    uint64_t n;                 /* wakeups */
+    uint64_t overruns;          /* wakeups that found more than one timer expiration */
+    uint64_t missed;            /* deadlines skipped in total */
+    uint64_t lat_sum_ns, lat_max_ns;
+    uint64_t bucket[RT_HIST_BUCKETS];   /* [0]: < 1 us, [k]: [2^(k-1), 2^k) us */
+} RtHist;
+
+void     rt_hist_add(RtHist* h, uint64_t lat_ns, uint64_t expirations);
+uint64_t rt_hist_quantile_us(const RtHist* h, double q);   /* bucket upper edge */
+void     rt_hist_print(const RtHist* h, FILE* out);
+
+/* 0x202 -> echoing 0x201 round trip in ns: 16 log-linear buckets per power of two (each
+ * quantile within 1/16 of its value). Must match the definitions in plant_user.c. */
+#define RTT_BUCKETS (16 * 38)
+typedef struct {
+    uint64_t n, sum_ns, min_ns, max_ns;
+    uint64_t bucket[RTT_BUCKETS];
+} RttHist;
+
+typedef struct {
+    uint64_t tx_ns[256];        /* send time by sequence; 0 = answered or never sent */
+    uint64_t sent;              /* sequences handed out; the low byte is the last (first is 1) */
+    bool     counted;           /* classic: the echo is the controller's 0x202 count, not a tag */
+    bool     desynced;          /* counted: an echo jumped, nothing measured until back in step */
+    uint64_t echo_at;           /* counted: `sent` value the last in-step echo named */
+    uint64_t matched, unmatched, stale, desync;
+    RttHist  h;
+} RttTrack;
+
+void     rtt_hist_add(RttHist* h, uint64_t ns);
+uint64_t rtt_hist_quantile_ns(const RttHist* h, double q);   /* bucket upper edge, <= max */
+void     rtt_hist_print(const RttHist* h, FILE* out, bool buckets);
+uint8_t  rtt_next_seq(RttTrack* t);
+void     rtt_on_tx(RttTrack* t, uint8_t seq, uint64_t tx_ns);
+bool     rtt_on_rx(RttTrack* t, uint8_t seq, uint64_t rx_ns);   /* true: first answer, measured */
+int      plant_cmd_echo(const struct canfd_frame* f);           /* echo byte or -1 */
+
 #ifdef __cplusplus
 }
 #endif
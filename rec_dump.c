@@ -0,0 +1,31 @@
+// rec_dump.c — Export a plant_user flight recording (--rec) to CSV
+// Build:  gcc -O2 -Wall -o rec_dump rec_dump.c plant_rec.c
+// Run:    ./rec_dump flight.rec > flight.csv
+//
+// One row per recorded frame: time since the recording started and wall clock, direction
+// (rx = 0x201 command received, tx = 0x202 feedback sent), the raw frame, decoded commands for
+// rx rows, the integration step for tx rows, and the full-precision plant state at that moment.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "plant_rec_api.h"
+
+int main(int argc, char** argv){
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.rec> [out.csv]   (CSV to stdout by default)\n", argv[0]);
+        return 1;
+    }
+    FILE* out = stdout;
+    if (argc > 2 && !(out = fopen(argv[2], "w"))) { perror(argv[2]); return 1; }
+
+    long rows = prec_export_csv(argv[1], out);
+    if (out != stdout) fclose(out);
+    if (rows < 0) {
+        fprintf(stderr, "%s: %s\n", argv[1], errno == EINVAL ? "not a valid recording" : strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "%ld rows\n", rows);
+    return 0;
+}
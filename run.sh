@@ -18,7 +18,7 @@ sudo insmod controller/controller_kernel.ko ifname=vcan0 period_ms=100 idle_ms=1
 
 # Build the plant_user.c file
 echo "Building plant_user.c..."
-gcc -O2 -Wall -o plant_user plant_user.c -lm
+gcc -O2 -Wall -pthread -o plant_user plant_user.c plant_log.c plant_rec.c -lm
 
 # Build the ctrl_set.c file
 echo "Building ctrl_set.c..."
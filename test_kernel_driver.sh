@@ -58,6 +58,8 @@ done
 # -------- Verify required files exist in your repo --------
 req=(
   "controller_kernel.c"
+  "controller_core.c"
+  "controller_core.h"
   "tests/nodeb_test_hooks.h"
   "tests/nodeb_kunit_test.c"
 )
@@ -98,13 +100,20 @@ mkdir -p "${DST_TESTS}"
 
 echo "[i] Copying sources from: ${SRC_REPO}"
 cp -v "${SRC_REPO}/controller_kernel.c" "${DST_DIR}/"
+cp -v "${SRC_REPO}/controller_core.c"   "${DST_DIR}/"   # #included by controller_kernel.c
+cp -v "${SRC_REPO}/controller_core.h"   "${DST_DIR}/"
+cp -v "${SRC_REPO}/nodeb_trace.h"       "${DST_DIR}/"   # re-read by <trace/define_trace.h>
+cp -v "${SRC_REPO}/rx_ring.h"           "${DST_DIR}/"   # per-CPU RX rings
 cp -v "${SRC_REPO}/tests/nodeb_test_hooks.h"   "${DST_DIR}/"
+cp -v "${SRC_REPO}/tests/nodeb_test_hooks.h"   "${DST_TESTS}/"
 cp -v "${SRC_REPO}/tests/nodeb_kunit_test.c" "${DST_TESTS}/"
 
 # -------- Write Makefile & Kconfig for the driver/tests --------
 cat > "${DST_DIR}/Makefile" <<'EOF'
 # drivers/misc/nodeb/Makefile
 obj-$(CONFIG_NODEB) += controller_kernel.o
+# nodeb_trace.h is re-included by <trace/define_trace.h> from this directory
+CFLAGS_controller_kernel.o += -I$(src)
 obj-$(CONFIG_NODEB_KUNIT_TEST) += tests/nodeb_kunit_test.o
 ccflags-y += -Wno-unused-function
 EOF
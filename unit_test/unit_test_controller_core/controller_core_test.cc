@@ -0,0 +1,267 @@
+// controller_core_test.cc
+#include <gtest/gtest.h>
+#include <cstring>
+#include <thread>
+extern "C" {
+  #include "controller_core.h"
+  #include "rx_ring.h"
+}
+
+// 0x202 payload: Ts,Th,Tc in 0.1 °C, v_prev in 10 rpm, dt in ms
+static enum ctrl_rx_kind feed(struct ctrl_core* c, int16_t Ts, int16_t Th, int16_t Tc,
+                              uint8_t vprev_q10, uint8_t dt_ms) {
+  uint8_t d[8];
+  le_put_u16(&d[0], (uint16_t)Ts);
+  le_put_u16(&d[2], (uint16_t)Th);
+  le_put_u16(&d[4], (uint16_t)Tc);
+  d[6] = vprev_q10;
+  d[7] = dt_ms;
+  return ctrl_rx_frame(c, 0x202, d, sizeof(d));
+}
+
+TEST(ControllerCore, ResetAppliesDefaults) {
+  struct ctrl_core c;
+  std::memset(&c, 0xA5, sizeof(c));
+  ctrl_reset(&c);
+  EXPECT_EQ(c.cfg.Ts_sp, Q_FROM_INT(25));
+  EXPECT_EQ(Q_TO_INT(c.cfg.KpT), 100);
+  EXPECT_EQ(c.cfg.KiT, Q_ONE / 10);
+  EXPECT_EQ(c.cfg.Kpm, Q_FROM_INT(130));
+  EXPECT_EQ(c.cfg.kwv, -(Q_ONE / 50));
+  EXPECT_EQ(c.cfg.v_cut_rpm, 700);
+  EXPECT_EQ(c.cfg.tau_d_min_s, Q_ONE / 1000);
+  EXPECT_EQ(c.st.tau_d, Q_ONE);
+  EXPECT_EQ(c.st.eta_T, 0);
+  EXPECT_FALSE(c.have_feedback);
+}
+
+TEST(ControllerCore, NoFeedbackMeansZeroCommand) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  c.omega_cmd_rpm = 1234;
+  controller_step(&c);
+  EXPECT_EQ(c.omega_cmd_rpm, 0);
+  EXPECT_EQ(c.v_cmd_rpm, 0);
+}
+
+TEST(ControllerCore, FeedbackFrameDecodesAndSteps) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  // Ts above setpoint: e_m = -5, omega = -(100 - 130*5) - 0.02*(1200-100) ~= 528 rpm
+  EXPECT_EQ(feed(&c, 300, 250, 225, 120, 10), CTRL_RX_FEEDBACK);
+  EXPECT_TRUE(c.have_feedback);
+  EXPECT_EQ(c.Ts, Q_FROM_INT(30));
+  EXPECT_EQ(c.Tc, Q_FROM_INT(22) + Q_ONE / 2);
+  EXPECT_EQ(c.v_prev_rpm, 1200);
+  EXPECT_EQ(c.dt_us, 10000u);
+  EXPECT_EQ(c.omega_cmd_rpm, 528);
+  EXPECT_EQ(c.v_cmd_rpm, 0);   // ~416 rpm, below the 700 rpm cut-in
+
+  // Far above setpoint: pump and fan saturate
+  feed(&c, 900, 600, 400, 0, 10);
+  EXPECT_EQ(c.omega_cmd_rpm, 4000);
+  EXPECT_EQ(c.v_cmd_rpm, 2800);
+
+  uint8_t d[8];
+  ctrl_tx_payload(&c, d);
+  EXPECT_EQ(le_to_u16(&d[0]), 4000);
+  EXPECT_EQ(le_to_u16(&d[2]), 2800);
+  EXPECT_EQ(d[CTRL_ECHO_BYTE], 2);     // echoes the count of latched 0x202 frames
+  EXPECT_EQ(d[5] | d[6] | d[7], 0);
+}
+
+TEST(ControllerCore, EdgeCasesMatchKernel) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  EXPECT_EQ(feed(&c, 250, 250, 250, 0, 0), CTRL_RX_FEEDBACK);
+  EXPECT_EQ(c.dt_us, 1000u);                   // dt=0 coerced to 1 ms
+
+  uint8_t d[8] = {0};
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x202, d, 7), CTRL_RX_IGNORED);   // 0x202 needs DLC 8
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x300, d, 6), CTRL_RX_IGNORED);
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x123, d, 8), CTRL_RX_IGNORED);
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x101, d, 0), CTRL_RX_HELLO);
+}
+
+TEST(ControllerCore, SetpointAndGainFrames) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  uint8_t d[8] = {0};
+
+  le_put_u16(&d[0], (uint16_t)315);   // 31.5 °C
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x301, d, 2), CTRL_RX_SETPOINT);
+  EXPECT_EQ(c.cfg.Ts_sp, Q_FROM_INT(31) + Q_ONE / 2);
+
+  // KpT=2.0, KiT=0.5, KdT=1.0 (q8.8), kawT=1.5 (q4.4)
+  le_put_u16(&d[0], 512); le_put_u16(&d[2], 128); le_put_u16(&d[4], 256); d[6] = 24;
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x300, d, 7), CTRL_RX_GAINS_T);
+  EXPECT_EQ(c.cfg.KpT, Q_FROM_INT(2));
+  EXPECT_EQ(c.cfg.KiT, Q_ONE / 2);
+  EXPECT_EQ(c.cfg.KdT, Q_ONE);
+  EXPECT_EQ(c.cfg.kawT, Q_ONE + Q_ONE / 2);
+
+  // Kpm=150, Kim=0.25 (q8.8), kawm=8, kvw=0.5, kwv=0.25 (q4.4)
+  le_put_u16(&d[0], 150 * 256); le_put_u16(&d[2], 64); d[4] = 128; d[5] = 8; d[6] = 4;
+  EXPECT_EQ(ctrl_rx_frame(&c, 0x302, d, 7), CTRL_RX_GAINS_M);
+  EXPECT_EQ(c.cfg.Kpm, Q_FROM_INT(150));
+  EXPECT_EQ(c.cfg.Kim, Q_ONE / 4);
+  EXPECT_EQ(c.cfg.kawm, Q_FROM_INT(8));
+  EXPECT_EQ(c.cfg.kvw, Q_ONE / 2);
+  EXPECT_EQ(c.cfg.kwv, Q_ONE / 4);
+  EXPECT_FALSE(c.have_feedback);   // configuration frames do not step the controller
+}
+
+TEST(ControllerCore, FdParamsFrameCarriesSignedGains) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  uint8_t d[CTRL_FD_PARAMS_LEN] = {0};
+  const q16_16 v[10] = {Q_FROM_INT(31) + Q_ONE / 4,                 // Ts_sp
+                        Q_FROM_INT(120), Q_ONE * 3 / 20, Q_FROM_INT(5), Q_FROM_INT(4),
+                        Q_FROM_INT(150), Q_ONE / 50, Q_FROM_INT(8),
+                        -(Q_ONE / 10), -(Q_ONE * 3 / 100)};         // kvw, kwv < 0
+  for (int i = 0; i < 10; i++) le_put_u32(&d[4 * i], (uint32_t)v[i]);
+
+  EXPECT_EQ(ctrl_rx_frame(&c, CTRL_FD_PARAMS_ID, d, CTRL_FD_PARAMS_LEN - 1), CTRL_RX_IGNORED);
+  EXPECT_EQ(ctrl_rx_frame(&c, CTRL_FD_PARAMS_ID, d, CTRL_FD_PARAMS_LEN), CTRL_RX_PARAMS);
+  EXPECT_EQ(c.cfg.Ts_sp, v[0]);
+  EXPECT_EQ(c.cfg.KpT, v[1]);
+  EXPECT_EQ(c.cfg.KiT, v[2]);
+  EXPECT_EQ(c.cfg.kawT, v[4]);
+  EXPECT_EQ(c.cfg.Kim, v[6]);
+  EXPECT_EQ(c.cfg.kvw, v[8]);
+  EXPECT_EQ(c.cfg.kwv, v[9]);
+  EXPECT_FALSE(c.have_feedback);
+}
+
+TEST(ControllerCore, FdFeedbackMatchesClassicAtWholeUnits) {
+  // Same operating point both ways: whole-ms dt and 0.1 °C temperatures give identical commands
+  struct ctrl_core a, b;
+  ctrl_reset(&a);
+  ctrl_reset(&b);
+  feed(&a, 300, 250, 225, 120, 10);
+
+  uint8_t d[CTRL_FD_FEEDBACK_LEN] = {0};
+  le_put_u32(&d[0], (uint32_t)Q_FROM_INT(30));
+  le_put_u32(&d[4], (uint32_t)Q_FROM_INT(25));
+  le_put_u32(&d[8], (uint32_t)(Q_FROM_INT(22) + Q_ONE / 2));
+  le_put_u32(&d[12], (uint32_t)(Q_ONE / 5));
+  le_put_u32(&d[16], (uint32_t)Q_FROM_INT(1200));
+  le_put_u32(&d[20], 10000);
+  EXPECT_EQ(ctrl_rx_frame(&b, 0x202, d, 24), CTRL_RX_IGNORED);     // neither classic nor FD
+  ASSERT_EQ(ctrl_rx_frame(&b, 0x202, d, sizeof(d)), CTRL_RX_FEEDBACK);
+  EXPECT_EQ(b.mdot, Q_ONE / 5);
+  EXPECT_EQ(b.omega_cmd_rpm, a.omega_cmd_rpm);
+  EXPECT_EQ(b.st.eta_m, a.st.eta_m);
+  EXPECT_EQ(b.st.dTh_f, a.st.dTh_f);
+
+  uint8_t tx[CTRL_FD_CMD_LEN];
+  EXPECT_EQ(ctrl_tx_payload_fd(&b, tx), CTRL_FD_CMD_LEN);
+  EXPECT_EQ(le_to_u32(&tx[0]) >> 16, b.omega_cmd_rpm);            // same integer part
+  EXPECT_EQ(le_to_u32(&tx[8]), 0u);
+
+  // dt: 0 -> 16 us (the smallest non-zero Q16.16 step), huge -> 1 s
+  le_put_u32(&d[20], 0);
+  ctrl_rx_frame(&b, 0x202, d, sizeof(d));
+  EXPECT_EQ(b.dt_us, 16u);
+  le_put_u32(&d[20], 0xFFFFFFFFu);
+  ctrl_rx_frame(&b, 0x202, d, sizeof(d));
+  EXPECT_EQ(b.dt_us, 1000000u);
+
+  // v_prev: negative -> 0, above v_max -> v_max
+  le_put_u32(&d[16], (uint32_t)-Q_FROM_INT(5));
+  ctrl_rx_frame(&b, 0x202, d, sizeof(d));
+  EXPECT_EQ(b.v_prev_rpm, 0);
+  le_put_u32(&d[16], 0x7FFFFFFFu);
+  ctrl_rx_frame(&b, 0x202, d, sizeof(d));
+  EXPECT_EQ(b.v_prev_rpm, b.cfg.v_max_rpm);
+}
+
+TEST(ControllerCore, CommandsEchoTheFeedbackSequence) {
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  uint8_t tx[CTRL_FD_CMD_LEN];
+
+  // classic: a running count (mod 256) of 0x202 frames latched; short frames do not count
+  for (int k = 0; k < 300; k++) feed(&c, 300, 250, 225, 120, 10);
+  uint8_t d[8] = {0};
+  ctrl_rx_frame(&c, 0x202, d, 7);
+  ctrl_tx_payload(&c, tx);
+  EXPECT_EQ(tx[CTRL_ECHO_BYTE], 300 % 256);
+
+  // FD: the sequence byte of the frame itself
+  uint8_t fd[CTRL_FD_FEEDBACK_LEN] = {0};
+  le_put_u32(&fd[20], 10000);
+  fd[CTRL_FD_SEQ_BYTE] = 0xA7;
+  ASSERT_EQ(ctrl_rx_frame(&c, 0x202, fd, sizeof(fd)), CTRL_RX_FEEDBACK);
+  ctrl_tx_payload_fd(&c, tx);
+  EXPECT_EQ(tx[CTRL_FD_ECHO_BYTE], 0xA7);
+  EXPECT_EQ(tx[9] | tx[10] | tx[11], 0);
+}
+
+/*** -------- rx_ring.h (per-CPU RX rings of controller_kernel.c) -------- ***/
+TEST(RxRing, FifoOrderAndDropNew) {
+  uint32_t slots[4], v;
+  struct rx_ring r;
+  rx_ring_init(&r, slots, 4, sizeof(uint32_t));
+  for (uint32_t i = 0; i < 4; i++) {
+    v = i;
+    EXPECT_EQ(rx_ring_put(&r, &v, false), RX_RING_QUEUED);
+  }
+  v = 4;
+  EXPECT_EQ(rx_ring_put(&r, &v, false), RX_RING_FULL);
+  for (uint32_t i = 0; i < 4; i++) {
+    ASSERT_TRUE(rx_ring_take(&r, &v));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_FALSE(rx_ring_take(&r, &v));
+}
+
+TEST(RxRing, DropOldEvictsOldest) {
+  uint32_t slots[4], v;
+  struct rx_ring r;
+  rx_ring_init(&r, slots, 4, sizeof(uint32_t));
+  for (uint32_t i = 0; i < 6; i++) {
+    v = i;
+    EXPECT_EQ(rx_ring_put(&r, &v, true), i < 4 ? RX_RING_QUEUED : RX_RING_EVICTED);
+  }
+  uint32_t old = 99;
+  v = 6;
+  EXPECT_EQ(rx_ring_put_old(&r, &v, true, &old), RX_RING_EVICTED);
+  EXPECT_EQ(old, 2u);   // the evicted entry, for the caller's accounting
+  for (uint32_t i = 3; i < 7; i++) {
+    ASSERT_TRUE(rx_ring_take(&r, &v));
+    EXPECT_EQ(v, i);
+  }
+  EXPECT_FALSE(rx_ring_take(&r, &v));
+}
+
+// One producer thread against this one: every value arrives once and in order. With
+// eviction, every value is either taken or reported evicted, never both and never lost.
+TEST(RxRing, ConcurrentProducerLosesNothingUnreported) {
+  const uint32_t n = 200000;
+  for (bool evict : {false, true}) {
+    uint32_t slots[16];
+    struct rx_ring r;
+    rx_ring_init(&r, slots, 16, sizeof(uint32_t));
+    uint32_t evicted = 0;
+    std::thread prod([&] {
+      for (uint32_t i = 1; i <= n; i++) {
+        int ret;
+        while ((ret = rx_ring_put(&r, &i, evict)) == RX_RING_FULL) std::this_thread::yield();
+        if (ret == RX_RING_EVICTED) evicted++;
+      }
+    });
+    uint32_t taken = 0, last = 0, v;
+    while (last != n) {
+      if (!rx_ring_take(&r, &v)) { std::this_thread::yield(); continue; }
+      ASSERT_GT(v, last);
+      if (!evict) {
+        ASSERT_EQ(v, last + 1);
+      }
+      last = v;
+      taken++;
+    }
+    prod.join();
+    EXPECT_EQ(taken + evicted, n) << "evict=" << evict;
+  }
+}
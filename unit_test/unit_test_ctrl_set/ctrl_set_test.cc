@@ -78,3 +78,48 @@ TEST(CtrlSetFrames, BuildParamsAll) {
   EXPECT_EQ(p2.data[5], 0u); // -0.1 → clamp to 0
   EXPECT_EQ(p2.data[6], 0u); // -0.03 → clamp to 0
 }
+
+TEST(CtrlSetFrames, BuildFdParamsFrame) {
+  CtrlParams P{};
+  P.Ts_sp_C = 30.5f;
+  P.KpT = 120.0f;  P.KiT = 0.15f;  P.KdT = 5.0f;   P.kawT = 4.0f;
+  P.Kpm = 150.0f;  P.Kim = 0.02f;  P.kawm = 8.0f;  P.kvw  = -0.1f;  P.kwv = -0.03f;
+  P.send_params = true;
+  P.fd = true;
+
+  canfd_frame f{};
+  build_params_fd_frame(&P, &f);
+  EXPECT_EQ(f.can_id, 0x310u);
+  EXPECT_EQ(f.len, 48);
+  auto S32 = [&](int i) {
+    return (int32_t)((uint32_t)U16(f.data[4*i], f.data[4*i+1]) |
+                     ((uint32_t)U16(f.data[4*i+2], f.data[4*i+3]) << 16));
+  };
+  EXPECT_EQ(S32(0), 30 * 65536 + 32768);          // Ts_sp 30.5 °C
+  EXPECT_EQ(S32(1), 120 * 65536);                 // KpT
+  EXPECT_EQ(S32(2), to_q16(0.15f));               // KiT keeps its fraction
+  EXPECT_EQ(S32(5), 150 * 65536);                 // Kpm
+  EXPECT_EQ(S32(8), -6554);                       // kvw = -0.1, sign kept
+  EXPECT_EQ(S32(9), -1966);                       // kwv = -0.03
+  for (int i = 40; i < 48; i++) EXPECT_EQ(f.data[i], 0);
+
+  EXPECT_EQ(to_q16(-1.0f), -65536);
+  EXPECT_EQ(to_q16(1e6f), 2147483647);            // clamp high
+}
+
+TEST(CtrlSetFrames, IdOffsetAddressesAnotherLoop) {
+  can_frame sp{}, p1{}, p2{};
+  canfd_frame f{};
+  CtrlParams P{};
+  P.Ts_sp_C = 30.0f;
+  P.send_params = true;
+  P.id_off = 0x20;                      // loop 1 with id_base=0, id_stride=0x20
+
+  build_ctrl_frames(&P, &sp, &p1, &p2);
+  build_params_fd_frame(&P, &f);
+  EXPECT_EQ(sp.can_id, 0x321u);
+  EXPECT_EQ(p1.can_id, 0x320u);
+  EXPECT_EQ(p2.can_id, 0x322u);
+  EXPECT_EQ(f.can_id, 0x330u);
+  EXPECT_EQ(U16(sp.data[0], sp.data[1]), (uint16_t)300);
+}
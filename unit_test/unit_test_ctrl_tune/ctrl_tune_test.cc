@@ -0,0 +1,95 @@
+// ctrl_tune_test.cc
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+extern "C" {
+  #include "ctrl_tune_api.h"
+}
+
+static CtrlParams defaults() {
+  CtrlParams p{};
+  p.Ts_sp_C = 35.0f;
+  p.KpT = 100.6f; p.KiT = 0.10f; p.KdT = 4.0f; p.kawT = 5.0f;
+  p.Kpm = 130.0f; p.Kim = 0.01f; p.kawm = 10.0f; p.kvw = -0.15f; p.kwv = -0.02f;
+  p.send_params = true;
+  return p;
+}
+
+static TuneScenario short_scenario() {
+  TuneScenario sc{};
+  sc.dt = 0.010;
+  sc.tx_every = 10;
+  sc.steps = 6000;   // one minute
+  sc.init = Plant{.Ts = 80.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.18, .v_prev = 0.0};
+  sc.w_iae = 1.0; sc.w_os = 1.0; sc.w_u = 1.0;
+  return sc;
+}
+
+TEST(TuneSample, GridCoversEveryCorner) {
+  CtrlParams base = defaults();
+  TuneRange r[2] = {{tune_field_index("KpT"), 50.0, 150.0, false},
+                    {tune_field_index("Kim"), 0.001, 0.1, true}};
+  std::vector<CtrlParams> out(9);
+  ASSERT_EQ(tune_sample(&base, r, 2, TUNE_GRID, 3, 1, out.data(), out.size()), 9u);
+  EXPECT_FLOAT_EQ(out[0].KpT, 50.0f);
+  EXPECT_FLOAT_EQ(out[1].KpT, 100.0f);
+  EXPECT_FLOAT_EQ(out[2].KpT, 150.0f);
+  EXPECT_FLOAT_EQ(out[0].Kim, 0.001f);
+  EXPECT_NEAR(out[3].Kim, 0.01f, 1e-6);   // log midpoint
+  EXPECT_FLOAT_EQ(out[8].Kim, 0.1f);
+  EXPECT_FLOAT_EQ(out[4].KdT, base.KdT);  // untouched fields keep the base value
+}
+
+TEST(TuneSample, LatinHypercubeHitsEachStratumOnce) {
+  CtrlParams base = defaults();
+  TuneRange r[2] = {{tune_field_index("KpT"), 0.0, 100.0, false},
+                    {tune_field_index("Kpm"), 0.0, 100.0, false}};
+  const size_t n = 50;
+  std::vector<CtrlParams> out(n);
+  ASSERT_EQ(tune_sample(&base, r, 2, TUNE_LHS, n, 42, out.data(), n), n);
+  std::vector<int> a(n, 0), b(n, 0);
+  for (const auto& p : out) {
+    a[(size_t)(p.KpT / 100.0 * n)]++;
+    b[(size_t)(p.Kpm / 100.0 * n)]++;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(a[i], 1) << "KpT stratum " << i;
+    EXPECT_EQ(b[i], 1) << "Kpm stratum " << i;
+  }
+  EXPECT_EQ(tune_field_index("nope"), -1);
+}
+
+TEST(TuneRun, ParallelMatchesSerialForEveryCandidate) {
+  CtrlParams base = defaults();
+  TuneRange r[2] = {{tune_field_index("KpT"), 20.0, 200.0, false},
+                    {tune_field_index("Kpm"), 20.0, 200.0, false}};
+  const size_t n = 37;   // not a multiple of the thread count
+  std::vector<CtrlParams> cand(n);
+  tune_sample(&base, r, 2, TUNE_RANDOM, n, 7, cand.data(), n);
+
+  TuneScenario sc = short_scenario();
+  std::vector<TuneResult> par(n), ser(n);
+  for (size_t i = 0; i < n; ++i) par[i].p = ser[i].p = cand[i];
+
+  ASSERT_EQ(tune_run(&sc, par.data(), n, 6), 0);
+  for (size_t i = 0; i < n; ++i) {
+    tune_eval(&sc, &ser[i]);
+    EXPECT_EQ(par[i].cost, ser[i].cost) << i;
+    EXPECT_EQ(par[i].m.iae, ser[i].m.iae) << i;
+  }
+}
+
+TEST(TuneRun, RanksDefaultsAheadOfDisabledLoops) {
+  TuneScenario sc = short_scenario();
+  TuneResult res[2]{};
+  res[0].p = defaults();
+  res[0].p.KpT = 0; res[0].p.KiT = 0; res[0].p.KdT = 0;
+  res[0].p.Kpm = 0; res[0].p.Kim = 0;     // no feedback at all
+  res[1].p = defaults();
+  ASSERT_EQ(tune_run(&sc, res, 2, 2), 0);
+  tune_rank(res, 2);
+  EXPECT_FLOAT_EQ(res[0].p.KpT, 100.6f);
+  EXPECT_LT(res[0].cost, res[1].cost);
+  EXPECT_GT(res[0].m.iae, 0.0);
+}
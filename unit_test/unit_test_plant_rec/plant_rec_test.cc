@@ -0,0 +1,160 @@
+// plant_rec_test.cc
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+extern "C" {
+  #include "plant_rec_api.h"
+}
+
+static struct can_frame frame(uint16_t id, uint8_t seed) {
+  struct can_frame f;
+  std::memset(&f, 0, sizeof(f));
+  f.can_id = id; f.len = 8;
+  for (int i = 0; i < 8; i++) f.data[i] = (uint8_t)(seed + i);
+  return f;
+}
+
+// Slow thermal drift plus a fast hydraulic wiggle, like a real run
+static PrecState state_at(int k) {
+  double t = k * 0.01;
+  return PrecState{60.0 - 20.0 * (1 - std::exp(-t / 300.0)) + 1e-3 * std::sin(7.0 * t),
+                   40.0 + 0.5 * std::sin(t / 50.0), 30.0 - 1e-4 * k,
+                   0.2 + 0.01 * std::sin(3.0 * t), (double)(700 + (k / 100) % 20 * 100)};
+}
+
+TEST(PlantRec, RoundTripTimesFramesAndState) {
+  const char* path = "roundtrip.rec";
+  PlantRec r;
+  ASSERT_EQ(prec_open(&r, path, 1 << 20, 64), 0);
+  const int n = 5000;
+  for (int k = 0; k < n; k++) {
+    PrecState s = state_at(k);
+    uint8_t kind = (k % 5 == 0) ? PREC_RX_CMD : PREC_TX_FB;
+    struct can_frame f = frame(kind == PREC_RX_CMD ? 0x201 : 0x202, (uint8_t)k);
+    ASSERT_EQ(prec_append(&r, kind, 10000000ull * k + 17, &f, &s, 10000000u), 0);
+  }
+  // 5000 events + one two-slot keyframe per 64 events
+  EXPECT_EQ(r.used, (uint64_t)n + 2 * ((n + 63) / 64));
+  prec_close(&r);
+
+  PrecReader rd;
+  ASSERT_EQ(prec_reader_open(&rd, path), 0);
+  PrecEvent ev;
+  double worst = 0.0;
+  for (int k = 0; k < n; k++) {
+    ASSERT_EQ(prec_next(&rd, &ev), 1) << k;
+    EXPECT_EQ(ev.t_ns, 10000000ull * k + 17);
+    EXPECT_EQ(ev.kind, (k % 5 == 0) ? PREC_RX_CMD : PREC_TX_FB);
+    EXPECT_EQ(ev.f.data[0], (uint8_t)k);
+    EXPECT_EQ(ev.aux, 10000000u);
+    PrecState s = state_at(k);
+    double a[5], b[5];   // same view of PrecState as plant_rec.c
+    std::memcpy(a, &s, sizeof(a));
+    std::memcpy(b, &ev.s, sizeof(b));
+    for (int i = 0; i < 5; i++) worst = std::fmax(worst, std::fabs(a[i] - b[i]));
+    if (k % 64 == 0) {
+      EXPECT_EQ(std::memcmp(&s, &ev.s, sizeof(s)), 0) << "keyframe " << k;
+    }
+  }
+  EXPECT_EQ(prec_next(&rd, &ev), 0);
+  EXPECT_LT(worst, 1e-9);   // float deltas, but never accumulated
+  prec_reader_close(&rd);
+}
+
+TEST(PlantRec, FullFileKeepsCommittedPrefixAndCountsDrops) {
+  const char* path = "full.rec";
+  PlantRec r;
+  ASSERT_EQ(prec_open(&r, path, sizeof(PrecHeader) + 10 * sizeof(PrecSlot), 0), 0);
+  PrecState s = state_at(0);
+  struct can_frame f = frame(0x202, 0);
+  int ok = 0;
+  for (int k = 0; k < 20; k++) ok += prec_append(&r, PREC_TX_FB, 1000u * k, &f, &s, 0) == 0;
+  EXPECT_EQ(ok, 8);                 // 2 key slots + 8 events
+  EXPECT_EQ(r.hdr->dropped, 12u);
+
+  // Readable while the writer still has it mapped (as after a crash)
+  PrecReader rd;
+  ASSERT_EQ(prec_reader_open(&rd, path), 0);
+  PrecEvent ev;
+  int seen = 0;
+  while (prec_next(&rd, &ev) == 1) seen++;
+  EXPECT_EQ(seen, 8);
+  prec_reader_close(&rd);
+  prec_close(&r);
+
+  char buf[8192] = {0};
+  FILE* out = fmemopen(buf, sizeof(buf) - 1, "w");
+  ASSERT_NE(out, nullptr);
+  EXPECT_EQ(prec_export_csv(path, out), 8);
+  fclose(out);
+  EXPECT_EQ(std::strncmp(buf, "t_s,wall_s,dir,id,dlc,data,", 27), 0);
+  EXPECT_NE(std::strstr(buf, ",tx,0x202,8,0001020304050607,,,0.000000000,60,40,30,0.20000000000000001,700\n"), nullptr);
+}
+
+TEST(PlantRec, LongGapForcesKeyframe) {
+  const char* path = "gap.rec";
+  PlantRec r;
+  ASSERT_EQ(prec_open(&r, path, 1 << 16, 0), 0);
+  PrecState s = state_at(0);
+  struct can_frame f = frame(0x201, 1);
+  const uint64_t late = 10ull * 1000000000ull;   // 10 s does not fit the 32-bit delta
+  ASSERT_EQ(prec_append(&r, PREC_RX_CMD, 5, &f, &s, 0), 0);
+  ASSERT_EQ(prec_append(&r, PREC_RX_CMD, late, &f, &s, 0), 0);
+  EXPECT_EQ(r.used, 6u);
+  prec_close(&r);
+
+  PrecReader rd;
+  ASSERT_EQ(prec_reader_open(&rd, path), 0);
+  PrecEvent ev;
+  ASSERT_EQ(prec_next(&rd, &ev), 1);
+  EXPECT_EQ(ev.t_ns, 5u);
+  ASSERT_EQ(prec_next(&rd, &ev), 1);
+  EXPECT_EQ(ev.t_ns, late);
+  prec_reader_close(&rd);
+}
+
+TEST(PlantRec, FdFramesKeepLengthAndCommand) {
+  const char* path = "fd.rec";
+  PlantRec r;
+  ASSERT_EQ(prec_open(&r, path, 1 << 16, 0), 0);
+  PrecState s = state_at(0);
+  // 12-byte FD 0x201 digest: omega 1500.5, v 800.25 rpm (Q16.16) in the first 8 bytes
+  struct can_frame f = frame(0x201, 0);
+  f.len = 12;
+  const uint32_t om = 1500u * 65536u + 32768u, v = 800u * 65536u + 16384u;
+  std::memcpy(&f.data[0], &om, 4);
+  std::memcpy(&f.data[4], &v, 4);
+  ASSERT_EQ(prec_append(&r, PREC_RX_CMD, 1, &f, &s, 0), 0);
+  prec_close(&r);
+
+  PrecReader rd;
+  ASSERT_EQ(prec_reader_open(&rd, path), 0);
+  PrecEvent ev;
+  ASSERT_EQ(prec_next(&rd, &ev), 1);
+  EXPECT_EQ(ev.f.len, 12);
+  EXPECT_EQ(std::memcmp(ev.f.data, f.data, 8), 0);
+  prec_reader_close(&rd);
+
+  char buf[1024] = {0};
+  FILE* out = fmemopen(buf, sizeof(buf) - 1, "w");
+  ASSERT_EQ(prec_export_csv(path, out), 1);
+  fclose(out);
+  EXPECT_NE(std::strstr(buf, ",rx,0x201,12,"), nullptr);
+  EXPECT_NE(std::strstr(buf, ",1500.5,800.25,"), nullptr);
+}
+
+TEST(PlantRec, RejectsForeignFiles) {
+  const char* path = "foreign.rec";
+  FILE* f = fopen(path, "w");
+  ASSERT_NE(f, nullptr);
+  std::vector<char> junk(256, 'x');
+  fwrite(junk.data(), 1, junk.size(), f);
+  fclose(f);
+  PrecReader rd;
+  errno = 0;
+  EXPECT_EQ(prec_reader_open(&rd, path), -1);
+  EXPECT_EQ(errno, EINVAL);
+}
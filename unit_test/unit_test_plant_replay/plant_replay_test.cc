@@ -0,0 +1,178 @@
+// plant_replay_test.cc
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <string>
+extern "C" {
+  #include "plant_replay_api.h"
+  #include "plant_rec_api.h"
+}
+
+TEST(ReplayCandump, ParsesClassicFramesAndSkipsTheRest) {
+  uint64_t t = 0;
+  struct canfd_frame f;
+  ASSERT_EQ(replay_parse_candump_line("(1700000000.123456) vcan0 201#E803B004\n", &t, &f), 1);
+  EXPECT_EQ(t, 1700000000123456000ull);
+  EXPECT_EQ(f.can_id, 0x201u);
+  EXPECT_EQ(f.len, 4);
+  EXPECT_EQ(f.data[0], 0xE8);
+  EXPECT_EQ(f.data[3], 0x04);
+
+  ASSERT_EQ(replay_parse_candump_line("(1.000001) can0 202#01.02.03", &t, &f), 1);
+  EXPECT_EQ(f.len, 3);
+  ASSERT_EQ(replay_parse_candump_line("(1.0) can0 301#", &t, &f), 1);
+  EXPECT_EQ(f.len, 0);
+
+  EXPECT_EQ(replay_parse_candump_line("# comment", &t, &f), 0);
+  EXPECT_EQ(replay_parse_candump_line("   \n", &t, &f), 0);
+  EXPECT_EQ(replay_parse_candump_line("(1.0) can0 12345678#00", &t, &f), 0);   // 29-bit
+  EXPECT_EQ(replay_parse_candump_line("(1.0) can0 201#R", &t, &f), 0);         // remote
+  EXPECT_EQ(replay_parse_candump_line("vcan0 201 [4] E8 03", &t, &f), -1);
+  EXPECT_EQ(replay_parse_candump_line("(1.0) can0 201#E80", &t, &f), -1);      // odd nibble
+}
+
+TEST(ReplayCandump, FdFramesSeedAndStep) {
+  uint64_t t = 0;
+  struct canfd_frame f;
+  ASSERT_EQ(replay_parse_candump_line("(1.0) can0 201##1E803", &t, &f), 1);
+  EXPECT_EQ(f.len, 2);
+  EXPECT_EQ(f.flags, CANFD_BRS | CANFD_FDF);
+  EXPECT_EQ(replay_parse_candump_line("(1.0) can0 201#0102030405060708090A", &t, &f), -1);
+
+  // 32-byte Q16.16 feedback seeds the exact state (mdot included), 12-byte commands drive it
+  auto hex = [](const uint8_t* d, int n) {
+    std::string s;
+    char b[3];
+    for (int i = 0; i < n; i++) { std::snprintf(b, sizeof(b), "%02X", d[i]); s += b; }
+    return s;
+  };
+  Plant p0{.Ts = 61.25, .Th = 40.5, .Tc = 30.125, .mdot = 0.25, .v_prev = 1200.5};
+  struct canfd_frame fb;
+  plant_pack_feedback_fd(&p0, 0.0125, &fb);
+  struct canfd_frame cmd{};
+  cmd.can_id = 0x201; cmd.len = CTRL_FD_CMD_LEN;
+  const uint32_t om_q = 2000u * 65536u + 32768u, v_q = 1200u * 65536u;
+  std::memcpy(&cmd.data[0], &om_q, 4);
+  std::memcpy(&cmd.data[4], &v_q, 4);
+  std::string log = "(1.000000) vcan0 202##1" + hex(fb.data, fb.len) + "\n" +
+                    "(1.001000) vcan0 201##1" + hex(cmd.data, cmd.len) + "\n" +
+                    "(1.002000) vcan0 202##1" + hex(fb.data, fb.len) + "\n";
+  FILE* in = fmemopen((void*)log.data(), log.size(), "r");
+  ASSERT_NE(in, nullptr);
+  ReplayStream rs{};
+  ASSERT_EQ(replay_load_candump(&rs, in), 2);
+  fclose(in);
+  EXPECT_DOUBLE_EQ(rs.init.Ts, 61.25);
+  EXPECT_DOUBLE_EQ(rs.init.Tc, 30.125);
+  EXPECT_DOUBLE_EQ(rs.init.mdot, 0.25);
+  EXPECT_DOUBLE_EQ(rs.init.v_prev, 1200.5);
+  EXPECT_EQ(rs.ev[0].kind, RP_CMD);
+  EXPECT_DOUBLE_EQ(rs.ev[0].omega_cmd, 2000.5);
+  EXPECT_DOUBLE_EQ(rs.ev[0].v_cmd, 1200.0);
+  EXPECT_EQ(rs.ev[1].kind, RP_STEP);
+  EXPECT_DOUBLE_EQ(rs.ev[1].dt, 0.0125);
+  replay_free(&rs);
+}
+
+static const char* kLog =
+    "(100.000000) vcan0 202#5802900158007800\n"   // Ts=60.0 Th=40.0 Tc=8.8 v=1200, seeds init
+    "(100.010000) vcan0 201#D007B004\n"           // omega=2000 v=1200
+    "(100.010100) vcan0 202#57028F0158007819\n"   // step, dt=25 ms
+    "(100.035000) vcan0 202#57028F015800780A\n"   // step, dt=10 ms, no new command
+    "(100.045000) vcan0 201#E803BC02\n"           // omega=1000 v=700
+    "(100.045100) vcan0 202#57028F015800780A\n";
+
+static ReplayStream load(const char* text) {
+  ReplayStream rs{};
+  rs.init.mdot = 0.2;
+  FILE* in = fmemopen((void*)text, std::strlen(text), "r");
+  EXPECT_EQ(replay_load_candump(&rs, in), 5);
+  fclose(in);
+  return rs;
+}
+
+TEST(ReplayCandump, StreamAndDeterministicReplay) {
+  ReplayStream rs = load(kLog);
+  ASSERT_TRUE(rs.have_init);
+  EXPECT_DOUBLE_EQ(rs.init.Ts, 60.0);
+  EXPECT_DOUBLE_EQ(rs.init.Tc, 8.8);
+  EXPECT_DOUBLE_EQ(rs.init.v_prev, 1200.0);
+  EXPECT_DOUBLE_EQ(rs.init.mdot, 0.2);
+  EXPECT_EQ(rs.ev[0].kind, RP_CMD);
+  EXPECT_DOUBLE_EQ(rs.ev[0].omega_cmd, 2000.0);
+  EXPECT_EQ(rs.ev[1].kind, RP_STEP);
+  EXPECT_DOUBLE_EQ(rs.ev[1].dt, 0.025);
+
+  char frames[1024] = {0};
+  ReplayConfig cfg{};
+  cfg.frames = fmemopen(frames, sizeof(frames) - 1, "w");
+  Plant a = rs.init, b = rs.init;
+  ReplayResult ra, rb;
+  replay_run(&rs, &cfg, &a, &ra);
+  fclose(cfg.frames);
+  cfg.frames = nullptr;
+  replay_run(&rs, &cfg, &b, &rb);
+
+  EXPECT_EQ(ra.steps, 3u);
+  EXPECT_EQ(ra.cmds, 2u);
+  EXPECT_EQ(ra.hash, rb.hash);
+  EXPECT_EQ(std::memcmp(&a, &b, sizeof(a)), 0);
+  EXPECT_EQ(ra.ref_steps, 0u);   // candump has no full-precision reference
+  EXPECT_EQ(std::strncmp(frames, "(0.025000) replay 202#", 22), 0);
+  EXPECT_NE(std::strstr(frames, "\n(0.035000) replay 202#"), nullptr);
+  EXPECT_NE(std::strstr(frames, "\n(0.045000) replay 202#"), nullptr);
+
+  // Holding the first command through the second step changes the outcome
+  cfg.hold = true;
+  Plant c = rs.init;
+  ReplayResult rc;
+  replay_run(&rs, &cfg, &c, &rc);
+  EXPECT_NE(rc.hash, ra.hash);
+  replay_free(&rs);
+}
+
+TEST(ReplayRec, ReproducesARecordedRunBitForBit) {
+  // What plant_user --rec does: RX with the pre-step state, then one step and its TX; every
+  // 37th wakeup overran and catches up three steps on the inputs it started with
+  const char* path = "replay_src.rec";
+  PlantRec rec;
+  ASSERT_EQ(prec_open(&rec, path, 1 << 20, 256), 0);
+  Plant s{.Ts = 90.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.18, .v_prev = 0.0};
+  const double dt = 0.010;
+  uint64_t t = 0, steps = 0;
+  for (int k = 0; k < 3000; k++, t += 10000000ull) {
+    double om = 0.0, v = s.v_prev;
+    if (k % 10 == 0) {
+      struct can_frame f{};
+      f.can_id = 0x201; f.len = 8;
+      le_from_u16(&f.data[0], &f.data[1], (uint16_t)(1500 + 10 * (k % 70)));
+      le_from_u16(&f.data[2], &f.data[3], (uint16_t)(900 + 5 * (k % 50)));
+      PrecState ps{s.Ts, s.Th, s.Tc, s.mdot, s.v_prev};
+      ASSERT_EQ(prec_append(&rec, PREC_RX_CMD, t, &f, &ps, 0), 0);
+      plant_unpack_cmd(&f, &om, &v);
+    }
+    for (int j = 0; j < (k % 37 == 0 ? 3 : 1); j++, steps++) {
+      plant_step(&s, om, v, dt);
+      struct can_frame tx;
+      plant_pack_feedback(&s, dt, &tx);
+      PrecState ps{s.Ts, s.Th, s.Tc, s.mdot, s.v_prev};
+      ASSERT_EQ(prec_append(&rec, PREC_TX_FB, t + 100000 + j, &tx, &ps,
+                            10000000u | (j ? PREC_AUX_CATCHUP : 0u)), 0);
+    }
+  }
+  prec_close(&rec);
+  ASSERT_EQ(steps, 3000u + 2 * 82);
+
+  ReplayStream rs{};
+  ASSERT_EQ(replay_load_rec(&rs, path), (long)(300 + steps));
+  ReplayConfig cfg{};
+  Plant r = rs.init;
+  ReplayResult res;
+  replay_run(&rs, &cfg, &r, &res);
+  EXPECT_EQ(res.steps, steps);
+  EXPECT_EQ(res.ref_steps, steps);
+  EXPECT_EQ(std::memcmp(&r, &s, sizeof(r)), 0);   // exact initial state + same arithmetic
+  for (double d : res.max_dev) EXPECT_LT(d, 1e-9);
+  replay_free(&rs);
+}
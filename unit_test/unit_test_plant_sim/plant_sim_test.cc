@@ -0,0 +1,111 @@
+// plant_sim_test.cc
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+extern "C" {
+  #include "plant_sim_api.h"
+}
+
+TEST(SimRun, FramesReachTheControllerCore) {
+  // plant_user's 0x202 packing decoded by the module's core
+  Plant p{.Ts = 30.0, .Th = 25.0, .Tc = 22.5, .mdot = 0.0, .v_prev = 1200.0};
+  struct can_frame f;
+  plant_pack_feedback(&p, 0.010, &f);
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  ASSERT_EQ(ctrl_rx_frame(&c, f.can_id & CAN_SFF_MASK, f.data, f.len), CTRL_RX_FEEDBACK);
+  EXPECT_EQ(c.Ts, Q_FROM_INT(30));
+  EXPECT_EQ(c.v_prev_rpm, 1200);
+  EXPECT_EQ(c.dt_us, 10000u);
+
+  // and the core's 0x201 payload parsed by plant_user
+  std::memset(&f, 0, sizeof(f));
+  f.can_id = 0x201; f.len = 8;
+  ctrl_tx_payload(&c, f.data);
+  double om = -1, v = -1;
+  ASSERT_TRUE(plant_unpack_cmd(&f, &om, &v));
+  EXPECT_DOUBLE_EQ(om, c.omega_cmd_rpm);
+  EXPECT_DOUBLE_EQ(v, c.v_cmd_rpm);
+}
+
+TEST(SimRun, FdFramesCarryFullPrecision) {
+  // 32-byte 0x202: Q16.16 temperatures, mdot, v_prev and dt in us reach the core exactly
+  Plant p{.Ts = 30.0 + 1.0 / 64, .Th = 25.0, .Tc = 22.5, .mdot = 0.25, .v_prev = 1200.5};
+  struct canfd_frame f;
+  plant_pack_feedback_fd(&p, 0.0125, &f);
+  ASSERT_EQ(f.len, CTRL_FD_FEEDBACK_LEN);
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  ASSERT_EQ(ctrl_rx_frame(&c, f.can_id & CAN_SFF_MASK, f.data, f.len), CTRL_RX_FEEDBACK);
+  EXPECT_EQ(c.Ts, Q_FROM_INT(30) + Q_ONE / 64);
+  EXPECT_EQ(c.mdot, Q_ONE / 4);
+  EXPECT_EQ(c.v_prev_rpm, 1200);
+  EXPECT_EQ(c.dt_us, 12500u);
+
+  // 12-byte 0x201 keeps the fractional rpm the classic frame truncates
+  std::memset(&f, 0, sizeof(f));
+  f.can_id = 0x201;
+  f.len = ctrl_tx_payload_fd(&c, f.data);
+  ASSERT_EQ(f.len, CTRL_FD_CMD_LEN);
+  double om = -1, v = -1;
+  ASSERT_TRUE(plant_unpack_cmd_fd(&f, &om, &v));
+  EXPECT_DOUBLE_EQ(om, (double)c.omega_cmd_q / 65536.0);
+  EXPECT_EQ((int)om, c.omega_cmd_rpm);
+  EXPECT_GT(om, 0.0);
+}
+
+TEST(SimRun, ClosedLoopIsDeterministicAndRegulates) {
+  SimConfig cfg{};
+  cfg.dt = 0.010;
+  cfg.tx_every = 10;                 // 100 ms controller period
+  cfg.steps = 30 * 60 * 100;         // 30 minutes
+
+  Plant a{.Ts = 155.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.18, .v_prev = 0.0};
+  Plant b = a;
+  struct ctrl_core ca, cb;
+  ctrl_reset(&ca);
+  ctrl_reset(&cb);
+
+  EXPECT_EQ(sim_run(&cfg, &a, &ca), cfg.steps / 10);
+  sim_run(&cfg, &b, &cb);
+  EXPECT_EQ(std::memcmp(&a, &b, sizeof(a)), 0);
+  EXPECT_EQ(std::memcmp(&ca, &cb, sizeof(ca)), 0);
+
+  // Pulled down from 155 °C to near ambient against the 180 W load
+  EXPECT_TRUE(std::isfinite(a.Ts) && std::isfinite(a.mdot));
+  EXPECT_LT(a.Ts, 40.0);
+  EXPECT_GT(a.Ts, 25.0);
+
+  // Same scenario over CAN FD frames: same frame count, regulates at least as well
+  Plant d{.Ts = 155.0, .Th = 35.0, .Tc = 25.0, .mdot = 0.18, .v_prev = 0.0};
+  struct ctrl_core cd;
+  ctrl_reset(&cd);
+  cfg.fd = true;
+  EXPECT_EQ(sim_run(&cfg, &d, &cd), cfg.steps / 10);
+  EXPECT_TRUE(std::isfinite(d.Ts));
+  EXPECT_LT(d.Ts, 40.0);
+  EXPECT_GT(d.Ts, 25.0);
+}
+
+TEST(SimRun, WritesDecimatedTrajectory) {
+  char buf[4096] = {0};
+  FILE* out = fmemopen(buf, sizeof(buf) - 1, "w");
+  ASSERT_NE(out, nullptr);
+
+  SimConfig cfg{};
+  cfg.dt = 0.010;
+  cfg.tx_every = 1;
+  cfg.steps = 1000;
+  cfg.log_every = 250;
+  cfg.out = out;
+  Plant s{.Ts = 60.0, .Th = 40.0, .Tc = 30.0, .mdot = 0.2, .v_prev = 0.0};
+  struct ctrl_core c;
+  ctrl_reset(&c);
+  sim_run(&cfg, &s, &c);
+  fclose(out);
+
+  int rows = 0;
+  for (const char* p = buf; *p; ++p) rows += (*p == '\n');
+  EXPECT_EQ(rows, 4);
+  EXPECT_EQ(std::strncmp(buf, "2.500,", 6), 0);
+}
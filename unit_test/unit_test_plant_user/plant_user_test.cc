@@ -1,5 +1,10 @@
 // plant_user_test.cc
 #include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
 extern "C" {
   #include "plant_user_api.h"
 }
@@ -101,3 +106,425 @@ TEST(PlantStep, FanIncreasesUAAndCoolsColdLegFaster) {
   // With fan, the radiator UA is higher → Tc should be lower (better cooling)
   EXPECT_LT(b.Tc, a.Tc);
 }
+
+TEST(PlantBatch, MatchesScalarPlantStepOnEveryIsa) {
+  // 37 plants: exercises full vectors plus a scalar tail for both AVX widths.
+  const size_t n = 37;
+  const double dt = 0.015;
+  plant_set_fast_math(0);   // the batch always models exactly; compare like with like
+  for (const char* isa : {"scalar", "avx2", "avx512"}) {
+    if (plant_batch_select_isa(isa) != 0) continue;   // not supported on this CPU
+    SCOPED_TRACE(isa);
+
+    PlantBatch bt;
+    ASSERT_EQ(plant_batch_init(&bt, n), 0);
+    std::vector<Plant> ref(n);
+    std::vector<double> om(n), vc(n);
+    for (size_t i = 0; i < n; ++i) {
+      ref[i] = Plant{.Ts=40.0 + 3.0*i, .Th=30.0 + i, .Tc=20.0 + 0.5*i, .mdot=0.02*i, .v_prev=0.0};
+      plant_batch_set(&bt, i, &ref[i]);
+    }
+    for (int k = 0; k < 2000; ++k) {
+      if (k % 100 == 0) {                     // new commands, held like CAN 0x201
+        for (size_t i = 0; i < n; ++i) {
+          om[i] = (double)((i * 97 + k) % 4000);
+          vc[i] = (double)((i * 53 + 3 * k) % 2800);
+        }
+      }
+      for (size_t i = 0; i < n; ++i) plant_step(&ref[i], om[i], vc[i], dt);
+      plant_batch_step(&bt, om.data(), vc.data(), dt);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      Plant got;
+      plant_batch_get(&bt, i, &got);
+      EXPECT_NEAR(got.Ts,   ref[i].Ts,   1e-9 * (1.0 + fabs(ref[i].Ts)));
+      EXPECT_NEAR(got.Th,   ref[i].Th,   1e-9 * (1.0 + fabs(ref[i].Th)));
+      EXPECT_NEAR(got.Tc,   ref[i].Tc,   1e-9 * (1.0 + fabs(ref[i].Tc)));
+      EXPECT_NEAR(got.mdot, ref[i].mdot, 1e-9 * (1.0 + fabs(ref[i].mdot)));
+      EXPECT_DOUBLE_EQ(got.v_prev, ref[i].v_prev);
+    }
+    plant_batch_free(&bt);
+  }
+  plant_batch_select_isa(nullptr);
+}
+
+TEST(PlantBatch, UnknownIsaRejected) {
+  EXPECT_EQ(plant_batch_select_isa("neon"), -1);
+  EXPECT_EQ(plant_batch_select_isa(nullptr), 0);
+  EXPECT_NE(plant_batch_isa(), nullptr);
+}
+
+TEST(FastMath, TablesWithinDocumentedError) {
+  double mu_err = 0.0, ua_err = 0.0;
+  for (double T = -20.0; T <= 130.0; T += 0.001)
+    mu_err = std::fmax(mu_err, fabs(mu_water_fast(T) / mu_water(T) - 1.0));
+  for (double v = -10.0; v <= 700.0; v += 0.0007)
+    ua_err = std::fmax(ua_err, fabs(UA_func_fast(v, 60.0) / UA_func(v, 60.0) - 1.0));
+  EXPECT_LT(mu_err, 1e-6);
+  EXPECT_LT(ua_err, 5e-6);
+}
+
+TEST(FastMath, PlantStepTracksExactModel) {
+  Plant a{.Ts=80.0, .Th=60.0, .Tc=50.0, .mdot=0.18, .v_prev=0.0};
+  Plant b = a;
+  for (int i = 0; i < 1000; ++i) {
+    plant_set_fast_math(0);
+    plant_step(&a, 2000.0, 350.0, 0.02);
+    plant_set_fast_math(1);
+    plant_step(&b, 2000.0, 350.0, 0.02);
+  }
+  plant_set_fast_math(0);
+  EXPECT_NEAR(b.Ts, a.Ts, 1e-3);
+  EXPECT_NEAR(b.Tc, a.Tc, 1e-3);
+  EXPECT_NEAR(b.mdot, a.mdot, 1e-6);
+}
+
+TEST(PlantAdaptive, MatchesFineHeunWithFewerRhsEvaluations) {
+  // 10 minutes at a 15 ms frame cadence, commands held for 60 s at a time.
+  const double dt = 0.015;
+  const int frames = 40000;
+  auto cmd = [](int k, double* om, double* v) {
+    int ph = (k / 4000) % 3;
+    *om = ph == 0 ? 2000.0 : ph == 1 ? 500.0 : 3500.0;
+    *v  = ph == 1 ? 600.0 : 0.0;
+  };
+
+  Plant ref{.Ts=80.0, .Th=60.0, .Tc=50.0, .mdot=0.18, .v_prev=0.0};
+  Plant ad = ref;
+  PlantAdaptive a;
+  plant_adaptive_init(&a, 1e-5);
+  for (int k = 0; k < frames; ++k) {
+    double om, v;
+    cmd(k, &om, &v);
+    for (int j = 0; j < 10; ++j) plant_step(&ref, om, v, dt / 10);
+    EXPECT_EQ(plant_step_adaptive(&ad, om, v, dt, &a), 0);
+  }
+  EXPECT_NEAR(ad.Ts, ref.Ts, 1e-4);
+  EXPECT_NEAR(ad.Tc, ref.Tc, 1e-4);
+  EXPECT_NEAR(ad.mdot, ref.mdot, 1e-5);
+  EXPECT_DOUBLE_EQ(ad.v_prev, ref.v_prev);
+  // Heun at the frame cadence would need 2 evaluations per frame.
+  EXPECT_LT(a.rhs_evals, (unsigned long)frames / 2);
+  EXPECT_GT(a.steps, 0ul);
+  EXPECT_GE(a.restarts, 2ul);   // one per command change
+}
+
+TEST(PlantAdaptive, RestartsWhenStateIsOverwritten) {
+  Plant s{.Ts=60.0, .Th=40.0, .Tc=30.0, .mdot=0.2, .v_prev=0.0};
+  PlantAdaptive a;
+  plant_adaptive_init(&a, 1e-5);
+  plant_step_adaptive(&s, 1000.0, 0.0, 0.01, &a);
+  s.Ts = 90.0;                                  // caller resets the plant
+  plant_step_adaptive(&s, 1000.0, 0.0, 0.01, &a);
+  EXPECT_EQ(a.restarts, 1ul);
+  EXPECT_GT(s.Ts, 89.0);
+}
+
+TEST(PlantRosenbrock, StableAndAccurateAtMaxFrameDt) {
+  // Hot start with the pump off, then pump/fan steps; 255 ms is the largest dt_ms.
+  auto cmd = [](double t, double* om, double* v) {
+    int ph = ((int)(t / 60.0)) % 4;
+    *om = ph == 0 ? 4000.0 : ph == 1 ? 0.0 : ph == 2 ? 3500.0 : 200.0;
+    *v  = ph == 1 ? 600.0 : ph == 3 ? 300.0 : 0.0;
+  };
+  const double dt = 0.255;
+  Plant ref{.Ts=155.0, .Th=35.0, .Tc=25.0, .mdot=0.0, .v_prev=0.0};
+  Plant ros = ref;
+  for (int k = 0; k < 2400; ++k) {           // ~10 minutes
+    double om, v;
+    cmd(k * dt, &om, &v);
+    for (int j = 0; j < 255; ++j) plant_step(&ref, om, v, 0.001);
+    plant_step_rosenbrock(&ros, om, v, dt);
+    ASSERT_TRUE(std::isfinite(ros.Ts) && std::isfinite(ros.mdot));
+    EXPECT_NEAR(ros.Ts, ref.Ts, 0.5);
+    EXPECT_NEAR(ros.Th, ref.Th, 0.5);
+    EXPECT_NEAR(ros.Tc, ref.Tc, 0.5);
+  }
+  EXPECT_NEAR(ros.mdot, ref.mdot, 1e-3);
+}
+
+TEST(PlantRosenbrock, ConvergesToHeunAtSmallDt) {
+  Plant a{.Ts=80.0, .Th=60.0, .Tc=50.0, .mdot=0.18, .v_prev=0.0};
+  Plant r = a;
+  for (int i = 0; i < 2000; ++i) {
+    plant_step(&a, 2000.0, 400.0, 0.005);
+    plant_step_rosenbrock(&r, 2000.0, 400.0, 0.005);
+  }
+  EXPECT_NEAR(r.Ts, a.Ts, 1e-3);
+  EXPECT_NEAR(r.Tc, a.Tc, 1e-3);
+  EXPECT_NEAR(r.mdot, a.mdot, 1e-5);
+  EXPECT_DOUBLE_EQ(r.v_prev, 400.0);
+}
+
+TEST(RtHist, BucketsOverrunsAndQuantiles) {
+  RtHist h;
+  std::memset(&h, 0, sizeof(h));
+  rt_hist_add(&h, 500, 1);          // < 1 us
+  rt_hist_add(&h, 1500, 1);         // [1, 2) us
+  rt_hist_add(&h, 3000, 1);         // [2, 4) us
+  for (int i = 0; i < 96; i++) rt_hist_add(&h, 40000, 1);   // [32, 64) us
+  rt_hist_add(&h, 5000000, 4);      // 5 ms late, three deadlines skipped
+
+  EXPECT_EQ(h.n, 100u);
+  EXPECT_EQ(h.bucket[0], 1u);
+  EXPECT_EQ(h.bucket[1], 1u);
+  EXPECT_EQ(h.bucket[2], 1u);
+  EXPECT_EQ(h.bucket[6], 96u);
+  EXPECT_EQ(h.bucket[13], 1u);      // 5000 us in [4096, 8192)
+  EXPECT_EQ(h.overruns, 1u);
+  EXPECT_EQ(h.missed, 3u);
+  EXPECT_EQ(h.lat_max_ns, 5000000u);
+
+  EXPECT_EQ(rt_hist_quantile_us(&h, 0.50), 64u);
+  EXPECT_EQ(rt_hist_quantile_us(&h, 0.99), 64u);
+  EXPECT_EQ(rt_hist_quantile_us(&h, 1.00), 8192u);
+
+  rt_hist_add(&h, UINT64_MAX / 2, 1);   // clamps into the open-ended bucket
+  EXPECT_EQ(h.bucket[RT_HIST_BUCKETS - 1], 1u);
+}
+
+TEST(RtHist, PrintsSummaryAndNonEmptyBuckets) {
+  RtHist h;
+  std::memset(&h, 0, sizeof(h));
+  rt_hist_add(&h, 40000, 1);
+  rt_hist_add(&h, 40000, 2);
+
+  char buf[1024] = {0};
+  FILE* out = fmemopen(buf, sizeof(buf) - 1, "w");
+  ASSERT_NE(out, nullptr);
+  rt_hist_print(&h, out);
+  fclose(out);
+
+  EXPECT_NE(std::strstr(buf, "wakeups=2 overruns=1 missed=1"), nullptr);
+  EXPECT_NE(std::strstr(buf, "[      32,       64) us          2  100.00%"), nullptr);
+  int rows = 0;
+  for (const char* p = buf; *p; ++p) rows += (*p == '\n');
+  EXPECT_EQ(rows, 2);
+}
+
+// Datagram socketpair: one frame per datagram, like CAN_RAW
+static struct can_frame cmd_frame(uint16_t om, uint16_t v) {
+  struct can_frame f;
+  std::memset(&f, 0, sizeof(f));
+  f.can_id = 0x201; f.len = 8;
+  f.data[0] = om & 0xFF; f.data[1] = om >> 8;
+  f.data[2] = v & 0xFF;  f.data[3] = v >> 8;
+  return f;
+}
+
+TEST(BatchedIo, DrainKeepsNewestCommandAcrossBatches) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+
+  // More than one recvmmsg batch, with a foreign ID mixed in
+  const unsigned n = PLANT_RX_BATCH + 5;
+  std::vector<struct can_frame> burst;
+  for (unsigned i = 0; i < n; i++) burst.push_back(cmd_frame(100 + i, 700 + i));
+  burst[3].can_id = 0x123;
+  ASSERT_EQ(plant_tx_batch(sv[0], burst.data(), n), (int)n);
+
+  double om = -1, v = -1;
+  struct canfd_frame newest;
+  unsigned n_cmd = 0;
+  unsigned hooked = 0;
+  auto count_hook = [](const struct canfd_frame*, uint64_t, void* u) { ++*static_cast<unsigned*>(u); };
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, &newest, &n_cmd, count_hook, &hooked), (int)n);
+  EXPECT_EQ(n_cmd, n - 1);
+  EXPECT_EQ(hooked, n - 1);
+  EXPECT_DOUBLE_EQ(om, 100 + n - 1);
+  EXPECT_DOUBLE_EQ(v, 700 + n - 1);
+  EXPECT_EQ(std::memcmp(&newest, &burst[n - 1], sizeof(burst[0])), 0);
+
+  // Empty queue: returns at once and leaves the commands alone
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, nullptr, &n_cmd, nullptr, nullptr), 0);
+  EXPECT_EQ(n_cmd, 0u);
+  EXPECT_DOUBLE_EQ(om, 100 + n - 1);
+
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST(BatchedIo, DrainRejectsShortDatagrams) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+  struct can_frame f = cmd_frame(1234, 2000);
+  ASSERT_EQ(send(sv[0], &f, 8, 0), 8);
+  double om = -1, v = -1;
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, nullptr, nullptr, nullptr, nullptr), 0);
+  EXPECT_DOUBLE_EQ(om, -1);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST(BatchedIo, DrainTakesFdCommandsAlongsideClassic) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+  struct can_frame c = cmd_frame(1000, 900);
+  ASSERT_EQ(plant_tx_batch(sv[0], &c, 1), 1);
+
+  // 12-byte FD command: 1234.5 rpm, 987.25 rpm in Q16.16
+  struct canfd_frame fd[2];
+  std::memset(fd, 0, sizeof(fd));
+  for (auto& f : fd) { f.can_id = 0x201; f.len = CTRL_FD_CMD_LEN; f.flags = CANFD_BRS; }
+  const uint32_t om_q = 1234u * 65536u + 32768u, v_q = 987u * 65536u + 16384u;
+  std::memcpy(&fd[1].data[0], &om_q, 4);   // little-endian host
+  std::memcpy(&fd[1].data[4], &v_q, 4);
+  fd[0].can_id = 0x123;
+  ASSERT_EQ(plant_tx_batch_fd(sv[0], fd, 2), 2);
+
+  double om = -1, v = -1;
+  unsigned n_cmd = 0;
+  struct canfd_frame newest;
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, &newest, &n_cmd, nullptr, nullptr), 3);
+  EXPECT_EQ(n_cmd, 2u);
+  EXPECT_DOUBLE_EQ(om, 1234.5);
+  EXPECT_DOUBLE_EQ(v, 987.25);
+  EXPECT_EQ(newest.len, CTRL_FD_CMD_LEN);
+
+  // a recorder digest (first 8 bytes, FD length kept) decodes the same
+  struct can_frame d{};
+  d.can_id = 0x201; d.len = CTRL_FD_CMD_LEN;
+  std::memcpy(d.data, newest.data, 8);
+  om = v = -1;
+  ASSERT_TRUE(plant_unpack_cmd(&d, &om, &v));
+  EXPECT_DOUBLE_EQ(om, 1234.5);
+  EXPECT_DOUBLE_EQ(v, 987.25);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST(BatchedIo, DrainRebasesAnotherLoopsCommand) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+  struct can_frame c = cmd_frame(1500, 800);
+  c.can_id = 0x221;                       // loop 1 with id_stride=0x20
+  ASSERT_EQ(plant_tx_batch(sv[0], &c, 1), 1);
+
+  plant_set_id_off(0x20);
+  double om = -1, v = -1;
+  struct canfd_frame newest;
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, &newest, nullptr, nullptr, nullptr), 1);
+  plant_set_id_off(0);
+  EXPECT_DOUBLE_EQ(om, 1500);
+  EXPECT_DOUBLE_EQ(v, 800);
+  EXPECT_EQ(newest.can_id, 0x201u);       // what the recorder and replay see
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST(RttHist, QuantilesWithinOneSixteenth) {
+  RttHist h;
+  std::memset(&h, 0, sizeof(h));
+  for (uint64_t i = 1; i <= 1000; i++) rtt_hist_add(&h, i * 1000);   // 1 .. 1000 us
+  EXPECT_EQ(h.n, 1000u);
+  EXPECT_EQ(h.min_ns, 1000u);
+  EXPECT_EQ(h.max_ns, 1000000u);
+  const uint64_t p50 = rtt_hist_quantile_ns(&h, 0.50), p99 = rtt_hist_quantile_ns(&h, 0.99);
+  EXPECT_GE(p50, 500000u);
+  EXPECT_LE(p50, 500000u + 500000u / 16);
+  EXPECT_GE(p99, 990000u);
+  EXPECT_LE(p99, 1000000u);                 // capped at the observed max
+  EXPECT_EQ(rtt_hist_quantile_ns(&h, 1.0), 1000000u);
+
+  // small values are exact, huge ones land in the last bucket
+  RttHist s;
+  std::memset(&s, 0, sizeof(s));
+  for (uint64_t v = 0; v < 32; v++) rtt_hist_add(&s, v);
+  EXPECT_EQ(rtt_hist_quantile_ns(&s, 0.5), 15u);
+  rtt_hist_add(&s, UINT64_MAX / 2);
+  EXPECT_EQ(s.bucket[RTT_BUCKETS - 1], 1u);
+}
+
+TEST(RttTrack, MatchesFirstEchoOnly) {
+  RttTrack t;
+  std::memset(&t, 0, sizeof(t));
+  const uint8_t a = rtt_next_seq(&t), b = rtt_next_seq(&t);
+  EXPECT_EQ(a, 1);
+  EXPECT_EQ(b, 2);
+  rtt_on_tx(&t, a, 1000000);
+  rtt_on_tx(&t, b, 2000000);
+
+  EXPECT_TRUE(rtt_on_rx(&t, a, 1250000));    // 250 us
+  EXPECT_FALSE(rtt_on_rx(&t, a, 1500000));   // controller repeats the echo until a newer 0x202
+  EXPECT_FALSE(rtt_on_rx(&t, 0, 1500000));   // nothing latched yet
+  EXPECT_FALSE(rtt_on_rx(&t, b, 2000000 + 2000000000ull));   // 2 s late: not this frame's answer
+  EXPECT_EQ(t.matched, 1u);
+  EXPECT_EQ(t.unmatched, 2u);
+  EXPECT_EQ(t.stale, 1u);
+  EXPECT_EQ(t.h.n, 1u);
+  EXPECT_EQ(t.h.min_ns, 250000u);
+
+  // the sequence wraps like the controller's uint8_t count
+  t.sent = 255;
+  EXPECT_EQ(rtt_next_seq(&t), 0);
+}
+
+TEST(RttTrack, ClassicCountJumpStopsMeasuring) {
+  RttTrack t;
+  std::memset(&t, 0, sizeof(t));
+  t.counted = t.desynced = true;   // as plant_user starts a classic run
+  for (int i = 1; i <= 5; i++) rtt_on_tx(&t, rtt_next_seq(&t), 1000000u * i);
+
+  EXPECT_FALSE(rtt_on_rx(&t, 3, 5100000));   // cannot tell yet which 0x202 that count names
+  EXPECT_TRUE(rtt_on_rx(&t, 5, 5100000));    // the newest one: the counts agree
+  rtt_on_tx(&t, rtt_next_seq(&t), 6000000);
+  rtt_on_tx(&t, rtt_next_seq(&t), 7000000);
+  EXPECT_TRUE(rtt_on_rx(&t, 6, 7200000));    // in step with one 0x202 in flight
+  EXPECT_FALSE(rtt_on_rx(&t, 6, 7300000));   // repeat: in step, already answered
+  EXPECT_EQ(t.unmatched, 1u);
+  EXPECT_EQ(t.desync, 1u);
+
+  // controller reloaded: its count restarts at 1 while ours is at 7
+  EXPECT_FALSE(rtt_on_rx(&t, 1, 7400000));
+  EXPECT_TRUE(t.desynced);
+  // and advances with ours from there; consistent by itself, still not trusted
+  rtt_on_tx(&t, rtt_next_seq(&t), 8000000);
+  EXPECT_FALSE(rtt_on_rx(&t, 2, 8200000));
+  EXPECT_EQ(t.desync, 3u);
+  EXPECT_EQ(t.matched, 2u);
+
+  // an echo naming the newest 0x202 puts it back in step
+  rtt_on_tx(&t, rtt_next_seq(&t), 9000000);
+  EXPECT_TRUE(rtt_on_rx(&t, 9, 9300000));
+  EXPECT_FALSE(t.desynced);
+  EXPECT_EQ(t.h.n, 3u);          // 100, 1200 and 300 us; nothing from the parted count
+
+  // an echo ahead of anything sent (plant restarted, controller kept counting)
+  EXPECT_FALSE(rtt_on_rx(&t, 40, 9400000));
+  EXPECT_EQ(t.desync, 4u);
+}
+
+TEST(RttTrack, EchoByteByFrameLength) {
+  struct canfd_frame f;
+  std::memset(&f, 0, sizeof(f));
+  f.can_id = 0x201;
+  f.len = 8;  f.data[CTRL_ECHO_BYTE] = 7;
+  EXPECT_EQ(plant_cmd_echo(&f), 7);
+  f.len = CTRL_FD_CMD_LEN; f.data[CTRL_FD_ECHO_BYTE] = 42;
+  EXPECT_EQ(plant_cmd_echo(&f), 42);
+  f.len = 4;
+  EXPECT_EQ(plant_cmd_echo(&f), -1);
+}
+
+TEST(BatchedIo, DrainHandsReceiveTimeToHook) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+  // AF_UNIX takes SO_TIMESTAMPNS; either way the hook must see a current CLOCK_REALTIME
+  EXPECT_NE(plant_enable_rx_timestamps(sv[1]), -1);
+
+  struct timespec t0;
+  clock_gettime(CLOCK_REALTIME, &t0);
+  struct can_frame c = cmd_frame(1000, 900);
+  ASSERT_EQ(plant_tx_batch(sv[0], &c, 1), 1);
+
+  double om = -1, v = -1;
+  uint64_t rx_ns = 0;
+  auto stamp_hook = [](const struct canfd_frame*, uint64_t ns, void* u) { *static_cast<uint64_t*>(u) = ns; };
+  EXPECT_EQ(plant_rx_drain(sv[1], &om, &v, nullptr, nullptr, stamp_hook, &rx_ns), 1);
+  struct timespec t1;
+  clock_gettime(CLOCK_REALTIME, &t1);
+  EXPECT_GE(rx_ns, (uint64_t)t0.tv_sec * 1000000000ull + (uint64_t)t0.tv_nsec);
+  EXPECT_LE(rx_ns, (uint64_t)t1.tv_sec * 1000000000ull + (uint64_t)t1.tv_nsec);
+  close(sv[0]);
+  close(sv[1]);
+}